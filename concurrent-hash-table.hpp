@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+#include "hash-table.hpp"
+
+// A hash table that's safe to use from many threads at once, built from a
+// power-of-2 number of `HashTable` shards, each behind its own reader-writer
+// lock. Lookups take their shard's lock shared, so readers only contend with
+// writers to the same shard.
+//
+// Each shard's table places keys by the high bits of their mixed hash (and
+// tags them with bits below those). A key's shard comes from the high bits
+// of that hash mixed once more. The shard is then a function of every bit,
+// including the ones that place the key, but decorrelated from them, so
+// keys sharing a shard still spread across its slots. That's weaker than
+// picking the shard from bits the table never uses; there are none to pick,
+// since a table uses more high bits as it grows. (The low bits of the mixed
+// hash won't do either: multiplying by an odd constant leaves them
+// depending only on the key's low bits.)
+//
+// Keys are hashed once per operation, outside the shard's lock; the shard's
+// table is handed that hash rather than computing it again.
+//
+// Since another thread may change an entry as soon as its shard is unlocked,
+// nothing hands out references or iterators: `find` returns a copy, and
+// `visit` and `for_each` run a callback while the shard is locked. Callbacks
+// mustn't use the same table, or they may deadlock.
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class KeyEqual = std::equal_to<Key>,
+	class Probe = LinearProbing,
+	class Allocator = std::allocator<std::pair<const Key, T>>,
+	bool CacheHash = false
+>
+class ConcurrentHashTable {
+public:
+	using Table = HashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>;
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = std::pair<const Key, T>;
+	using size_type = size_t;
+	using hasher = Hash;
+	using key_equal = KeyEqual;
+	using allocator_type = Allocator;
+
+	static constexpr size_t DEFAULT_SHARDS = 32;
+
+private:
+	// Each shard gets its own cache lines, so locking one doesn't slow
+	// down threads using its neighbours.
+	struct alignas(64) Shard {
+		mutable std::shared_mutex lock;
+		Table table;
+
+		Shard(const Hash& hash, const KeyEqual& cmp, const allocator_type& alloc) : table(0, hash, cmp, alloc) { }
+	};
+
+	// Shards are allocated separately since locks can't be moved.
+	std::vector<std::unique_ptr<Shard>> shards;
+	size_t mask;
+
+	size_t mix(const Key& key) const {
+		return Table::mix(key, this->shards[0]->table.hashf);
+	}
+	Shard& shard_for(size_t mixed) const noexcept {
+		// the 64-bit finalizer from SplitMix64
+		uint64_t x = mixed;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return *this->shards[(size_t) (((unsigned __int128) x * (this->mask + 1)) >> 64)];
+	}
+	// The entry for `key` in `shard`, whose lock must be held.
+	static typename Table::value_type* find_in(const Shard& shard, const Key& key, size_t mixed) {
+		if (shard.table.capacity == 0) {
+			return nullptr;
+		}
+		auto [contains, index] = shard.table.find_slot(key, mixed);
+		return contains ? &*shard.table.slots.items[index] : nullptr;
+	}
+
+public:
+	explicit ConcurrentHashTable(size_t shard_count = DEFAULT_SHARDS, const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{}, const allocator_type& alloc = allocator_type{}) {
+		size_t count = 1;
+		while (count < shard_count) {
+			count <<= 1;
+		}
+		this->shards.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			this->shards.push_back(std::make_unique<Shard>(hash, cmp, alloc));
+		}
+		this->mask = count - 1;
+	}
+	ConcurrentHashTable(const ConcurrentHashTable&) = delete;
+	ConcurrentHashTable& operator=(const ConcurrentHashTable&) = delete;
+
+	size_t shard_count() const noexcept {
+		return this->mask + 1;
+	}
+	// Totals every shard in turn, so with concurrent writers the result
+	// may never have been the size at any single moment.
+	size_t size() const {
+		size_t total = 0;
+		for (size_t i = 0; i <= this->mask; i++) {
+			std::shared_lock guard(this->shards[i]->lock);
+			total += this->shards[i]->table.size();
+		}
+		return total;
+	}
+	bool empty() const {
+		return this->size() == 0;
+	}
+
+	bool contains(const Key& key) const {
+		size_t mixed = this->mix(key);
+		const Shard& shard = this->shard_for(mixed);
+		std::shared_lock guard(shard.lock);
+		return ConcurrentHashTable::find_in(shard, key, mixed) != nullptr;
+	}
+	// A copy of the value for `key`, if there is one.
+	std::optional<T> find(const Key& key) const {
+		size_t mixed = this->mix(key);
+		const Shard& shard = this->shard_for(mixed);
+		std::shared_lock guard(shard.lock);
+		auto entry = ConcurrentHashTable::find_in(shard, key, mixed);
+		return entry == nullptr ? std::nullopt : std::optional<T>(entry->second);
+	}
+	// Calls `f(value)` with the shard's lock held shared, if `key` exists;
+	// returns whether it did.
+	template<class F>
+	bool visit(const Key& key, F&& f) const {
+		size_t mixed = this->mix(key);
+		const Shard& shard = this->shard_for(mixed);
+		std::shared_lock guard(shard.lock);
+		auto entry = ConcurrentHashTable::find_in(shard, key, mixed);
+		if (entry == nullptr) {
+			return false;
+		}
+		std::forward<F>(f)(std::as_const(entry->second));
+		return true;
+	}
+
+	// Returns `true` if `key` was inserted, or `false` if an existing
+	// value was replaced.
+	template<class M>
+	bool insert_or_assign(const Key& key, M&& obj) {
+		size_t mixed = this->mix(key);
+		Shard& shard = this->shard_for(mixed);
+		std::unique_lock guard(shard.lock);
+		return shard.table.insert_or_assign_mixed(key, mixed, std::forward<M>(obj)).second;
+	}
+	template<class M>
+	bool insert_or_assign(Key&& key, M&& obj) {
+		size_t mixed = this->mix(key);
+		Shard& shard = this->shard_for(mixed);
+		std::unique_lock guard(shard.lock);
+		return shard.table.insert_or_assign_mixed(std::move(key), mixed, std::forward<M>(obj)).second;
+	}
+	// Returns a copy of the value for `key`, first inserting `make()` if
+	// there isn't one. Hits only take the shard's lock shared; `make` is
+	// called with the lock held exclusively, at most once.
+	template<class F>
+	T compute_if_absent(const Key& key, F&& make) {
+		size_t mixed = this->mix(key);
+		Shard& shard = this->shard_for(mixed);
+		{
+			std::shared_lock guard(shard.lock);
+			auto entry = ConcurrentHashTable::find_in(shard, key, mixed);
+			if (entry != nullptr) {
+				return entry->second;
+			}
+		}
+		std::unique_lock guard(shard.lock);
+		// another writer may have inserted it between the two locks
+		auto entry = ConcurrentHashTable::find_in(shard, key, mixed);
+		if (entry != nullptr) {
+			return entry->second;
+		}
+		return (*shard.table.try_emplace_mixed(key, mixed, std::forward<F>(make)()).first).second;
+	}
+	size_t erase(const Key& key) {
+		size_t mixed = this->mix(key);
+		Shard& shard = this->shard_for(mixed);
+		std::unique_lock guard(shard.lock);
+		if (shard.table.capacity == 0) {
+			return 0;
+		}
+		auto [contains, index] = shard.table.find_slot(key, mixed);
+		if (!contains) {
+			return 0;
+		}
+		shard.table.erase_at(index);
+		return 1;
+	}
+	void clear() {
+		for (size_t i = 0; i <= this->mask; i++) {
+			std::unique_lock guard(this->shards[i]->lock);
+			this->shards[i]->table.clear();
+		}
+	}
+	// Makes room for `count` entries in total, split evenly between shards.
+	void reserve(size_t count) {
+		size_t per_shard = (count + this->mask) / (this->mask + 1);
+		for (size_t i = 0; i <= this->mask; i++) {
+			std::unique_lock guard(this->shards[i]->lock);
+			this->shards[i]->table.reserve(per_shard);
+		}
+	}
+
+	// Calls `f(entry)` for every entry, one shard at a time, holding that
+	// shard's lock shared. Entries inserted or erased in other shards
+	// meanwhile may or may not be seen.
+	template<class F>
+	void for_each(F&& f) const {
+		for (size_t i = 0; i <= this->mask; i++) {
+			std::shared_lock guard(this->shards[i]->lock);
+			this->shards[i]->table.for_each(f);
+		}
+	}
+	// As the `const` `for_each`, but holding each lock exclusively, so `f`
+	// may modify values.
+	template<class F>
+	void for_each(F&& f) {
+		for (size_t i = 0; i <= this->mask; i++) {
+			std::unique_lock guard(this->shards[i]->lock);
+			this->shards[i]->table.for_each(f);
+		}
+	}
+	// Calls `f(table)` with shard `index`'s table, holding its lock shared.
+	// A traversal can be split across threads by giving each its own
+	// indices below `shard_count()`.
+	template<class F>
+	void for_shard(size_t index, F&& f) const {
+		std::shared_lock guard(this->shards[index]->lock);
+		std::forward<F>(f)(std::as_const(this->shards[index]->table));
+	}
+
+	hasher hash_function() const {
+		return this->shards[0]->table.hash_function();
+	}
+	key_equal key_eq() const {
+		return this->shards[0]->table.key_eq();
+	}
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include "hash-table.hpp"
+
+// A bounded cache on a `HashTable`: it holds at most `max_entries()`
+// entries, and inserting a new key into a full table evicts one by CLOCK.
+// Each slot stores, beside its value, a "referenced" bit that hits set and
+// an optional expiry time. To evict, a hand sweeps the slots in order,
+// clearing the bits it finds set and evicting the first entry whose bit was
+// already clear (or that has expired), so entries hit since the hand last
+// passed get a second chance. The slot array is sized for `max_entries()`
+// up front and never grows, so nothing is allocated after construction
+// beyond what the entries' own constructors allocate, and nothing is kept
+// outside the table.
+//
+// Expired entries are never returned, and count towards `size()` until
+// they're erased: when an insert finds them, when the hand reaches them, or
+// by `erase_expired`. Lookups leave them, since erasing moves other entries.
+// Times come from `Clock`; lookups only ask it for the time when they find
+// an entry that has an expiry.
+//
+// `find` sets its entry's bit, so it isn't `const`; `peek` and `contains`
+// look without counting as a hit. Pointers to values stay valid until the
+// next insert or erase.
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class KeyEqual = std::equal_to<Key>,
+	class Probe = LinearProbing,
+	class Allocator = std::allocator<std::pair<const Key, T>>,
+	bool CacheHash = false,
+	class Clock = std::chrono::steady_clock
+>
+class EvictingHashTable {
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using size_type = size_t;
+	using hasher = Hash;
+	using key_equal = KeyEqual;
+	using allocator_type = Allocator;
+	using clock = Clock;
+	using time_point = typename Clock::time_point;
+	using duration = typename Clock::duration;
+
+private:
+	// What each slot maps its key to.
+	struct Entry {
+		T value;
+		bool referenced;
+		// `time_point::max()` if it never expires.
+		time_point expires;
+
+		template<class... Args>
+		explicit Entry(time_point expires, Args&&... args) : value(std::forward<Args>(args)...), referenced(false), expires(expires) { }
+
+		bool expired(time_point now) const noexcept {
+			return this->expires <= now;
+		}
+		bool expired() const {
+			return this->expires != time_point::max() && this->expired(Clock::now());
+		}
+	};
+	using Table = HashTable<Key, Entry, Hash, KeyEqual, Probe, Allocator, CacheHash>;
+
+	Table table;
+	size_t limit;
+	// The next slot CLOCK's hand looks at.
+	size_t hand;
+	size_t evicted;
+
+	Entry& entry_at(size_t index) const noexcept {
+		return (*this->table.slots.items[index]).second;
+	}
+	// The slot holding an unexpired entry for `key`, or `capacity`.
+	size_t live_slot(const Key& key, size_t mixed) const {
+		if (this->table.capacity == 0) {
+			return 0;
+		}
+		auto [contains, index] = this->table.find_slot(key, mixed);
+		if (!contains || this->entry_at(index).expired()) {
+			return this->table.capacity;
+		}
+		return index;
+	}
+	// As `live_slot`, but erasing an expired entry for `key`, which only
+	// inserts may do.
+	size_t reclaim_slot(const Key& key, size_t mixed) {
+		if (this->table.capacity == 0) {
+			return 0;
+		}
+		auto [contains, index] = this->table.find_slot(key, mixed);
+		if (!contains) {
+			return this->table.capacity;
+		}
+		if (this->entry_at(index).expired()) {
+			this->table.erase_at(index);
+			return this->table.capacity;
+		}
+		return index;
+	}
+	// Erases one entry, sweeping the hand on from where it last stopped; the
+	// table mustn't be empty. Since the hand clears every bit it passes,
+	// this takes at most one lap plus a slot.
+	void evict_one() {
+		size_t cap = this->table.capacity;
+		time_point now = Clock::now();
+		for (;; this->hand++) {
+			if (this->hand >= cap) {
+				this->hand = 0;
+			}
+			if (this->table.slots.ctrl[this->hand] == ht_detail::CTRL_EMPTY) {
+				continue;
+			}
+			Entry& entry = this->entry_at(this->hand);
+			if (entry.referenced && !entry.expired(now)) {
+				entry.referenced = false;
+				continue;
+			}
+			// whatever erasing shifts into this slot is looked at next
+			this->table.erase_at(this->hand);
+			this->evicted++;
+			return;
+		}
+	}
+	// Inserts a new entry for `key`, which wasn't in the table, evicting one
+	// first if the table is full.
+	template<class K, class... Args>
+	T* insert_new(K&& key, size_t mixed, time_point expires, Args&&... args) {
+		if (this->table.capacity == 0) {
+			// only after being moved from
+			this->table.reserve(this->limit);
+		}
+		auto index = this->table.find_slot(key, mixed).second;
+		if (this->table.len >= this->limit) {
+			this->evict_one();
+			// evicting can move entries along the new key's probe
+			index = this->table.find_slot(key, mixed).second;
+		}
+		auto out = this->table.emplace_unique_hint(
+			index,
+			mixed,
+			std::piecewise_construct,
+			std::forward_as_tuple(std::forward<K>(key)),
+			std::forward_as_tuple(expires, std::forward<Args>(args)...)
+		);
+		return &(*out.first).second.value;
+	}
+	template<class K, class M>
+	bool assign(K&& key, M&& obj, time_point expires) {
+		size_t mixed = Table::mix(key, this->table.hashf);
+		size_t index = this->reclaim_slot(key, mixed);
+		if (index == this->table.capacity) {
+			this->insert_new(std::forward<K>(key), mixed, expires, std::forward<M>(obj));
+			return true;
+		}
+		Entry& entry = this->entry_at(index);
+		entry.value = std::forward<M>(obj);
+		entry.expires = expires;
+		return false;
+	}
+	static time_point expiry_after(duration ttl) {
+		return Clock::now() + ttl;
+	}
+
+public:
+	// Throws `std::invalid_argument` if `max_entries` is 0.
+	explicit EvictingHashTable(size_t max_entries, const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{}, const allocator_type& alloc = allocator_type{})
+		: table(0, hash, cmp, alloc), limit(max_entries), hand(0), evicted(0)
+	{
+		if (max_entries == 0) {
+			throw std::invalid_argument("A cache must hold at least one entry");
+		}
+		this->table.reserve(max_entries);
+	}
+
+	size_t size() const noexcept {
+		return this->table.size();
+	}
+	bool empty() const noexcept {
+		return this->table.empty();
+	}
+	size_t max_entries() const noexcept {
+		return this->limit;
+	}
+	size_t bucket_count() const noexcept {
+		return this->table.bucket_count();
+	}
+	// Entries evicted to make room since construction; expired entries
+	// erased other than by evicting aren't counted.
+	size_t evictions() const noexcept {
+		return this->evicted;
+	}
+
+	// The value for `key`, if it's there and unexpired, marking it as hit.
+	T* find(const Key& key) {
+		size_t index = this->live_slot(key, Table::mix(key, this->table.hashf));
+		if (index == this->table.capacity) {
+			return nullptr;
+		}
+		Entry& entry = this->entry_at(index);
+		// don't dirty the cache line if it's already set
+		if (!entry.referenced) {
+			entry.referenced = true;
+		}
+		return &entry.value;
+	}
+	// As `find`, but without marking the entry as hit.
+	const T* peek(const Key& key) const {
+		size_t index = this->live_slot(key, Table::mix(key, this->table.hashf));
+		return index == this->table.capacity ? nullptr : &this->entry_at(index).value;
+	}
+	bool contains(const Key& key) const {
+		return this->peek(key) != nullptr;
+	}
+
+	// Inserts `T(args...)` for `key` if it isn't there (or has expired),
+	// with no expiry. Returns the value for `key` and whether it was
+	// inserted; inserting doesn't count as a hit.
+	template<class... Args>
+	std::pair<T*, bool> try_emplace(const Key& key, Args&&... args) {
+		size_t mixed = Table::mix(key, this->table.hashf);
+		size_t index = this->reclaim_slot(key, mixed);
+		if (index != this->table.capacity) {
+			return std::make_pair(&this->entry_at(index).value, false);
+		}
+		return std::make_pair(this->insert_new(key, mixed, time_point::max(), std::forward<Args>(args)...), true);
+	}
+	template<class... Args>
+	std::pair<T*, bool> try_emplace(Key&& key, Args&&... args) {
+		size_t mixed = Table::mix(key, this->table.hashf);
+		size_t index = this->reclaim_slot(key, mixed);
+		if (index != this->table.capacity) {
+			return std::make_pair(&this->entry_at(index).value, false);
+		}
+		return std::make_pair(this->insert_new(std::move(key), mixed, time_point::max(), std::forward<Args>(args)...), true);
+	}
+	// Returns `true` if `key` was inserted, or `false` if an existing value
+	// was replaced; either way, the entry no longer expires.
+	template<class M>
+	bool insert_or_assign(const Key& key, M&& obj) {
+		return this->assign(key, std::forward<M>(obj), time_point::max());
+	}
+	template<class M>
+	bool insert_or_assign(Key&& key, M&& obj) {
+		return this->assign(std::move(key), std::forward<M>(obj), time_point::max());
+	}
+	// As `insert_or_assign`, but the entry expires `ttl` from now.
+	template<class M>
+	bool insert_or_assign(const Key& key, M&& obj, duration ttl) {
+		return this->assign(key, std::forward<M>(obj), EvictingHashTable::expiry_after(ttl));
+	}
+	template<class M>
+	bool insert_or_assign(Key&& key, M&& obj, duration ttl) {
+		return this->assign(std::move(key), std::forward<M>(obj), EvictingHashTable::expiry_after(ttl));
+	}
+	// Makes the entry for `key` expire `ttl` from now; returns whether there
+	// was one.
+	bool expire_after(const Key& key, duration ttl) {
+		size_t index = this->live_slot(key, Table::mix(key, this->table.hashf));
+		if (index == this->table.capacity) {
+			return false;
+		}
+		this->entry_at(index).expires = EvictingHashTable::expiry_after(ttl);
+		return true;
+	}
+
+	size_t erase(const Key& key) {
+		return this->table.erase(key);
+	}
+	// Keeps the slot array, so the table still never allocates.
+	void clear() {
+		this->table.erase(this->table.cbegin(), this->table.cend());
+		this->hand = 0;
+	}
+	// Erases every expired entry, returning how many there were.
+	size_t erase_expired() {
+		time_point now = Clock::now();
+		size_t erased = 0;
+		for (size_t i = 0; i < this->table.capacity;) {
+			if (this->table.slots.ctrl[i] != ht_detail::CTRL_EMPTY && this->entry_at(i).expired(now)) {
+				// erasing may pull a later entry back into slot `i`
+				this->table.erase_at(i);
+				erased++;
+			} else {
+				i++;
+			}
+		}
+		return erased;
+	}
+
+	// Calls `f(key, value)` for every unexpired entry, without marking any
+	// as hit.
+	template<class F>
+	void for_each(F&& f) const {
+		time_point now = Clock::now();
+		this->table.for_each([&](const auto& entry) {
+			if (!entry.second.expired(now)) {
+				f(entry.first, std::as_const(entry.second.value));
+			}
+		});
+	}
+
+	hasher hash_function() const {
+		return this->table.hash_function();
+	}
+	key_equal key_eq() const {
+		return this->table.key_eq();
+	}
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace ht_detail {
+	// The 64-bit finalizer from SplitMix64.
+	constexpr uint64_t frozen_mix(uint64_t x) noexcept {
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return x;
+	}
+	constexpr size_t frozen_ceil_pow2(size_t n) noexcept {
+		size_t out = 1;
+		while (out < n) {
+			out <<= 1;
+		}
+		return out;
+	}
+}
+
+// The default hash of a `FrozenHashTable`, which has to be usable at compile
+// time: FNV-1a over anything convertible to `std::string_view`, and a mix of
+// the value of integers and enums. It's transparent, so a table keyed by
+// `std::string_view` can be searched with a `const char*` or `std::string`.
+struct FrozenHash {
+	using is_transparent = void;
+
+	template<class K>
+	constexpr uint64_t operator()(const K& key) const noexcept {
+		if constexpr (std::is_convertible_v<const K&, std::string_view>) {
+			std::string_view bytes = key;
+			uint64_t hash = 0xcbf29ce484222325ull;
+			for (char c : bytes) {
+				hash = (hash ^ (unsigned char) c) * 0x100000001b3ull;
+			}
+			return ht_detail::frozen_mix(hash);
+		} else {
+			static_assert(std::is_integral_v<K> || std::is_enum_v<K>, "FrozenHash only hashes strings, integers and enums");
+			return ht_detail::frozen_mix((uint64_t) key);
+		}
+	}
+};
+
+// A read-only table of `N` entries fixed when it's built, which can be done
+// at compile time, e.g. `constexpr auto t = make_frozen_hash_table<std::string_view,
+// int>({{"one", 1}, {"two", 2}});`. Its hash is perfect: building it chooses,
+// for each of about `N`/2 buckets of keys, a seed that sends every key in the
+// bucket to a slot no other key has, so a lookup hashes once, reads the seed
+// and the one slot it names, and compares one key, with no probing.
+//
+// `Key` and `T` have to be literal types for the table to be built at compile
+// time; `Hash` has to be `constexpr` too, and return a `uint64_t` that no two
+// keys share. Building it throws `std::invalid_argument` (which at compile
+// time is an error) if two keys are equal or their hashes are.
+template<
+	class Key,
+	class T,
+	size_t N,
+	class Hash = FrozenHash,
+	class KeyEqual = std::equal_to<>
+>
+class FrozenHashTable {
+	static_assert(N > 0, "A frozen table must hold at least one entry");
+	static_assert(N < UINT32_MAX, "A frozen table holds fewer than 2^32 - 1 entries");
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = std::pair<Key, T>;
+	using size_type = size_t;
+	using hasher = Hash;
+	using key_equal = KeyEqual;
+	using const_iterator = typename std::array<value_type, N>::const_iterator;
+	using iterator = const_iterator;
+
+	// At a load of at most 0.8, and two keys per bucket on average.
+	static constexpr size_t SLOTS = ht_detail::frozen_ceil_pow2(N + N / 4);
+	static constexpr size_t BUCKETS = ht_detail::frozen_ceil_pow2((N + 1) / 2);
+
+private:
+	// Seeds tried for a bucket before giving up.
+	static constexpr uint32_t MAX_SEED = 1 << 20;
+
+	// In the order they were given.
+	std::array<value_type, N> items;
+	std::array<uint32_t, BUCKETS> seeds;
+	// Which of `items` is in each slot, or `N` if none is.
+	std::array<uint32_t, SLOTS> index;
+	Hash hashf;
+	KeyEqual cmp;
+
+	static constexpr size_t bucket_for(uint64_t hash) noexcept {
+		return (size_t) (hash >> 32) & (BUCKETS - 1);
+	}
+	static constexpr size_t slot_for(uint64_t hash, uint32_t seed) noexcept {
+		return (size_t) ht_detail::frozen_mix(hash ^ (seed * 0x9e3779b97f4a7c15ull)) & (SLOTS - 1);
+	}
+
+	// Which of `items` holds `key`, or `N`.
+	template<class K>
+	constexpr size_t index_of(const K& key) const {
+		uint64_t hash = this->hashf(key);
+		uint32_t i = this->index[FrozenHashTable::slot_for(hash, this->seeds[FrozenHashTable::bucket_for(hash)])];
+		return i != N && this->cmp(this->items[i].first, key) ? i : N;
+	}
+
+	template<size_t... I>
+	constexpr FrozenHashTable(const value_type (&entries)[N], std::index_sequence<I...>, const Hash& hash, const KeyEqual& cmp)
+		: items{{entries[I]...}}, seeds{}, index{}, hashf(hash), cmp(cmp)
+	{
+		this->build();
+	}
+
+	// Chooses every bucket's seed, placing the fullest buckets first, while
+	// the most slots are free.
+	constexpr void build() {
+		std::array<uint64_t, N> hashes{};
+		std::array<uint32_t, BUCKETS + 1> starts{};
+		for (size_t i = 0; i < N; i++) {
+			hashes[i] = this->hashf(this->items[i].first);
+			for (size_t j = 0; j < i; j++) {
+				if (hashes[i] != hashes[j]) {
+					continue;
+				}
+				if (this->cmp(this->items[i].first, this->items[j].first)) {
+					throw std::invalid_argument("A frozen table's keys must be unique");
+				}
+				throw std::invalid_argument("Two of a frozen table's keys have the same hash");
+			}
+			starts[FrozenHashTable::bucket_for(hashes[i]) + 1]++;
+		}
+		// sort the entries by bucket, counting sort style
+		for (size_t b = 0; b < BUCKETS; b++) {
+			starts[b + 1] += starts[b];
+		}
+		std::array<uint32_t, N> members{};
+		std::array<uint32_t, BUCKETS> filled{};
+		for (size_t i = 0; i < N; i++) {
+			size_t b = FrozenHashTable::bucket_for(hashes[i]);
+			members[starts[b] + filled[b]++] = (uint32_t) i;
+		}
+		std::array<uint32_t, BUCKETS> order{};
+		for (size_t b = 0; b < BUCKETS; b++) {
+			size_t at = b;
+			for (; at > 0 && filled[order[at - 1]] < filled[b]; at--) {
+				order[at] = order[at - 1];
+			}
+			order[at] = (uint32_t) b;
+		}
+
+		for (size_t s = 0; s < SLOTS; s++) {
+			this->index[s] = (uint32_t) N;
+		}
+		for (size_t b : order) {
+			if (filled[b] == 0) {
+				break;
+			}
+			uint32_t seed = 0;
+			while (!this->place(hashes, members, starts[b], starts[b + 1], seed)) {
+				if (++seed == MAX_SEED) {
+					throw std::invalid_argument("No seed places every key of a frozen table's bucket");
+				}
+			}
+			this->seeds[b] = seed;
+		}
+	}
+	// Puts the entries `members[first..last)` in the slots `seed` sends them
+	// to, if they're all free (and different), or else leaves every slot as
+	// it was.
+	constexpr bool place(const std::array<uint64_t, N>& hashes, const std::array<uint32_t, N>& members, size_t first, size_t last, uint32_t seed) {
+		for (size_t m = first; m < last; m++) {
+			size_t slot = FrozenHashTable::slot_for(hashes[members[m]], seed);
+			if (this->index[slot] != N) {
+				for (size_t undo = first; undo < m; undo++) {
+					this->index[FrozenHashTable::slot_for(hashes[members[undo]], seed)] = (uint32_t) N;
+				}
+				return false;
+			}
+			this->index[slot] = members[m];
+		}
+		return true;
+	}
+
+public:
+	constexpr explicit FrozenHashTable(const value_type (&entries)[N], const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{})
+		: FrozenHashTable(entries, std::make_index_sequence<N>{}, hash, cmp) { }
+
+	constexpr size_t size() const noexcept {
+		return N;
+	}
+	constexpr bool empty() const noexcept {
+		return false;
+	}
+	constexpr const_iterator begin() const noexcept {
+		return this->items.begin();
+	}
+	constexpr const_iterator end() const noexcept {
+		return this->items.end();
+	}
+
+	// The value for `key`, or `nullptr`.
+	template<class K>
+	constexpr const T* find(const K& key) const {
+		size_t i = this->index_of(key);
+		return i == N ? nullptr : &this->items[i].second;
+	}
+	template<class K>
+	constexpr bool contains(const K& key) const {
+		return this->index_of(key) != N;
+	}
+	template<class K>
+	constexpr const T& at(const K& key) const {
+		size_t i = this->index_of(key);
+		if (i == N) {
+			throw std::out_of_range("Key doesn't exist");
+		}
+		return this->items[i].second;
+	}
+
+	constexpr hasher hash_function() const {
+		return this->hashf;
+	}
+	constexpr key_equal key_eq() const {
+		return this->cmp;
+	}
+};
+
+template<class Key, class T, size_t N>
+constexpr FrozenHashTable<Key, T, N> make_frozen_hash_table(const std::pair<Key, T> (&entries)[N]) {
+	return FrozenHashTable<Key, T, N>(entries);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <ostream>
+#include <utility>
+
+#include "hash-table.hpp"
+
+// A set of keys on the same slot array, probing and growth as `HashTable`,
+// but with each slot holding a bare `Key` rather than a key-value pair, so a
+// set of 64-bit IDs needs no space for a mapped value or its padding. The
+// parameters are `HashTable`'s, less `T`. Keys can't be changed in place, so
+// `iterator` is the same as `const_iterator`.
+template<
+	class Key,
+	class Hash = std::hash<Key>,
+	class KeyEqual = std::equal_to<Key>,
+	class Probe = LinearProbing,
+	class Allocator = std::allocator<Key>,
+	bool CacheHash = false
+>
+class HashSet : public ht_detail::TableCore<ht_detail::SetEntries<Key>, Hash, KeyEqual, Probe, Allocator, CacheHash> {
+	using Core = ht_detail::TableCore<ht_detail::SetEntries<Key>, Hash, KeyEqual, Probe, Allocator, CacheHash>;
+	using typename Core::IndexNothrow;
+public:
+	using typename Core::value_type;
+
+	using Core::Core;
+	HashSet& operator=(std::initializer_list<value_type> ilist) {
+		Core::operator=(ilist);
+		return *this;
+	}
+
+	bool operator==(const HashSet& other) const noexcept(IndexNothrow::value) {
+		if (this->len != other.len) {
+			return false;
+		}
+		if (this->slots.items == other.slots.items) {
+			return true;
+		}
+		for (const Key& key : *this) {
+			if (!other.contains(key)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	bool operator!=(const HashSet& other) const noexcept(IndexNothrow::value) {
+		return !(*this == other);
+	}
+};
+
+#if __has_include(<memory_resource>)
+namespace pmr {
+	template<
+		class Key,
+		class Hash = std::hash<Key>,
+		class KeyEqual = std::equal_to<Key>,
+		class Probe = LinearProbing,
+		bool CacheHash = false
+	>
+	using HashSet = ::HashSet<Key, Hash, KeyEqual, Probe, std::pmr::polymorphic_allocator<Key>, CacheHash>;
+}
+#endif
+
+namespace std {
+	template<class Key, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+	void swap(HashSet<Key, Hash, KeyEqual, Probe, Allocator, CacheHash>& s1, HashSet<Key, Hash, KeyEqual, Probe, Allocator, CacheHash>& s2) noexcept(noexcept(s1.swap(s2))) {
+		s1.swap(s2);
+	}
+
+	template<class Key, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash, class Pred>
+	size_t erase_if(HashSet<Key, Hash, KeyEqual, Probe, Allocator, CacheHash>& c, Pred pred) {
+		auto old_size = c.size();
+		for (auto i = c.begin(), last = c.end(); i != last;) {
+			if (pred(*i)) {
+				i = c.erase(i);
+			} else {
+				++i;
+			}
+		}
+		return old_size - c.size();
+	}
+}
+
+template<class Key, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+std::ostream& operator<<(std::ostream& os, const HashSet<Key, Hash, KeyEqual, Probe, Allocator, CacheHash>& set) {
+	if (set.size() == 0) {
+		os << "HashSet {}";
+		return os;
+	}
+	os << "HashSet {" << std::endl;
+	for (const auto& key : set) {
+		os << "\t" << key << "," << std::endl;
+	}
+	os << "}";
+	return os;
+}
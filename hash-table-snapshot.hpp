@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if __has_include(<sys/mman.h>)
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#else
+#	include <fstream>
+#endif
+
+#include "hash-table.hpp"
+#include "ht-snapshot.h"
+
+// A read-only `HashTable` served straight from a binary snapshot, in the
+// format of ht-snapshot.h that the C table's `ht_snapshot_write` also uses.
+// `write` saves a table's control bytes and slots as they are, so `open`
+// only has to map the file and check its header; pages are read from disk
+// as lookups reach them, however large the table.
+//
+// Slots are saved byte for byte, so `Key` and `T` have to be trivially
+// copyable, and a snapshot can only be read by the same table type on the
+// same platform. The header records the slot size and layout, which are
+// checked, but not `Hash`, which has to give every process the same hashes
+// (as `std::hash` does for integers in the common standard libraries).
+//
+// Only the header is checked when a snapshot is opened; the slots aren't
+// read until lookups reach them. Slots damaged on disk can make lookups give
+// wrong answers, but never hang or read outside the snapshot: like the
+// table's, they give up after probing `bucket_count()` slots, even if no
+// slot is empty or Robin Hood distances are out of range.
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class KeyEqual = std::equal_to<Key>,
+	class Probe = LinearProbing,
+	class Allocator = std::allocator<std::pair<const Key, T>>,
+	bool CacheHash = false
+>
+class HashTableSnapshot {
+	static_assert(
+		std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<T>,
+		"snapshots copy entries byte for byte"
+	);
+	static_assert(ht_detail::Group::WIDTH - 1 <= HT_SNAPSHOT_MIRROR, "snapshots don't mirror enough control bytes");
+public:
+	using Table = HashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>;
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = std::pair<const Key, T>;
+	using size_type = size_t;
+	using hasher = Hash;
+	using key_equal = KeyEqual;
+
+private:
+	using HtItem = typename Table::HtItem;
+	using Slots = ht_detail::SlotView<HtItem>;
+	using ctrl_t = ht_detail::ctrl_t;
+
+	static constexpr uint64_t FLAGS = (Probe::TRACKS_DISTANCE ? HT_SNAPSHOT_DIST : 0) | (CacheHash ? HT_SNAPSHOT_HASHES : 0);
+	// Bytes written through one buffer, rather than an entry at a time.
+	static constexpr size_t CHUNK = 64 * 1024;
+
+	// Where each array starts in a snapshot of `cap` slots, and where the
+	// snapshot ends.
+	struct Layout {
+		size_t dist;
+		size_t hashes;
+		size_t items;
+		size_t end;
+
+		explicit Layout(size_t cap) noexcept {
+			auto align = [](size_t offset, size_t to) {
+				return (offset + to - 1) / to * to;
+			};
+			this->dist = sizeof(ht_snapshot_header) + cap + HT_SNAPSHOT_MIRROR;
+			this->hashes = align(this->dist + (Probe::TRACKS_DISTANCE ? cap : 0), alignof(size_t));
+			this->items = align(this->hashes + (CacheHash ? cap * sizeof(size_t) : 0), alignof(HtItem));
+			this->end = this->items + cap * sizeof(HtItem);
+		}
+	};
+
+	Slots slots{};
+	size_t len = 0;
+	// The mapping (or buffer) `open` made, if any, and its length.
+	void* map = nullptr;
+	size_t map_len = 0;
+	Hash hashf;
+	KeyEqual cmp;
+
+	// Writes `count` elements of `size` bytes, each filled in by
+	// `fill(index, out)`.
+	template<class F>
+	static void write_each(std::ostream& os, size_t count, size_t size, F&& fill) {
+		std::vector<char> chunk(std::max(CHUNK / size, (size_t) 1) * size);
+		size_t used = 0;
+		for (size_t i = 0; i < count; i++) {
+			fill(i, chunk.data() + used);
+			used += size;
+			if (used == chunk.size()) {
+				os.write(chunk.data(), used);
+				used = 0;
+			}
+		}
+		os.write(chunk.data(), used);
+	}
+	static void pad(std::ostream& os, size_t from, size_t to) {
+		static const char zeros[alignof(std::max_align_t)] = {};
+		while (from < to) {
+			size_t step = std::min(to - from, sizeof(zeros));
+			os.write(zeros, step);
+			from += step;
+		}
+	}
+
+	void unmap() noexcept {
+		if (this->map == nullptr) {
+			return;
+		}
+#if __has_include(<sys/mman.h>)
+		munmap(this->map, this->map_len);
+#else
+		delete[] (char*) this->map;
+#endif
+		this->map = nullptr;
+	}
+
+public:
+	// Views the snapshot in the `size` bytes at `data`, which aren't copied:
+	// they have to stay valid and unchanged for as long as this is used, and
+	// be aligned for the table's slots, as memory from `new` or `mmap` is.
+	// Throws `std::invalid_argument` if they aren't a snapshot of this table
+	// type.
+	HashTableSnapshot(const void* data, size_t size, const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{}) : hashf(hash), cmp(cmp) {
+		auto header = (const ht_snapshot_header*) data;
+		if (size < sizeof(ht_snapshot_header) || (uintptr_t) data % std::max(alignof(HtItem), alignof(uint64_t)) != 0) {
+			throw std::invalid_argument("Snapshot is truncated or misaligned");
+		}
+		if (std::memcmp(header->magic, HT_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+			|| header->version != HT_SNAPSHOT_VERSION
+			|| header->byte_order != HT_SNAPSHOT_BYTE_ORDER) {
+			throw std::invalid_argument("Not a snapshot this build can read");
+		}
+		if (header->kind != HT_SNAPSHOT_SLOTS || header->slot_size != sizeof(HtItem) || header->flags != FLAGS) {
+			throw std::invalid_argument("Snapshot is of another table type");
+		}
+		size_t cap = header->capacity;
+		// a capacity beyond the whole snapshot's size would overflow `Layout`
+		if (cap > size || header->size > Table::limit_for(cap, 1.0f) || header->heap_size != 0) {
+			throw std::invalid_argument("Snapshot is damaged");
+		}
+		Layout at(cap);
+		if (header->slots_offset != at.items || size != at.end) {
+			throw std::invalid_argument("Snapshot is damaged");
+		}
+		// nothing is ever written through these
+		auto base = (uint8_t*) data;
+		this->slots.items = cap == 0 ? nullptr : (HtItem*) (base + at.items);
+		this->slots.ctrl = (ctrl_t*) (base + sizeof(ht_snapshot_header));
+		this->slots.dist = Probe::TRACKS_DISTANCE ? base + at.dist : nullptr;
+		this->slots.hashes = CacheHash ? (size_t*) (base + at.hashes) : nullptr;
+		this->slots.cap = cap;
+		this->len = header->size;
+	}
+	// Maps the snapshot in the file at `path` read-only (or, where `mmap`
+	// isn't available, reads it into memory). Throws `std::runtime_error` if
+	// it can't, or `std::invalid_argument` as above.
+	static HashTableSnapshot open(const std::string& path, const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{}) {
+		void* map;
+		size_t size;
+#if __has_include(<sys/mman.h>)
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("Can't open snapshot " + path);
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			close(fd);
+			throw std::runtime_error("Can't read snapshot " + path);
+		}
+		size = (size_t) st.st_size;
+		map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED) {
+			throw std::runtime_error("Can't map snapshot " + path);
+		}
+		// lookups land all over the file, so reading ahead only wastes I/O
+		posix_madvise(map, size, POSIX_MADV_RANDOM);
+#else
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		if (!in) {
+			throw std::runtime_error("Can't open snapshot " + path);
+		}
+		size = (size_t) in.tellg();
+		map = new char[size];
+		in.seekg(0);
+		if (!in.read((char*) map, size)) {
+			delete[] (char*) map;
+			throw std::runtime_error("Can't read snapshot " + path);
+		}
+#endif
+		try {
+			HashTableSnapshot snapshot(map, size, hash, cmp);
+			snapshot.map = map;
+			snapshot.map_len = size;
+			return snapshot;
+		} catch (...) {
+#if __has_include(<sys/mman.h>)
+			munmap(map, size);
+#else
+			delete[] (char*) map;
+#endif
+			throw;
+		}
+	}
+	HashTableSnapshot(HashTableSnapshot&& other) noexcept(std::is_nothrow_move_constructible_v<Hash> && std::is_nothrow_move_constructible_v<KeyEqual>)
+		: slots(std::exchange(other.slots, Slots{})),
+		len(std::exchange(other.len, 0)),
+		map(std::exchange(other.map, nullptr)),
+		map_len(std::exchange(other.map_len, 0)),
+		hashf(std::move(other.hashf)),
+		cmp(std::move(other.cmp)) { }
+	HashTableSnapshot& operator=(HashTableSnapshot&& other) noexcept(std::is_nothrow_move_assignable_v<Hash> && std::is_nothrow_move_assignable_v<KeyEqual>) {
+		if (this != &other) {
+			this->unmap();
+			this->slots = std::exchange(other.slots, Slots{});
+			this->len = std::exchange(other.len, 0);
+			this->map = std::exchange(other.map, nullptr);
+			this->map_len = std::exchange(other.map_len, 0);
+			this->hashf = std::move(other.hashf);
+			this->cmp = std::move(other.cmp);
+		}
+		return *this;
+	}
+	HashTableSnapshot(const HashTableSnapshot&) = delete;
+	HashTableSnapshot& operator=(const HashTableSnapshot&) = delete;
+	~HashTableSnapshot() {
+		this->unmap();
+	}
+
+	// Writes `table` to `os`, which should be in binary mode; as with `<<`,
+	// failures are left in `os`'s state.
+	static void write(const Table& table, std::ostream& os) {
+		const auto& slots = table.slots;
+		size_t cap = table.capacity;
+		Layout at(cap);
+		ht_snapshot_header header = {};
+		std::memcpy(header.magic, HT_SNAPSHOT_MAGIC, sizeof(header.magic));
+		header.version = HT_SNAPSHOT_VERSION;
+		header.byte_order = HT_SNAPSHOT_BYTE_ORDER;
+		header.kind = HT_SNAPSHOT_SLOTS;
+		header.slot_size = sizeof(HtItem);
+		header.capacity = cap;
+		header.size = table.len;
+		header.slots_offset = at.items;
+		header.flags = FLAGS;
+		os.write((const char*) &header, sizeof(header));
+		// the mirrored tail is rebuilt for the widest group, whatever this
+		// build's is
+		HashTableSnapshot::write_each(os, cap + HT_SNAPSHOT_MIRROR, 1, [&](size_t i, char* out) {
+			*out = cap == 0 ? (char) ht_detail::CTRL_EMPTY : (char) slots.ctrl[i % cap];
+		});
+		// entries' bytes are copied, and empty slots zeroed
+		if constexpr (Probe::TRACKS_DISTANCE) {
+			HashTableSnapshot::write_each(os, cap, 1, [&](size_t i, char* out) {
+				*out = slots.ctrl[i] == ht_detail::CTRL_EMPTY ? 0 : (char) slots.dist[i];
+			});
+		}
+		HashTableSnapshot::pad(os, at.dist + (Probe::TRACKS_DISTANCE ? cap : 0), at.hashes);
+		if constexpr (CacheHash) {
+			HashTableSnapshot::write_each(os, cap, sizeof(size_t), [&](size_t i, char* out) {
+				size_t hash = slots.ctrl[i] == ht_detail::CTRL_EMPTY ? 0 : slots.hashes[i];
+				std::memcpy(out, &hash, sizeof(size_t));
+			});
+		}
+		HashTableSnapshot::pad(os, at.hashes + (CacheHash ? cap * sizeof(size_t) : 0), at.items);
+		HashTableSnapshot::write_each(os, cap, sizeof(HtItem), [&](size_t i, char* out) {
+			if (slots.ctrl[i] == ht_detail::CTRL_EMPTY) {
+				std::memset(out, 0, sizeof(HtItem));
+			} else {
+				std::memcpy(out, (const void*) (slots.items + i), sizeof(HtItem));
+			}
+		});
+	}
+
+	size_t size() const noexcept {
+		return this->len;
+	}
+	bool empty() const noexcept {
+		return this->len == 0;
+	}
+	size_t bucket_count() const noexcept {
+		return this->slots.cap;
+	}
+
+	// The entry for `key` in the snapshot, or `nullptr`.
+	const value_type* find(const Key& key) const {
+		const Slots& slots = this->slots;
+		if (slots.cap == 0) {
+			return nullptr;
+		}
+		size_t mixed = Table::mix(key, this->hashf);
+		auto [contains, index] = Probe::find(
+			slots,
+			Table::home(mixed, slots.cap),
+			Table::tag(mixed, slots.cap),
+			[&](size_t index) {
+				if constexpr (CacheHash) {
+					if (slots.hashes[index] != mixed) {
+						return false;
+					}
+				}
+				return this->cmp((*slots.items[index]).first, key);
+			},
+			[&](size_t index) {
+				if constexpr (CacheHash) {
+					return Table::home(slots.hashes[index], slots.cap);
+				} else {
+					return Table::home(Table::mix((*slots.items[index]).first, this->hashf), slots.cap);
+				}
+			}
+		);
+		return contains ? &*slots.items[index] : nullptr;
+	}
+	bool contains(const Key& key) const {
+		return this->find(key) != nullptr;
+	}
+	const T& at(const Key& key) const {
+		const value_type* entry = this->find(key);
+		if (entry == nullptr) {
+			throw std::out_of_range("Key doesn't exist");
+		}
+		return entry->second;
+	}
+
+	// Calls `f(entry)` for every entry, in slot order.
+	template<class F>
+	void for_each(F&& f) const {
+		for (size_t i = 0; i < this->slots.cap; i++) {
+			if (this->slots.full(i)) {
+				f(*this->slots.items[i]);
+			}
+		}
+	}
+	// A modifiable copy of the snapshot's entries.
+	Table load() const {
+		Table table(0, this->hashf, this->cmp);
+		table.reserve(this->len);
+		this->for_each([&](const value_type& entry) {
+			table.emplace(entry.first, entry.second);
+		});
+		return table;
+	}
+};
@@ -1,416 +1,2751 @@
+#pragma once
+
 #include <algorithm>
+#if defined(HT_STATS)
+#	include <atomic>
+#endif
 #if __cplusplus >= 202002L
 #	include <bit>
 #endif
+#if defined(HT_STATS)
+#	include <chrono>
+#endif
+#include <cmath>
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+#	include <coroutine>
+#endif
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <functional>
 #include <initializer_list>
+#include <iterator>
 #include <memory>
+#if __has_include(<memory_resource>)
+#	include <memory_resource>
+#endif
 #include <optional>
 #include <ostream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <type_traits>
 #include <utility>
-
-// Note that behavior is undefined if there are two keys `a` and `b` such that
-// `hash(a) != hash(b) && keyequal(a, b)`. (The inverse of `hash(a) == hash(b)
-// && !keyequal(a, b)` is well-defined, since the set of all key items may be
-// larger than the set of all `size_t` integers, so hash collisions are expected
-// and allowed.) Under these circumstances, an `insert` of one after the other
-// may or may not replace the other's contents, and a `find` or similar may
-// return either value.
-template<class Key, class T, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
-class HashTable {
-public:
-	using key_type = Key;
-	using mapped_type = T;
-	using value_type = std::pair<const Key, T>;
-	using size_type = size_t;
-	using difference_type = ptrdiff_t;
-	using hasher = Hash;
-	using key_equal = KeyEqual;
-	using allocator_type = std::allocator<std::pair<const Key, T>>;
-	using reference = value_type&;
-	using const_reference = const value_type&;
-	using pointer = value_type*;
-	using const_pointer = const value_type*;
-	class iterator;
-	class const_iterator;
-	using local_iterator = iterator;
-	using const_local_iterator = const_iterator;
-private:
-	using HtItem = std::optional<std::pair<const Key, T>>;
-
-	static const size_t FIB_MULT = 11400714819323198485ull;
-	static const size_t HT_PRIME = 151;
-	static const size_t INITIAL_CAPACITY = 32;
-
-	size_t capacity;
-	size_t len;
-	std::unique_ptr<HtItem[]> items;
-	Hash hashf;
-	KeyEqual cmp;
-
-	using HashNothrow = std::is_nothrow_invocable_r<size_t, Hash, const Key&>;
-	using IndexNothrow = std::conjunction<
-		HashTable::HashNothrow,
-		std::is_nothrow_invocable_r<bool, KeyEqual, const Key&, const Key&>
-	>;
-	using ItemNothrowDefault = std::conjunction<
-		std::is_nothrow_default_constructible<Key>,
-		std::is_nothrow_default_constructible<T>
-	>;
-	using ItemNothrowCopy = std::conjunction<
-		std::is_nothrow_copy_constructible<Key>,
-		std::is_nothrow_copy_constructible<T>
-	>;
-	using ItemNothrowMove = std::conjunction<
-		std::is_nothrow_move_constructible<Key>,
-		std::is_nothrow_move_constructible<T>
-	>;
-	using ItemNothrowDestructible = std::conjunction<
-		std::is_nothrow_destructible<Key>,
-		std::is_nothrow_destructible<T>
-	>;
-	using HashEqualNothrowDefault = std::conjunction<
-		std::is_nothrow_default_constructible<Hash>,
-		std::is_nothrow_default_constructible<KeyEqual>
-	>;
-	using HashEqualNothrowCopy = std::conjunction<
-		std::is_nothrow_copy_constructible<Hash>,
-		std::is_nothrow_copy_constructible<KeyEqual>
-	>;
-	using HashEqualNothrowMove = std::conjunction<
-		std::is_nothrow_move_constructible<Hash>,
-		std::is_nothrow_move_constructible<KeyEqual>
-	>;
-	using HashEqualNothrowDestructible = std::conjunction<
-		std::is_nothrow_destructible<Hash>,
-		std::is_nothrow_destructible<KeyEqual>
-	>;
-
-#if __cplusplus < 202002L
-	static inline size_t bit_ceil(size_t x) {
-		x--;
-		x |= x >> 1;
-		x |= x >> 2;
-		x |= x >> 4;
-		x |= x >> 8;
-		x |= x >> 16;
-		x |= x >> 32;
-		x++;
-		return x;
-	}
+#include <vector>
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#elif defined(__SSE2__)
+#	include <emmintrin.h>
 #endif
 
-	static size_t hash(const Key& val, size_t cap, const Hash &hashf) noexcept(HashNothrow::value) {
+#include "ht-bytes-hash.h"
+
+namespace ht_detail {
+	// Every slot has a one-byte control tag alongside it. An empty slot's tag
+	// is `CTRL_EMPTY` (the only value with the high bit set); a full slot's tag
+	// holds 7 bits of its key's hash. Probing scans tags a group at a time, so
+	// a key only has to be compared when its tag matches.
+	using ctrl_t = int8_t;
+	static constexpr ctrl_t CTRL_EMPTY = -128;
+
+	template<class U>
+	static inline int countr_zero(U x) noexcept {
 #if __cplusplus >= 202002L
-		int shift = std::countl_zero(cap) + 1;
+		return std::countr_zero(x);
+#else
+		return __builtin_ctzll(x);
+#endif
+	}
+
+	// A group of consecutive control bytes, loaded together. Matches are
+	// reported as bitmasks where the lowest set bit is the first matching
+	// slot in probe order.
+	struct Group {
+#if defined(__AVX2__)
+		using mask_t = uint32_t;
+		static constexpr size_t WIDTH = 32;
+		static constexpr int SHIFT = 0;
+
+		__m256i ctrl;
+		explicit Group(const ctrl_t* pos) noexcept : ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos))) { }
+		mask_t match(ctrl_t tag) const noexcept {
+			return (mask_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(this->ctrl, _mm256_set1_epi8(tag)));
+		}
+		mask_t match_empty() const noexcept {
+			return (mask_t) _mm256_movemask_epi8(this->ctrl);
+		}
+		mask_t match_full() const noexcept {
+			return ~this->match_empty();
+		}
+#elif defined(__SSE2__)
+		using mask_t = uint32_t;
+		static constexpr size_t WIDTH = 16;
+		static constexpr int SHIFT = 0;
+
+		__m128i ctrl;
+		explicit Group(const ctrl_t* pos) noexcept : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) { }
+		mask_t match(ctrl_t tag) const noexcept {
+			return (mask_t) _mm_movemask_epi8(_mm_cmpeq_epi8(this->ctrl, _mm_set1_epi8(tag)));
+		}
+		mask_t match_empty() const noexcept {
+			return (mask_t) _mm_movemask_epi8(this->ctrl);
+		}
+		mask_t match_full() const noexcept {
+			return this->match_empty() ^ 0xffff;
+		}
 #else
-		int shift = __builtin_clzll(cap) + 1;
+		// Portable fallback, treating 8 control bytes as one word. `match`
+		// may report a false positive next to a real match, which is fine
+		// since matching tags are always confirmed by comparing keys.
+		using mask_t = uint64_t;
+		static constexpr size_t WIDTH = 8;
+		static constexpr int SHIFT = 3;
+		static constexpr uint64_t LSBS = 0x0101010101010101ull;
+		static constexpr uint64_t MSBS = 0x8080808080808080ull;
+
+		uint64_t ctrl;
+		explicit Group(const ctrl_t* pos) noexcept {
+			std::memcpy(&this->ctrl, pos, sizeof(this->ctrl));
+#	if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			this->ctrl = __builtin_bswap64(this->ctrl);
+#	endif
+		}
+		mask_t match(ctrl_t tag) const noexcept {
+			uint64_t x = this->ctrl ^ (LSBS * (uint8_t) tag);
+			return (x - LSBS) & ~x & MSBS;
+		}
+		mask_t match_empty() const noexcept {
+			return this->ctrl & MSBS;
+		}
+		mask_t match_full() const noexcept {
+			return ~this->ctrl & MSBS;
+		}
 #endif
-		size_t hash = hashf(val);
-		return (hash * HashTable::FIB_MULT) >> shift;
+
+		// Offset within the group of the lowest set bit of `mask`.
+		static size_t lowest(mask_t mask) noexcept {
+			return (size_t) ht_detail::countr_zero(mask) >> SHIFT;
+		}
+		// Keeps only the bits of `mask` for the group's first `count` slots.
+		static mask_t first(mask_t mask, size_t count) noexcept {
+			return count >= WIDTH ? mask : mask & (((mask_t) 1 << (count << SHIFT)) - 1);
+		}
+		// Drops the bits of `mask` at or past the lowest bit of `limit`.
+		static mask_t below(mask_t mask, mask_t limit) noexcept {
+			return limit == 0 ? mask : mask & ((limit & (~limit + 1)) - 1);
+		}
+	};
+
+	// Wraps an index `step` slots past `index` back into the table.
+	static inline size_t probe_next(size_t index, size_t step, size_t cap) noexcept {
+		index += step;
+		return index < cap ? index : index % cap;
+	}
+	static inline size_t probe_prev(size_t index, size_t cap) noexcept {
+		return index == 0 ? cap - 1 : index - 1;
+	}
+	// How many slots past `from` the slot `to` is, in probe order.
+	static inline size_t probe_distance(size_t from, size_t to, size_t cap) noexcept {
+		return to >= from ? to - from : to + cap - from;
+	}
+
+	// Probe distances are stored in a byte each; 255 means "255 or more",
+	// where the real distance has to be worked out from the entry's hash.
+	static constexpr uint8_t DIST_SATURATED = 255;
+
+	template<class F, class = void>
+	struct is_transparent : std::false_type { };
+	template<class F>
+	struct is_transparent<F, std::void_t<typename F::is_transparent>> : std::true_type { };
+	// Whether `F` declares that every bit of its result is already well
+	// mixed, with a member `is_avalanching` that's `void` or a
+	// `std::bool_constant`, as Boost.Unordered's hashes do.
+	template<class F, class = void>
+	struct is_avalanching : std::false_type { };
+	template<class F>
+	struct is_avalanching<F, std::void_t<typename F::is_avalanching>>
+		: std::disjunction<std::is_void<typename F::is_avalanching>, typename F::is_avalanching> { };
+
+	// The storage of one slot, which the table constructs and destroys as
+	// its control byte says; unlike a `std::optional`, it doesn't know
+	// itself whether it holds an entry, so it takes no room beyond the entry.
+	template<class Entries>
+	union Slot {
+		using value_type = typename Entries::value_type;
+
+		value_type value;
+
+		Slot() noexcept { }
+		~Slot() { }
+
+		template<class... Args>
+		void emplace(Args&&... args) {
+			::new ((void*) &this->value) value_type(std::forward<Args>(args)...);
+		}
+		void reset() noexcept {
+			this->value.~value_type();
+		}
+		value_type& operator*() noexcept {
+			return this->value;
+		}
+		const value_type& operator*() const noexcept {
+			return this->value;
+		}
+		// The entry, to be moved from, as `Entries::take` gives it.
+		decltype(auto) take() noexcept {
+			return Entries::take(this->value);
+		}
+	};
+
+	// A non-owning view of a table's slots, which is what probing policies
+	// operate on. `Item` is a `Slot`; `dist` is only allocated
+	// for policies that track probe distances, and `hashes` only for tables
+	// that cache each entry's mixed hash.
+	template<class Item>
+	struct SlotView {
+		Item* items;
+		ctrl_t* ctrl;
+		uint8_t* dist;
+		size_t* hashes;
+		size_t cap;
+
+		bool full(size_t index) const noexcept {
+			return this->ctrl[index] != CTRL_EMPTY;
+		}
+		// Sets a control byte along with its mirrors past the end of the
+		// array.
+		void set_ctrl(size_t index, ctrl_t value) const noexcept {
+			this->ctrl[index] = value;
+			for (size_t i = index + this->cap; i < this->cap + Group::WIDTH - 1; i += this->cap) {
+				this->ctrl[i] = value;
+			}
+		}
+		// First empty slot at or after `index`. There is always one, since
+		// the table is grown before it fills.
+		size_t find_empty(size_t index) const noexcept {
+			while (true) {
+				auto empty = Group(this->ctrl + index).match_empty();
+				if (empty) {
+					return probe_next(index, Group::lowest(empty), this->cap);
+				}
+				index = probe_next(index, Group::WIDTH, this->cap);
+			}
+		}
+		// Moves the entry and tag in `from` into the empty slot `to`.
+		void relocate(size_t from, size_t to) const {
+			this->items[to].emplace(this->items[from].take());
+			this->items[from].reset();
+			if (this->hashes != nullptr) {
+				this->hashes[to] = this->hashes[from];
+			}
+			this->set_ctrl(to, this->ctrl[from]);
+			this->set_ctrl(from, CTRL_EMPTY);
+		}
+	};
+
+	// Owns the arrays behind a `SlotView`: the slots themselves, their
+	// `cap + Group::WIDTH - 1` control bytes (the tail mirrors the start of
+	// the array so a group can be loaded from any slot without wrapping),
+	// and optionally a probe distance and a cached hash per slot. All come
+	// from `Alloc`, rebound to `Item`, bytes and `size_t`; the control bytes
+	// and distances share one allocation.
+	template<class Item, class Alloc>
+	struct SlotArray {
+		using Traits = std::allocator_traits<Alloc>;
+		using ItemAlloc = typename Traits::template rebind_alloc<Item>;
+		using ItemTraits = std::allocator_traits<ItemAlloc>;
+		using ByteAlloc = typename Traits::template rebind_alloc<uint8_t>;
+		using ByteTraits = std::allocator_traits<ByteAlloc>;
+		using HashAlloc = typename Traits::template rebind_alloc<size_t>;
+		using HashTraits = std::allocator_traits<HashAlloc>;
+		static_assert(
+			std::is_same_v<typename ItemTraits::pointer, Item*>
+				&& std::is_same_v<typename ByteTraits::pointer, uint8_t*>
+				&& std::is_same_v<typename HashTraits::pointer, size_t*>,
+			"allocators with fancy pointers aren't supported"
+		);
+
+		Item* items = nullptr;
+		ctrl_t* ctrl = nullptr;
+		uint8_t* dist = nullptr;
+		size_t* hashes = nullptr;
+		size_t cap = 0;
+		Alloc alloc;
+
+		SlotArray() noexcept(std::is_nothrow_default_constructible_v<Alloc>) = default;
+		explicit SlotArray(const Alloc& alloc) noexcept : alloc(alloc) { }
+		SlotArray(size_t cap, bool with_dist, bool with_hash, const Alloc& alloc) : alloc(alloc) {
+			this->allocate(cap, with_dist, with_hash);
+			if (cap != 0) {
+				std::memset(this->ctrl, (uint8_t) CTRL_EMPTY, cap + Group::WIDTH - 1);
+			}
+		}
+		SlotArray(const SlotArray& other) : SlotArray(other, Traits::select_on_container_copy_construction(other.alloc)) { }
+		// Copies the slots of `other` into storage from `alloc`.
+		SlotArray(const SlotArray& other, const Alloc& alloc) : alloc(alloc) {
+			this->allocate(other.cap, other.dist != nullptr, other.hashes != nullptr);
+			this->copy_meta(other);
+			size_t copied = 0;
+			try {
+				for (size_t i = 0; i < other.cap; i++) {
+					if (other.ctrl[i] != CTRL_EMPTY) {
+						this->items[i].emplace(*other.items[i]);
+					}
+					copied = i + 1;
+				}
+			} catch (...) {
+				this->abandon(copied);
+				throw;
+			}
+		}
+		SlotArray(SlotArray&& other) noexcept : alloc(other.alloc) {
+			this->steal(other);
+		}
+		// Takes over `other`'s storage if `alloc` can free it, or moves its
+		// entries into new storage otherwise. `other` is left empty.
+		SlotArray(SlotArray&& other, const Alloc& alloc) : alloc(alloc) {
+			if (this->alloc == other.alloc) {
+				this->steal(other);
+				return;
+			}
+			this->allocate(other.cap, other.dist != nullptr, other.hashes != nullptr);
+			this->copy_meta(other);
+			size_t moved = 0;
+			try {
+				for (size_t i = 0; i < other.cap; i++) {
+					if (other.ctrl[i] != CTRL_EMPTY) {
+						this->items[i].emplace(other.items[i].take());
+					}
+					moved = i + 1;
+				}
+			} catch (...) {
+				this->abandon(moved);
+				throw;
+			}
+			other.reset();
+		}
+		~SlotArray() {
+			this->reset();
+		}
+
+		SlotArray& operator=(const SlotArray& other) {
+			if (this == &other) {
+				return *this;
+			}
+			if constexpr (Traits::propagate_on_container_copy_assignment::value) {
+				SlotArray copy(other, other.alloc);
+				this->reset();
+				this->alloc = other.alloc;
+				this->steal(copy);
+			} else {
+				SlotArray copy(other, this->alloc);
+				this->reset();
+				this->steal(copy);
+			}
+			return *this;
+		}
+		SlotArray& operator=(SlotArray&& other) noexcept(Traits::propagate_on_container_move_assignment::value || Traits::is_always_equal::value) {
+			if (this == &other) {
+				return *this;
+			}
+			if constexpr (Traits::propagate_on_container_move_assignment::value) {
+				this->reset();
+				this->alloc = other.alloc;
+				this->steal(other);
+			} else {
+				SlotArray moved(std::move(other), this->alloc);
+				this->reset();
+				this->steal(moved);
+			}
+			return *this;
+		}
+		// Like the standard containers, swapping storage from allocators
+		// that compare unequal is only allowed if they propagate on swap.
+		void swap(SlotArray& other) noexcept {
+			std::swap(this->items, other.items);
+			std::swap(this->ctrl, other.ctrl);
+			std::swap(this->dist, other.dist);
+			std::swap(this->hashes, other.hashes);
+			std::swap(this->cap, other.cap);
+			if constexpr (Traits::propagate_on_container_swap::value) {
+				using std::swap;
+				swap(this->alloc, other.alloc);
+			}
+		}
+
+		// Destroys every slot and frees the storage.
+		void reset() noexcept {
+			if (this->items == nullptr) {
+				return;
+			}
+			ItemAlloc item_alloc(this->alloc);
+			for (size_t i = 0; i < this->cap; i++) {
+				if (this->ctrl[i] != CTRL_EMPTY) {
+					this->items[i].reset();
+				}
+				ItemTraits::destroy(item_alloc, this->items + i);
+			}
+			ItemTraits::deallocate(item_alloc, this->items, this->cap);
+			ByteAlloc byte_alloc(this->alloc);
+			ByteTraits::deallocate(byte_alloc, (uint8_t*) this->ctrl, SlotArray::meta_size(this->cap, this->dist != nullptr));
+			if (this->hashes != nullptr) {
+				HashAlloc hash_alloc(this->alloc);
+				HashTraits::deallocate(hash_alloc, this->hashes, this->cap);
+			}
+			this->items = nullptr;
+			this->ctrl = nullptr;
+			this->dist = nullptr;
+			this->hashes = nullptr;
+			this->cap = 0;
+		}
+
+		SlotView<Item> view() const noexcept {
+			return SlotView<Item>{ this->items, this->ctrl, this->dist, this->hashes, this->cap };
+		}
+
+	private:
+		static size_t meta_size(size_t cap, bool with_dist) noexcept {
+			return cap + Group::WIDTH - 1 + (with_dist ? cap : 0);
+		}
+		// Allocates `cap` empty slots, leaving the control bytes unset.
+		void allocate(size_t cap, bool with_dist, bool with_hash) {
+			if (cap == 0) {
+				return;
+			}
+			ItemAlloc item_alloc(this->alloc);
+			ByteAlloc byte_alloc(this->alloc);
+			HashAlloc hash_alloc(this->alloc);
+			Item* items = ItemTraits::allocate(item_alloc, cap);
+			uint8_t* meta = nullptr;
+			size_t* hashes = nullptr;
+			try {
+				meta = ByteTraits::allocate(byte_alloc, SlotArray::meta_size(cap, with_dist));
+				if (with_hash) {
+					hashes = HashTraits::allocate(hash_alloc, cap);
+				}
+			} catch (...) {
+				if (meta != nullptr) {
+					ByteTraits::deallocate(byte_alloc, meta, SlotArray::meta_size(cap, with_dist));
+				}
+				ItemTraits::deallocate(item_alloc, items, cap);
+				throw;
+			}
+			// empty slots can't throw on construction
+			for (size_t i = 0; i < cap; i++) {
+				ItemTraits::construct(item_alloc, items + i);
+			}
+			this->items = items;
+			this->ctrl = (ctrl_t*) meta;
+			this->dist = with_dist ? meta + cap + Group::WIDTH - 1 : nullptr;
+			this->hashes = hashes;
+			this->cap = cap;
+		}
+		void copy_meta(const SlotArray& other) noexcept {
+			if (other.cap == 0) {
+				return;
+			}
+			std::memcpy(this->ctrl, other.ctrl, other.cap + Group::WIDTH - 1);
+			if (other.dist != nullptr) {
+				std::memcpy(this->dist, other.dist, other.cap);
+			}
+			if (other.hashes != nullptr) {
+				std::memcpy(this->hashes, other.hashes, other.cap * sizeof(size_t));
+			}
+		}
+		// Frees storage whose slots from `constructed` on were copied as
+		// full by `copy_meta` but never constructed.
+		void abandon(size_t constructed) noexcept {
+			std::memset(this->ctrl + constructed, (uint8_t) CTRL_EMPTY, this->cap - constructed);
+			this->reset();
+		}
+		void steal(SlotArray& other) noexcept {
+			this->items = std::exchange(other.items, nullptr);
+			this->ctrl = std::exchange(other.ctrl, nullptr);
+			this->dist = std::exchange(other.dist, nullptr);
+			this->hashes = std::exchange(other.hashes, nullptr);
+			this->cap = std::exchange(other.cap, 0);
+		}
+	};
+
+	// What a probing policy's `claim_within` found.
+	enum class Claim {
+		// the key is already in the returned slot
+		FOUND,
+		// the returned slot is ready for the new entry
+		ROOM,
+		// the probe would have to go past the limit; nothing was changed
+		SPILL,
+	};
+
+	// `threads`, or one per hardware thread if it's 0.
+	static inline size_t thread_count(size_t threads) noexcept {
+		if (threads == 0) {
+			threads = std::thread::hardware_concurrency();
+		}
+		return threads == 0 ? 1 : threads;
+	}
+	// Runs `f(0)` to `f(count - 1)` at once, each but the first on a thread
+	// of its own, then rethrows the first exception any of them threw once
+	// they've all finished.
+	template<class F>
+	static inline void parallel_for(size_t count, F&& f) {
+		std::vector<std::exception_ptr> errors(count);
+		auto run = [&](size_t i) {
+			try {
+				f(i);
+			} catch (...) {
+				errors[i] = std::current_exception();
+			}
+		};
+		std::vector<std::thread> workers;
+		try {
+			workers.reserve(count - 1);
+			for (size_t i = 1; i < count; i++) {
+				workers.emplace_back(run, i);
+			}
+		} catch (...) {
+			for (auto& worker : workers) {
+				worker.join();
+			}
+			throw;
+		}
+		run(0);
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		for (const auto& error : errors) {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+	}
+}
+
+// Probing policies decide where in the slot array entries go. Each one has:
+// - `find(slots, home, tag, eq, home_of)`, returning `(true, index)` of the
+//   entry `eq(index)` accepts, or `(false, index)` of where it would go;
+// - `find_insert(slots, home, home_of)`, where a key known to be new would go;
+// - `make_room(slots, index, home)`, freeing up the `index` that `find` or
+//   `find_insert` returned (and recording anything it needs about the new
+//   entry, which is then constructed there with `set_ctrl`);
+// - `erase(slots, index, home_of)`, destroying the entry at `index` and
+//   closing up its probe chain;
+// - `claim_within(slots, home, limit, tag, eq, home_of)`, which does what
+//   `find` and then `make_room` would, but only reads and writes slots from
+//   `home` up to `limit`, so threads can fill disjoint ranges of one table.
+//   It returns a `Claim` and the slot it applies to, and uses plain loads
+//   rather than groups, which could read into another thread's range.
+// `home_of(index)` recomputes the home slot of the entry at `index`, which
+// means hashing its key.
+
+// Linear probing, scanning control bytes a group at a time. Only keys whose
+// tag matches and that come before the first empty slot are ever compared.
+struct LinearProbing {
+	static constexpr bool TRACKS_DISTANCE = false;
+
+	template<class Slots, class Eq, class HomeOf>
+	static std::pair<bool, size_t> find(const Slots& slots, size_t home, ht_detail::ctrl_t tag, Eq&& eq, HomeOf&&) {
+		using ht_detail::Group;
+		size_t cap = slots.cap;
+		size_t index = home;
+		size_t attempts = 0;
+		while (true) {
+			Group group(slots.ctrl + index);
+			auto empty = group.match_empty();
+			// anything past the first empty slot is in another chain
+			auto match = Group::below(group.match(tag), empty);
+			while (match) {
+				size_t i = ht_detail::probe_next(index, Group::lowest(match), cap);
+				if (eq(i)) {
+					return std::make_pair(true, i);
+				}
+				match &= match - 1;
+			}
+			if (empty) {
+				return std::make_pair(false, ht_detail::probe_next(index, Group::lowest(empty), cap));
+			}
+			index = ht_detail::probe_next(index, Group::WIDTH, cap);
+			attempts += Group::WIDTH;
+			if (attempts >= cap) {
+				return std::make_pair(false, index);
+			}
+		}
+	}
+	template<class Slots, class HomeOf>
+	static size_t find_insert(const Slots& slots, size_t home, HomeOf&&) noexcept {
+		return slots.find_empty(home);
+	}
+	// `find` only ever returns empty slots to insert into.
+	template<class Slots>
+	static void make_room(const Slots&, size_t, size_t) noexcept { }
+	// Backward-shift deletion: later entries of the chain are pulled back
+	// into the hole, so there's never an empty slot between an entry and
+	// its home and lookups can keep stopping at the first empty slot,
+	// without leaving tombstones behind.
+	template<class Slots, class HomeOf>
+	static void erase(const Slots& slots, size_t index, HomeOf&& home_of) {
+		using ht_detail::probe_next;
+		using ht_detail::probe_distance;
+		size_t cap = slots.cap;
+		slots.items[index].reset();
+		slots.set_ctrl(index, ht_detail::CTRL_EMPTY);
+		size_t hole = index;
+		for (size_t next = probe_next(hole, 1, cap); slots.full(next); next = probe_next(next, 1, cap)) {
+			// the entry can only move back if its home isn't past the hole
+			if (probe_distance(home_of(next), next, cap) >= probe_distance(hole, next, cap)) {
+				slots.relocate(next, hole);
+				hole = next;
+			}
+		}
+	}
+	template<class Slots, class Eq, class HomeOf>
+	static std::pair<ht_detail::Claim, size_t> claim_within(const Slots& slots, size_t home, size_t limit, ht_detail::ctrl_t tag, Eq&& eq, HomeOf&&) {
+		size_t index = home;
+		for (; index < limit; index++) {
+			if (!slots.full(index)) {
+				return std::make_pair(ht_detail::Claim::ROOM, index);
+			}
+			if (slots.ctrl[index] == tag && eq(index)) {
+				return std::make_pair(ht_detail::Claim::FOUND, index);
+			}
+		}
+		return std::make_pair(ht_detail::Claim::SPILL, index);
+	}
+};
+
+// Robin Hood probing: still linear, but an entry that has probed further
+// than the one occupying a slot takes that slot, pushing the rest of the
+// chain along. That keeps every chain sorted by home slot, which caps the
+// variance of probe lengths and lets a lookup stop as soon as it reaches an
+// entry closer to its home than the lookup is, rather than scanning until
+// an empty slot; most failed lookups end within a slot or two.
+struct RobinHoodProbing {
+	static constexpr bool TRACKS_DISTANCE = true;
+
+	template<class Slots, class HomeOf>
+	static size_t distance(const Slots& slots, size_t index, HomeOf&& home_of) {
+		uint8_t dist = slots.dist[index];
+		if (__builtin_expect(dist == ht_detail::DIST_SATURATED, 0)) {
+			return ht_detail::probe_distance(home_of(index), index, slots.cap);
+		}
+		return dist;
+	}
+	static uint8_t saturate(size_t dist) noexcept {
+		return dist < ht_detail::DIST_SATURATED ? (uint8_t) dist : ht_detail::DIST_SATURATED;
+	}
+
+	template<class Slots, class Eq, class HomeOf>
+	static std::pair<bool, size_t> find(const Slots& slots, size_t home, ht_detail::ctrl_t tag, Eq&& eq, HomeOf&& home_of) {
+		size_t index = home;
+		for (size_t dist = 0; dist < slots.cap; dist++) {
+			if (!slots.full(index) || RobinHoodProbing::distance(slots, index, home_of) < dist) {
+				return std::make_pair(false, index);
+			}
+			if (slots.ctrl[index] == tag && eq(index)) {
+				return std::make_pair(true, index);
+			}
+			index = ht_detail::probe_next(index, 1, slots.cap);
+		}
+		return std::make_pair(false, index);
+	}
+	template<class Slots, class HomeOf>
+	static size_t find_insert(const Slots& slots, size_t home, HomeOf&& home_of) {
+		size_t index = home;
+		for (size_t dist = 0; slots.full(index) && RobinHoodProbing::distance(slots, index, home_of) >= dist; dist++) {
+			index = ht_detail::probe_next(index, 1, slots.cap);
+		}
+		return index;
+	}
+	// Shifts the entries from `index` up to the next empty slot along by
+	// one, which keeps the chain sorted by home slot.
+	template<class Slots>
+	static void make_room(const Slots& slots, size_t index, size_t home) {
+		if (slots.full(index)) {
+			RobinHoodProbing::shift_up(slots, index, slots.find_empty(index));
+		}
+		slots.dist[index] = RobinHoodProbing::saturate(ht_detail::probe_distance(home, index, slots.cap));
+	}
+	// Moves the entries in `[index, empty)` one slot along, into the empty
+	// slot `empty`.
+	template<class Slots>
+	static void shift_up(const Slots& slots, size_t index, size_t empty) {
+		for (size_t i = empty; i != index;) {
+			size_t prev = ht_detail::probe_prev(i, slots.cap);
+			slots.relocate(prev, i);
+			uint8_t dist = slots.dist[prev];
+			slots.dist[i] = dist == ht_detail::DIST_SATURATED ? dist : (uint8_t) (dist + 1);
+			i = prev;
+		}
+	}
+	// Backward-shift deletion, which for Robin Hood only has to look at the
+	// stored distances: everything after the hole that isn't in its home
+	// slot moves back one.
+	template<class Slots, class HomeOf>
+	static void erase(const Slots& slots, size_t index, HomeOf&& home_of) {
+		size_t cap = slots.cap;
+		slots.items[index].reset();
+		slots.set_ctrl(index, ht_detail::CTRL_EMPTY);
+		size_t hole = index;
+		for (size_t next = ht_detail::probe_next(hole, 1, cap); slots.full(next) && slots.dist[next] != 0; next = ht_detail::probe_next(next, 1, cap)) {
+			size_t dist = RobinHoodProbing::distance(slots, next, home_of);
+			slots.relocate(next, hole);
+			slots.dist[hole] = RobinHoodProbing::saturate(dist - 1);
+			hole = next;
+		}
+	}
+	template<class Slots, class Eq, class HomeOf>
+	static std::pair<ht_detail::Claim, size_t> claim_within(const Slots& slots, size_t home, size_t limit, ht_detail::ctrl_t tag, Eq&& eq, HomeOf&& home_of) {
+		size_t index = home;
+		for (size_t dist = 0; index < limit; index++, dist++) {
+			if (!slots.full(index)) {
+				slots.dist[index] = RobinHoodProbing::saturate(dist);
+				return std::make_pair(ht_detail::Claim::ROOM, index);
+			}
+			if (RobinHoodProbing::distance(slots, index, home_of) < dist) {
+				// the rest of the chain has to fit before `limit`
+				size_t empty = index + 1;
+				while (empty < limit && slots.full(empty)) {
+					empty++;
+				}
+				if (empty == limit) {
+					break;
+				}
+				RobinHoodProbing::shift_up(slots, index, empty);
+				slots.dist[index] = RobinHoodProbing::saturate(dist);
+				return std::make_pair(ht_detail::Claim::ROOM, index);
+			}
+			if (slots.ctrl[index] == tag && eq(index)) {
+				return std::make_pair(ht_detail::Claim::FOUND, index);
+			}
+		}
+		return std::make_pair(ht_detail::Claim::SPILL, index);
+	}
+};
+
+// Hashes anything that converts to `std::string_view` with `ht_hash_bytes`,
+// the kernel the C table uses, which reads 8 bytes or more at a time instead
+// of `std::hash`'s byte at a time. It's transparent, so a table keyed on
+// `std::string` with `std::equal_to<>` can be searched with views or literals.
+struct BytesHash {
+	using is_transparent = void;
+	using is_avalanching = void;
+	size_t operator()(std::string_view str) const noexcept {
+		return (size_t) ht_hash_bytes(str.data(), str.size(), 0);
+	}
+};
+
+// Hashes integer keys that are already well-mixed hashes themselves, like
+// precomputed 64-bit fingerprints, to themselves. It's avalanching, so tables
+// use the key as its own mixed hash, skipping even the multiply that
+// `std::hash`'s identity hash of an integer gets; keys that aren't evenly
+// spread in their high bits (sequential IDs, say) need a real `Hash`.
+struct FingerprintHash {
+	using is_avalanching = void;
+	size_t operator()(uint64_t key) const noexcept {
+		return (size_t) key;
 	}
+};
+
+// How a table's entries are laid out, from `cluster_stats()`. A cluster is
+// a run of full slots between two empty ones, and an entry's displacement is
+// how many slots past its home slot it sits, which is how far a lookup for it
+// has to probe; a good `Hash` keeps both short at any load below the maximum.
+struct ClusterStats {
+	size_t entries = 0;
+	size_t clusters = 0;
+	size_t longest_cluster = 0;
+	size_t max_displacement = 0;
+	size_t total_displacement = 0;
+
+	double mean_cluster() const noexcept {
+		return this->clusters == 0 ? 0.0 : (double) this->entries / (double) this->clusters;
+	}
+	double mean_displacement() const noexcept {
+		return this->entries == 0 ? 0.0 : (double) this->total_displacement / (double) this->entries;
+	}
+};
+
+#if defined(HT_STATS)
+// What a table has counted since it was made (or `reset_stats` last ran),
+// with `HT_STATS` defined; it has to be defined the same way everywhere a
+// table type is used. A lookup's probe length is how many slots past the
+// key's home it went before finding the key (for `hits`) or deciding it
+// isn't there (for `misses`), and bucket `b` of each counts the lookups whose
+// probe length has `b` significant bits: 0 for 0, 1 for 1, 2 for 2 to 3, 3
+// for 4 to 7 and so on, the last bucket also taking anything longer.
+// Inserts count as lookups too.
+struct ProbeStats {
+	static constexpr size_t BUCKETS = 16;
+
+	uint64_t hits[BUCKETS] = {};
+	uint64_t misses[BUCKETS] = {};
+	size_t longest_probe = 0;
+	uint64_t resizes = 0;
+	std::chrono::nanoseconds resize_time{0};
+
+	static size_t bucket(size_t length) noexcept {
+		size_t bits = 0;
+		while (length != 0 && bits < BUCKETS - 1) {
+			length >>= 1;
+			bits++;
+		}
+		return bits;
+	}
+};
+#endif
+
+namespace ht_detail {
+#if defined(HT_STATS)
+	// A table's `ProbeStats`, updated by lookups that may run on several
+	// threads at once (in `ConcurrentHashTable`, for instance). Counters are
+	// bumped with a relaxed load and store rather than an atomic add, which
+	// keeps them cheap but can lose counts from lookups racing each other.
+	// Copies start from zero, and assigning leaves a table's own counts.
+	class StatsCounters {
+		std::atomic<uint64_t> hits[ProbeStats::BUCKETS];
+		std::atomic<uint64_t> misses[ProbeStats::BUCKETS];
+		std::atomic<size_t> longest;
+		std::atomic<uint64_t> resizes;
+		std::atomic<uint64_t> resize_ns;
+
+		template<class U>
+		static void add(std::atomic<U>& counter, U by) noexcept {
+			counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+		}
+	public:
+		StatsCounters() noexcept {
+			this->reset();
+		}
+		StatsCounters(const StatsCounters&) noexcept : StatsCounters() { }
+		StatsCounters& operator=(const StatsCounters&) noexcept {
+			return *this;
+		}
+
+		void lookup(bool hit, size_t length) noexcept {
+			StatsCounters::add<uint64_t>((hit ? this->hits : this->misses)[ProbeStats::bucket(length)], 1);
+			if (length > this->longest.load(std::memory_order_relaxed)) {
+				this->longest.store(length, std::memory_order_relaxed);
+			}
+		}
+		void resized(std::chrono::nanoseconds took) noexcept {
+			StatsCounters::add<uint64_t>(this->resizes, 1);
+			StatsCounters::add<uint64_t>(this->resize_ns, (uint64_t) took.count());
+		}
+		ProbeStats snapshot() const noexcept {
+			ProbeStats out;
+			for (size_t b = 0; b < ProbeStats::BUCKETS; b++) {
+				out.hits[b] = this->hits[b].load(std::memory_order_relaxed);
+				out.misses[b] = this->misses[b].load(std::memory_order_relaxed);
+			}
+			out.longest_probe = this->longest.load(std::memory_order_relaxed);
+			out.resizes = this->resizes.load(std::memory_order_relaxed);
+			out.resize_time = std::chrono::nanoseconds(this->resize_ns.load(std::memory_order_relaxed));
+			return out;
+		}
+		void reset() noexcept {
+			for (size_t b = 0; b < ProbeStats::BUCKETS; b++) {
+				this->hits[b].store(0, std::memory_order_relaxed);
+				this->misses[b].store(0, std::memory_order_relaxed);
+			}
+			this->longest.store(0, std::memory_order_relaxed);
+			this->resizes.store(0, std::memory_order_relaxed);
+			this->resize_ns.store(0, std::memory_order_relaxed);
+		}
+	};
+#endif
+
+	// How a `TableCore` stores its entries: `HashTable`'s are key-value
+	// pairs, and `HashSet`'s bare keys. `key` gets the key of an entry (or
+	// of anything an entry can be made from), and `all<Trait>` is whether
+	// `Trait` holds for every part of one.
+	//
+	// `mutable_type` is what an entry is built as before being moved into a
+	// slot, or held as outside one: for maps, a `std::pair<Key, T>` whose key
+	// can be moved. `take` moves an entry out of a slot that's about to be
+	// destroyed, and `assign` replaces the value of an entry with that of
+	// another with an equal key.
+	template<class Key, class T>
+	struct MapEntries {
+		using key_type = Key;
+		using value_type = std::pair<const Key, T>;
+		using mutable_type = std::pair<Key, T>;
+		// what a non-`const` iterator yields
+		using iterator_value = value_type;
+		template<template<class> class Trait>
+		using all = std::conjunction<Trait<Key>, Trait<T>>;
+
+		template<class P>
+		static const auto& key(const P& entry) noexcept {
+			return entry.first;
+		}
+		// The key is moved out through a `const_cast`, as node-based maps
+		// conventionally do. Strictly, modifying a `const` object is
+		// undefined, but callers only destroy or erase the entry afterwards,
+		// never reading its key again; copying it instead would make every
+		// resize copy every key.
+		static std::pair<Key&&, T&&> take(value_type& entry) noexcept {
+			return { std::move(const_cast<Key&>(entry.first)), std::move(entry.second) };
+		}
+		template<class P>
+		static void assign(value_type& entry, P&& from) {
+			entry.second = std::forward<P>(from).second;
+		}
+	};
+	template<class Key>
+	struct SetEntries {
+		using key_type = Key;
+		using value_type = Key;
+		using mutable_type = Key;
+		// changing a key in place could change its hash
+		using iterator_value = const Key;
+		template<template<class> class Trait>
+		using all = Trait<Key>;
+
+		static const Key& key(const Key& entry) noexcept {
+			return entry;
+		}
+		static Key&& take(Key& entry) noexcept {
+			return std::move(entry);
+		}
+		// equal keys are interchangeable
+		template<class P>
+		static void assign(Key&, P&&) noexcept { }
+	};
+
+	template<class Entries, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+	class TableCore;
+
+	// Iterates over the full slots from `item` up to the one whose control
+	// byte is `end`, yielding `Value`s; the `const` form converts from the
+	// non-`const` one. `ctrl` is the control byte of `item`. Full slots are
+	// found a group of control bytes at a time: `full` marks those after
+	// `item` in the group starting at `group`, so stepping through a group
+	// never reloads it, and runs of empty slots cost a load per group.
+	template<class Item, class Value>
+	class SlotIterator {
+		template<class, class, class, class, class, bool>
+		friend class TableCore;
+		template<class, class>
+		friend class SlotIterator;
+		using ItemPtr = std::conditional_t<std::is_const_v<Value>, const Item*, Item*>;
+		using mask_t = Group::mask_t;
+
+		ItemPtr item;
+		const ctrl_t* ctrl;
+		const ctrl_t* end;
+		const ctrl_t* group;
+		mask_t full;
+
+		// Moves to the first slot in `full`, and drops it from `full`.
+		void take_lowest() noexcept {
+			const ctrl_t* next = this->group + Group::lowest(this->full);
+			this->full &= this->full - 1;
+			this->item += next - this->ctrl;
+			this->ctrl = next;
+		}
+		// Moves to the first full slot at or past `from`, the start of a
+		// group, or to `end`.
+		void find_from(const ctrl_t* from) noexcept {
+			for (this->group = from; this->group < this->end; this->group += Group::WIDTH) {
+				// groups may read into the mirrored control bytes past the
+				// last slot, but never count them
+				this->full = Group::first(Group(this->group).match_full(), (size_t) (this->end - this->group));
+				if (this->full != 0) {
+					this->take_lowest();
+					return;
+				}
+			}
+			this->item += this->end - this->ctrl;
+			this->ctrl = this->end;
+		}
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = std::remove_const_t<Value>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Value*;
+		using reference = Value&;
+		SlotIterator() noexcept : item(nullptr), ctrl(nullptr), end(nullptr), group(nullptr), full(0) { }
+		SlotIterator(ItemPtr item, const ctrl_t* ctrl) noexcept : item(item), ctrl(ctrl), end(ctrl), group(ctrl), full(0) { }
+		SlotIterator(ItemPtr item, const ctrl_t* ctrl, const ctrl_t* end) noexcept : item(item), ctrl(ctrl), end(end), group(ctrl), full(0) {
+			this->find_from(ctrl);
+		}
+		template<class Other, class = std::enable_if_t<std::is_same_v<const Other, Value> && !std::is_same_v<Other, Value>>>
+		SlotIterator(const SlotIterator<Item, Other>& other) noexcept : item(other.item), ctrl(other.ctrl), end(other.end), group(other.group), full(other.full) { }
+		SlotIterator& operator++() noexcept {
+			if (this->ctrl == this->end) {
+				return *this;
+			}
+			if (this->full != 0) {
+				this->take_lowest();
+			} else {
+				this->find_from(this->group + Group::WIDTH);
+			}
+			return *this;
+		}
+		SlotIterator operator++(int) noexcept {
+			SlotIterator out = *this;
+			++(*this);
+			return out;
+		}
+		bool operator==(const SlotIterator& other) const noexcept {
+			return this->item == other.item && this->end == other.end;
+		}
+		bool operator!=(const SlotIterator& other) const noexcept {
+			return !(*this == other);
+		}
+		reference operator*() const {
+			return **this->item;
+		}
+	};
+
+	// Only its address is used, to tell which `Hash` mixed a node's hash.
+	template<class Hash>
+	inline constexpr char hash_tag = 0;
+
+	// An entry taken out of a table by `extract`, to be changed or put back,
+	// into any table with the same key and value types, with `insert`. It's
+	// like the standard containers' node handles, but since tables have no
+	// nodes it holds the entry itself, so extracting and inserting move it.
+	// Until its key is reached through `key` or `value`, it keeps the key's
+	// mixed hash, which inserting reuses if the table has the same stateless
+	// `Hash` as the one the node came from.
+	template<class Entries>
+	class NodeHandle {
+		template<class, class, class, class, class, bool>
+		friend class TableCore;
+		using mutable_type = typename Entries::mutable_type;
+
+		std::optional<mutable_type> entry;
+		size_t mixed;
+		// `&hash_tag<Hash>` for the `Hash` that mixed `mixed`, or `nullptr`
+		// if it's stale.
+		const void* hashed_by;
+
+		// tagged, so braced entries passed to `insert` can't make nodes
+		struct Taken { };
+		template<class V>
+		NodeHandle(Taken, V&& entry, size_t mixed, const void* hashed_by) : entry(std::forward<V>(entry)), mixed(mixed), hashed_by(hashed_by) { }
+	public:
+		NodeHandle() noexcept : mixed(0), hashed_by(nullptr) { }
+
+		bool empty() const noexcept {
+			return !this->entry.has_value();
+		}
+		explicit operator bool() const noexcept {
+			return this->entry.has_value();
+		}
+		// A `HashSet`'s key, or a `HashTable`'s key-value pair.
+		mutable_type& value() noexcept {
+			this->hashed_by = nullptr;
+			return *this->entry;
+		}
+		// For `HashTable`'s nodes.
+		template<class M = mutable_type>
+		typename M::first_type& key() noexcept {
+			this->hashed_by = nullptr;
+			return this->entry->first;
+		}
+		template<class M = mutable_type>
+		typename M::second_type& mapped() noexcept {
+			return this->entry->second;
+		}
+	};
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+	// Keeps the frames of finished lookup coroutines for the next ones, per
+	// thread; one size of frame is kept at a time, and any other is
+	// allocated as usual.
+	struct FramePool {
+		static constexpr size_t MAX_FREE = 64;
+		struct Block {
+			Block* next;
+		};
+		Block* free = nullptr;
+		size_t size = 0;
+		size_t count = 0;
+
+		~FramePool() {
+			while (this->free != nullptr) {
+				Block* next = this->free->next;
+				::operator delete(this->free);
+				this->free = next;
+			}
+		}
+		static FramePool& local() noexcept {
+			thread_local FramePool pool;
+			return pool;
+		}
+		void* allocate(size_t size) {
+			if (this->free != nullptr && this->size == size) {
+				Block* block = this->free;
+				this->free = block->next;
+				this->count--;
+				return block;
+			}
+			return ::operator new(size);
+		}
+		void deallocate(void* frame, size_t size) noexcept {
+			if (this->count == 0) {
+				this->size = size;
+			}
+			if (this->size != size || this->count == MAX_FREE) {
+				::operator delete(frame);
+				return;
+			}
+			this->free = new (frame) Block { this->free };
+			this->count++;
+		}
+	};
+
+	// Most lookups `run_interleaved` keeps in flight.
+	static constexpr size_t MAX_IN_FLIGHT = 64;
+
+	// A coroutine that runs lookups one after another, suspending after each
+	// prefetch, for `run_interleaved` to resume other lanes while the line
+	// arrives. It starts suspended.
+	class LookupLane {
+	public:
+		struct promise_type {
+			std::exception_ptr exception;
+
+			LookupLane get_return_object() noexcept {
+				return LookupLane(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+			std::suspend_always initial_suspend() noexcept {
+				return {};
+			}
+			std::suspend_always final_suspend() noexcept {
+				return {};
+			}
+			void return_void() noexcept { }
+			void unhandled_exception() noexcept {
+				this->exception = std::current_exception();
+			}
+			static void* operator new(size_t size) {
+				return FramePool::local().allocate(size);
+			}
+			static void operator delete(void* frame, size_t size) noexcept {
+				FramePool::local().deallocate(frame, size);
+			}
+		};
+
+		LookupLane() noexcept : handle(nullptr) { }
+		LookupLane(LookupLane&& other) noexcept : handle(std::exchange(other.handle, nullptr)) { }
+		LookupLane& operator=(LookupLane&& other) noexcept {
+			std::swap(this->handle, other.handle);
+			return *this;
+		}
+		~LookupLane() {
+			if (this->handle) {
+				this->handle.destroy();
+			}
+		}
+
+		bool done() const noexcept {
+			return this->handle.done();
+		}
+		void resume() const {
+			this->handle.resume();
+		}
+		// Once it's `done`, throws whatever a lookup threw.
+		void rethrow() const {
+			if (this->handle.promise().exception) {
+				std::rethrow_exception(this->handle.promise().exception);
+			}
+		}
+	private:
+		std::coroutine_handle<promise_type> handle;
+
+		explicit LookupLane(std::coroutine_handle<promise_type> handle) noexcept : handle(handle) { }
+	};
+
+	// What the lanes of one `run_interleaved` share: the keys left, and a
+	// ring of results, each written by whichever lane looked its key up.
+	// Lanes finish lookups out of order, so results wait in the ring until
+	// every earlier one is in; a lane that would get `RING` lookups ahead
+	// of the oldest waits too.
+	template<class ForwardIt, class Result>
+	struct InterleavedLookups {
+		static constexpr size_t RING = 4 * MAX_IN_FLIGHT;
+
+		ForwardIt first;
+		ForwardIt last;
+		// lookups started, and results passed on
+		size_t started = 0;
+		size_t finished = 0;
+		Result results[RING];
+		bool ready[RING] = { };
+
+		InterleavedLookups(ForwardIt first, ForwardIt last) : first(first), last(last) { }
+
+		bool full() const noexcept {
+			return this->started - this->finished == RING;
+		}
+		void found(size_t lookup, Result result) noexcept {
+			this->results[lookup % RING] = result;
+			this->ready[lookup % RING] = true;
+		}
+	};
+
+	// Runs `lane(lookups)` as `width` lanes, resuming them in turn until the
+	// keys run out, and calls `found` with each result in the keys' order.
+	template<class Lookups, class Lane, class Found>
+	void run_interleaved(Lookups& lookups, size_t width, Lane&& lane, Found&& found) {
+		width = std::clamp<size_t>(width, 1, MAX_IN_FLIGHT);
+		LookupLane lanes[MAX_IN_FLIGHT];
+		for (size_t i = 0; i < width; i++) {
+			lanes[i] = lane(lookups);
+		}
+		for (size_t running = width; running > 0;) {
+			running = 0;
+			for (size_t i = 0; i < width; i++) {
+				if (lanes[i].done()) {
+					continue;
+				}
+				lanes[i].resume();
+				if (lanes[i].done()) {
+					lanes[i].rethrow();
+				} else {
+					running++;
+				}
+			}
+			while (lookups.ready[lookups.finished % Lookups::RING]) {
+				size_t at = lookups.finished++ % Lookups::RING;
+				lookups.ready[at] = false;
+				found(lookups.results[at]);
+			}
+		}
+	}
+#endif
+
+	// Everything `HashTable` and `HashSet` share: the slot array, probing,
+	// resizing, lookups and iteration. `Entries` says what an entry is
+	// (`MapEntries` or `SetEntries`); the other parameters are the tables'
+	// own, documented with `HashTable`.
+	template<class Entries, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+	class TableCore {
+	public:
+		using key_type = typename Entries::key_type;
+		using value_type = typename Entries::value_type;
+		using size_type = size_t;
+		using difference_type = ptrdiff_t;
+		using hasher = Hash;
+		using key_equal = KeyEqual;
+		using allocator_type = Allocator;
+		using reference = value_type&;
+		using const_reference = const value_type&;
+		using pointer = value_type*;
+		using const_pointer = const value_type*;
+	protected:
+		using Key = key_type;
+		using HtItem = Slot<Entries>;
+		using MutableValue = typename Entries::mutable_type;
+	public:
+		using iterator = SlotIterator<HtItem, typename Entries::iterator_value>;
+		using const_iterator = SlotIterator<HtItem, const value_type>;
+		using local_iterator = iterator;
+		using const_local_iterator = const_iterator;
+		using node_type = ht_detail::NodeHandle<Entries>;
+		struct insert_return_type {
+			iterator position;
+			bool inserted;
+			node_type node;
+		};
+	protected:
+		static constexpr size_t FIB_MULT = 11400714819323198485ull;
+		static constexpr size_t HT_PRIME = 151;
+		static constexpr size_t INITIAL_CAPACITY = 32;
+		static constexpr float DEFAULT_MAX_LOAD = 0.75f;
+		static constexpr float DEFAULT_GROWTH = 2.0f;
+		static constexpr float MIN_MAX_LOAD = 0.05f;
+		static constexpr float MIN_GROWTH = 1.125f;
+		// Keys a batched lookup hashes and prefetches before probing any.
+		static constexpr size_t BATCH = 16;
+		// The fewest slots each thread of a parallel insert or rehash fills.
+		static constexpr size_t PARALLEL_SPAN = 4096;
+
+		using ctrl_t = ht_detail::ctrl_t;
+		using Group = ht_detail::Group;
+		using Slots = ht_detail::SlotView<HtItem>;
+
+		size_t capacity;
+		size_t len;
+		ht_detail::SlotArray<HtItem, Allocator> slots;
+		// `max_load_factor` and `growth_factor`, and the size at which the
+		// table next has to grow, derived from the first.
+		float load_limit;
+		float growth;
+		size_t grow_at;
+		Hash hashf;
+		KeyEqual cmp;
+#if defined(HT_STATS)
+		mutable ht_detail::StatsCounters counters;
+#endif
+
+		using HashNothrow = std::is_nothrow_invocable_r<size_t, Hash, const Key&>;
+		using IndexNothrow = std::conjunction<
+			TableCore::HashNothrow,
+			std::is_nothrow_invocable_r<bool, KeyEqual, const Key&, const Key&>
+		>;
+		template<class K>
+		using LookupNothrow = std::conjunction<
+			std::is_nothrow_invocable_r<size_t, Hash, const K&>,
+			std::is_nothrow_invocable_r<bool, KeyEqual, const Key&, const K&>
+		>;
+		// With a transparent `Hash` and `KeyEqual`, lookups take any key type
+		// they accept, as C++20's unordered containers do, rather than making a
+		// `Key` first.
+		template<class K>
+		using TransparentKey = std::enable_if_t<
+			ht_detail::is_transparent<Hash>::value && ht_detail::is_transparent<KeyEqual>::value
+				&& !std::is_convertible_v<const K&, iterator> && !std::is_convertible_v<const K&, const_iterator>,
+			K
+		>;
+		using ItemNothrowDefault = typename Entries::template all<std::is_nothrow_default_constructible>;
+		using ItemNothrowCopy = typename Entries::template all<std::is_nothrow_copy_constructible>;
+		using ItemNothrowMove = typename Entries::template all<std::is_nothrow_move_constructible>;
+		using ItemNothrowDestructible = typename Entries::template all<std::is_nothrow_destructible>;
+		using HashEqualNothrowDefault = std::conjunction<
+			std::is_nothrow_default_constructible<Hash>,
+			std::is_nothrow_default_constructible<KeyEqual>
+		>;
+		using HashEqualNothrowCopy = std::conjunction<
+			std::is_nothrow_copy_constructible<Hash>,
+			std::is_nothrow_copy_constructible<KeyEqual>
+		>;
+		using HashEqualNothrowMove = std::conjunction<
+			std::is_nothrow_move_constructible<Hash>,
+			std::is_nothrow_move_constructible<KeyEqual>
+		>;
+		using HashEqualNothrowDestructible = std::conjunction<
+			std::is_nothrow_destructible<Hash>,
+			std::is_nothrow_destructible<KeyEqual>
+		>;
+
+		// The most entries `cap` slots may hold at a maximum load of `ml`; at
+		// least one slot is always left empty, so probing always terminates.
+		static size_t limit_for(size_t cap, float ml) noexcept {
+			if (cap == 0) {
+				return 0;
+			}
+			return std::min((size_t) ((double) cap * ml), cap - 1);
+		}
+		// The fewest slots able to hold `count` entries at a maximum load of `ml`.
+		static size_t capacity_for(size_t count, float ml) noexcept {
+			if (count == 0) {
+				return 0;
+			}
+			size_t cap = (size_t) std::ceil((double) count / ml);
+			while (TableCore::limit_for(cap, ml) < count) {
+				cap++;
+			}
+			return cap;
+		}
+		size_t initial_capacity() const noexcept {
+			return std::max(TableCore::INITIAL_CAPACITY, TableCore::capacity_for(1, this->load_limit));
+		}
+		// Capacity to grow to when inserting into a full table.
+		size_t next_capacity() const noexcept {
+			size_t cap = this->capacity;
+			size_t grown = std::max((size_t) ((double) cap * this->growth), cap + 1);
+			return std::max(grown, TableCore::capacity_for(this->len + 1, this->load_limit));
+		}
+
+		// Spreads `hashf`'s result over every bit with a Fibonacci multiply,
+		// unless `Hash` says it's avalanching already.
+		template<class K>
+		static size_t mix(const K& val, const Hash &hashf) noexcept(std::is_nothrow_invocable_r<size_t, Hash, const K&>::value) {
+			if constexpr (ht_detail::is_avalanching<Hash>::value) {
+				return hashf(val);
+			} else {
+				return hashf(val) * TableCore::FIB_MULT;
+			}
+		}
+		// The home slot is the high word of `mixed * cap`, which maps the mixed
+		// hash onto any capacity without a division; for a power-of-2 capacity
+		// it's just the top bits, as with plain Fibonacci hashing. The top 7
+		// bits of the low word, which the home slot doesn't depend on, become
+		// the tag.
+		static size_t home(size_t mixed, size_t cap) noexcept {
+			return (size_t) (((unsigned __int128) mixed * cap) >> 64);
+		}
+		static ctrl_t tag(size_t mixed, size_t cap) noexcept {
+			return (ctrl_t) ((mixed * cap) >> 57);
+		}
+		static size_t hash(const Key& val, size_t cap, const Hash &hashf) noexcept(HashNothrow::value) {
+			return TableCore::home(TableCore::mix(val, hashf), cap);
+		}
+
+		Slots view() const noexcept {
+			return this->slots.view();
+		}
+		// The mixed hash of the entry in `index`.
+		size_t mixed_at(const Slots& slots, size_t index) const noexcept(HashNothrow::value) {
+			if constexpr (CacheHash) {
+				return slots.hashes[index];
+			} else {
+				return TableCore::mix(Entries::key(*slots.items[index]), this->hashf);
+			}
+		}
+		// For probing policies to recompute where an entry belongs.
+		auto home_of(const Slots& slots) const noexcept {
+			return [&slots, this](size_t index) {
+				return TableCore::home(this->mixed_at(slots, index), slots.cap);
+			};
+		}
+
+		// Returns `(true, index of key)` if `key` is in the table, or `(false,
+		// where key would be inserted)` otherwise.
+		template<class K>
+		std::pair<bool, size_t> find_slot(const K& key, size_t mixed) const noexcept(LookupNothrow<K>::value) {
+			Slots slots = this->view();
+			size_t home = TableCore::home(mixed, slots.cap);
+			auto out = Probe::find(
+				slots,
+				home,
+				TableCore::tag(mixed, slots.cap),
+				[&](size_t index) {
+					if constexpr (CacheHash) {
+						if (slots.hashes[index] != mixed) {
+							return false;
+						}
+					}
+					return this->cmp(Entries::key(*slots.items[index]), key);
+				},
+				this->home_of(slots)
+			);
+#if defined(HT_STATS)
+			this->counters.lookup(out.first, ht_detail::probe_distance(home, out.second, slots.cap));
+#endif
+			return out;
+		}
+		template<class K>
+		std::pair<bool, size_t> index_of(const K& key) const noexcept(LookupNothrow<K>::value) {
+			return this->find_slot(key, TableCore::mix(key, this->hashf));
+		}
+		// Lookups shared by the `const Key&` and transparent overloads.
+		template<class K>
+		bool contains_key(const K& key) const noexcept(LookupNothrow<K>::value) {
+			return this->capacity > 0 && this->index_of(key).first;
+		}
+		template<class K>
+		HtItem* find_item(const K& key) const noexcept(LookupNothrow<K>::value) {
+			if (this->capacity == 0) {
+				return nullptr;
+			}
+			auto [contains, index] = this->index_of(key);
+			return contains ? this->slots.items + index : nullptr;
+		}
+		// The slots of the group at `index`, before its first empty one, whose
+		// tag is `tag`. Coroutines call this rather than keeping a `Group`,
+		// whose vector needn't be aligned in their frames.
+		static typename ht_detail::Group::mask_t chain_matches(const Slots& slots, size_t index, ht_detail::ctrl_t tag) noexcept {
+			ht_detail::Group group(slots.ctrl + index);
+			return ht_detail::Group::below(group.match(tag), group.match_empty());
+		}
+		static uintptr_t line_of(const void* at) noexcept {
+			return (uintptr_t) at / 64;
+		}
+		static void prefetch_slot(const Slots& slots, size_t index) noexcept {
+			__builtin_prefetch(slots.ctrl + index);
+			__builtin_prefetch(slots.items + index);
+			if constexpr (CacheHash) {
+				__builtin_prefetch(slots.hashes + index);
+			}
+		}
+		// Calls `found` with each key's slot, or `nullptr`, in order. Hashes a
+		// batch of keys and prefetches their home slots before probing for
+		// any, so the cache misses of a batch overlap rather than each lookup
+		// waiting on the one before.
+		template<class ForwardIt, class Found>
+		void find_items(ForwardIt first, ForwardIt last, Found&& found) const {
+			if (this->capacity == 0) {
+				for (; first != last; ++first) {
+					found(nullptr);
+				}
+				return;
+			}
+			Slots slots = this->view();
+			size_t mixed[TableCore::BATCH];
+			while (first != last) {
+				ForwardIt batch = first;
+				size_t count = 0;
+				for (; count < TableCore::BATCH && first != last; ++first, ++count) {
+					mixed[count] = TableCore::mix(*first, this->hashf);
+					TableCore::prefetch_slot(slots, TableCore::home(mixed[count], slots.cap));
+				}
+				for (size_t i = 0; i < count; ++i, ++batch) {
+					auto [contains, index] = this->find_slot(*batch, mixed[i]);
+					found(contains ? slots.items + index : nullptr);
+				}
+			}
+		}
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+		// A lane of `run_interleaved`, in a table with slots: it looks up one
+		// key after another as `index_of` does, but first prefetches the home
+		// slot, as `find_items` does, and suspends; if the first tag there
+		// that matches is another line's, it prefetches that entry and
+		// suspends again. Then it probes as `find_slot` does, on lines
+		// already in the cache.
+		template<class Lookups>
+		ht_detail::LookupLane lookup_lane(Lookups& lookups) const {
+			Slots slots = this->view();
+			while (lookups.first != lookups.last) {
+				if (lookups.full()) {
+					co_await std::suspend_always();
+					continue;
+				}
+				size_t lookup = lookups.started++;
+				const auto& key = *lookups.first;
+				++lookups.first;
+				size_t mixed = TableCore::mix(key, this->hashf);
+				size_t home = TableCore::home(mixed, slots.cap);
+				TableCore::prefetch_slot(slots, home);
+				co_await std::suspend_always();
+				auto match = TableCore::chain_matches(slots, home, TableCore::tag(mixed, slots.cap));
+				if (match != 0) {
+					size_t first = ht_detail::probe_next(home, ht_detail::Group::lowest(match), slots.cap);
+					// entries pushed only a few slots on are usually in the
+					// line already fetched
+					if (TableCore::line_of(slots.items + first) != TableCore::line_of(slots.items + home)) {
+						TableCore::prefetch_slot(slots, first);
+						co_await std::suspend_always();
+					}
+				}
+				auto [contains, index] = this->find_slot(key, mixed);
+				lookups.found(lookup, contains ? slots.items + index : nullptr);
+			}
+		}
+		// `find_items`, with up to `in_flight` lanes of lookups at once.
+		template<class ForwardIt, class Found>
+		void find_items_interleaved(ForwardIt first, ForwardIt last, size_t in_flight, Found&& found) const {
+			if (this->capacity == 0) {
+				for (; first != last; ++first) {
+					found(nullptr);
+				}
+				return;
+			}
+			ht_detail::InterleavedLookups<ForwardIt, HtItem*> lookups(first, last);
+			ht_detail::run_interleaved(lookups, in_flight, [this](auto& lookups) {
+				return this->lookup_lane(lookups);
+			}, found);
+		}
+#endif
+		template<class K>
+		size_t erase_key(const K& key) noexcept(LookupNothrow<K>::value && ItemNothrowMove::value && ItemNothrowDestructible::value) {
+			HtItem* item = this->find_item(key);
+			if (item == nullptr) {
+				return 0;
+			}
+			this->erase_at(item - this->slots.items);
+			return 1;
+		}
+
+		// Constructs an entry from `args` in `index`, the slot `find_slot` (or
+		// `find_insert`) picked for it.
+		template<class... Args>
+		size_t place(const Slots& slots, size_t index, size_t mixed, Args&&... args) {
+			Probe::make_room(slots, index, TableCore::home(mixed, slots.cap));
+			return TableCore::fill(slots, index, mixed, std::forward<Args>(args)...);
+		}
+		// `place`, once `index` has been made room in.
+		template<class... Args>
+		static size_t fill(const Slots& slots, size_t index, size_t mixed, Args&&... args) {
+			slots.items[index].emplace(std::forward<Args>(args)...);
+			if constexpr (CacheHash) {
+				slots.hashes[index] = mixed;
+			}
+			slots.set_ctrl(index, TableCore::tag(mixed, slots.cap));
+			return index;
+		}
+
+		// Places entries `[0, count)` into `slots` from up to `threads` threads,
+		// for `insert_parallel` and `reserve_exact`. Every entry `present(i)`
+		// accepts is hashed by `mixed_of(i)` into `mixed[i]`, and entries are
+		// grouped by which of a few equal ranges of slots their home is in,
+		// keeping their order within each. Then each range is filled by a thread
+		// of its own, which is the only one to touch its slots: an entry is
+		// skipped if `same(index, i)` finds its key already in slot `index`, or
+		// constructed from `value(i)` in its place. `placed` counts the entries
+		// constructed, even if one throws. Entries whose probe would run past
+		// the end of their range are returned, in order, for the caller to
+		// insert normally.
+		template<class Present, class MixedOf, class Same, class Value>
+		std::vector<size_t> fill_parallel(const Slots& slots, size_t count, size_t threads, std::vector<size_t>& mixed, size_t& placed, Present&& present, MixedOf&& mixed_of, Same&& same, Value&& value) const {
+			size_t cap = slots.cap;
+			size_t ranges = std::max<size_t>(1, std::min(threads, cap / TableCore::PARALLEL_SPAN));
+			size_t span = (cap + ranges - 1) / ranges;
+			// the input is split into as many chunks as there are ranges, and
+			// `offsets[chunk * ranges + range]` counts the chunk's entries for
+			// each range, then becomes where they go in `order`
+			std::vector<size_t> offsets(ranges * ranges);
+			auto chunk = [&](size_t c) {
+				return std::make_pair(count / ranges * c + std::min(c, count % ranges), count / ranges * (c + 1) + std::min(c + 1, count % ranges));
+			};
+			mixed.resize(count);
+			ht_detail::parallel_for(ranges, [&](size_t c) {
+				auto [from, to] = chunk(c);
+				size_t* counts = offsets.data() + c * ranges;
+				for (size_t i = from; i < to; i++) {
+					if (present(i)) {
+						mixed[i] = mixed_of(i);
+						counts[TableCore::home(mixed[i], cap) / span]++;
+					}
+				}
+			});
+			std::vector<size_t> starts(ranges + 1);
+			size_t total = 0;
+			for (size_t r = 0; r < ranges; r++) {
+				starts[r] = total;
+				for (size_t c = 0; c < ranges; c++) {
+					total += std::exchange(offsets[c * ranges + r], total);
+				}
+			}
+			starts[ranges] = total;
+			std::vector<size_t> order(total);
+			ht_detail::parallel_for(ranges, [&](size_t c) {
+				auto [from, to] = chunk(c);
+				size_t* next = offsets.data() + c * ranges;
+				for (size_t i = from; i < to; i++) {
+					if (present(i)) {
+						order[next[TableCore::home(mixed[i], cap) / span]++] = i;
+					}
+				}
+			});
+
+			std::vector<std::vector<size_t>> spilled(ranges);
+			std::vector<size_t> counts(ranges);
+			auto home_of = this->home_of(slots);
+			auto fill_range = [&](size_t r) {
+				size_t limit = std::min(cap, (r + 1) * span);
+				size_t done = 0;
+				try {
+					for (size_t pos = starts[r]; pos < starts[r + 1]; pos++) {
+						size_t i = order[pos];
+						size_t m = mixed[i];
+						auto [claim, index] = Probe::claim_within(
+							slots,
+							TableCore::home(m, cap),
+							limit,
+							TableCore::tag(m, cap),
+							[&](size_t index) {
+								if constexpr (CacheHash) {
+									if (slots.hashes[index] != m) {
+										return false;
+									}
+								}
+								return same(index, i);
+							},
+							home_of
+						);
+						if (claim == ht_detail::Claim::ROOM) {
+							TableCore::fill(slots, index, m, value(i));
+							done++;
+						} else if (claim == ht_detail::Claim::SPILL) {
+							spilled[r].push_back(i);
+						}
+					}
+				} catch (...) {
+					counts[r] = done;
+					throw;
+				}
+				counts[r] = done;
+			};
+			try {
+				ht_detail::parallel_for(ranges, fill_range);
+			} catch (...) {
+				for (size_t done : counts) {
+					placed += done;
+				}
+				throw;
+			}
+			for (size_t done : counts) {
+				placed += done;
+			}
+			std::vector<size_t> out;
+			for (const auto& range : spilled) {
+				out.insert(out.end(), range.begin(), range.end());
+			}
+			return out;
+		}
+
+		// Assumes `key` does not already exist in `slots`, so it doesn't
+		// compare any keys.
+		template<class V>
+		std::pair<iterator, bool> inner_insert(const Slots& slots, size_t mixed, V&& entry) {
+			size_t index = Probe::find_insert(slots, TableCore::home(mixed, slots.cap), this->home_of(slots));
+			this->place(slots, index, mixed, std::forward<V>(entry));
+			return std::make_pair(iterator(slots.items + index, slots.ctrl + index), true);
+		}
+
+		// `index` must be the slot `find_slot` returned for the key `args`
+		// construct an entry for.
+		template<class... Args>
+		std::pair<iterator, bool> emplace_unique_hint(size_t index, size_t mixed, Args&&... args) {
+			// resize once past the maximum load factor; the entry is built
+			// first, since `args` may refer to entries the resize moves
+			if (this->len++ >= this->grow_at) {
+				MutableValue pair(std::forward<Args>(args)...);
+				this->reserve_exact(this->capacity, this->next_capacity());
+				return this->inner_insert(this->view(), mixed, std::move(pair));
+			}
+			this->place(this->view(), index, mixed, std::forward<Args>(args)...);
+			return std::make_pair(this->iterator_at(index), true);
+		}
+
+		// Inserts `item`, replacing any existing value for its key; used by the
+		// initializer-list paths, which size the table beforehand.
+		void assign_presized(value_type item) {
+			size_t mixed = TableCore::mix(Entries::key(item), this->hashf);
+			auto [contains, index] = this->find_slot(Entries::key(item), mixed);
+			if (contains) {
+				Entries::assign(*this->slots.items[index], std::move(item));
+			} else {
+				this->len++;
+				this->place(this->view(), index, mixed, std::move(item));
+			}
+		}
+
+		// Grows the table, at most once, so that `count` more entries fit.
+		void reserve_more(size_t count, size_t threads = 1) {
+			if (count == 0) {
+				return;
+			}
+			if (this->capacity == 0) {
+				this->reserve_exact(0, std::max(this->initial_capacity(), TableCore::capacity_for(count, this->load_limit)));
+			} else if (this->len + count > this->grow_at) {
+				this->reserve_exact(this->capacity, std::max(this->next_capacity(), TableCore::capacity_for(this->len + count, this->load_limit)), threads);
+			}
+		}
+		// The mixed hash, for this table, of the entry of `source` in
+		// `index`; a stateless `Hash` gives every table the same hashes, so
+		// they needn't be recomputed if `source` has cached them.
+		size_t mixed_from(const TableCore& source, const Slots& slots, size_t index) const noexcept(HashNothrow::value) {
+			if constexpr (std::is_empty_v<Hash>) {
+				return source.mixed_at(slots, index);
+			} else {
+				return TableCore::mix(Entries::key(*slots.items[index]), this->hashf);
+			}
+		}
+		// Moves the entries of `source` into this table, which is grown for
+		// all of them first. Entries whose key this table already has, in slot
+		// `index`, are passed to `duplicate(index, entry)`; if `CONSUMES`, it
+		// takes every one, so `source` is left empty, and otherwise they stay
+		// in `source`.
+		template<bool CONSUMES, class F>
+		void merge_from(TableCore& source, F&& duplicate) {
+			if (&source == this || source.len == 0) {
+				return;
+			}
+			this->reserve_more(source.len);
+			Slots from = source.view();
+			Slots to = this->view();
+			auto move_in = [&](size_t i) {
+				size_t mixed = this->mixed_from(source, from, i);
+				auto [contains, index] = this->find_slot(Entries::key(*from.items[i]), mixed);
+				if (!contains) {
+					this->len++;
+					this->place(to, index, mixed, from.items[i].take());
+					return true;
+				}
+				if constexpr (CONSUMES) {
+					duplicate(index, *from.items[i]);
+					return true;
+				} else {
+					return false;
+				}
+			};
+			if constexpr (CONSUMES) {
+				for (size_t i = 0; i < from.cap; i++) {
+					if (from.full(i)) {
+						move_in(i);
+					}
+				}
+				// only moved-from entries are left
+				source.clear();
+			} else {
+				// erasing shifts later entries back, so each slot is drained
+				// until it's empty or holds a duplicate
+				for (size_t i = 0; i < from.cap; i++) {
+					while (from.full(i) && move_in(i)) {
+						source.erase_at(i);
+					}
+				}
+			}
+		}
+
+		void erase_at(size_t index) {
+			Slots slots = this->view();
+			Probe::erase(slots, index, this->home_of(slots));
+			this->len--;
+		}
+
+		// Reinserts every entry from `start` up to the next empty slot, closing
+		// up any holes left before it by erasing several entries at once.
+		void repair_chain(size_t start) {
+			Slots slots = this->view();
+			for (size_t i = start; slots.full(i); i = ht_detail::probe_next(i, 1, slots.cap)) {
+				size_t mixed = this->mixed_at(slots, i);
+				MutableValue pair(slots.items[i].take());
+				slots.items[i].reset();
+				slots.set_ctrl(i, ht_detail::CTRL_EMPTY);
+				this->inner_insert(slots, mixed, std::move(pair));
+			}
+		}
+
+		// `new_cap` must be able to hold every entry at the maximum load factor.
+		// With more than one thread, large tables are rehashed by
+		// `fill_parallel`.
+		void reserve_exact(size_t old_cap, size_t new_cap, size_t threads = 1) {
+#if defined(HT_STATS)
+			auto started = std::chrono::steady_clock::now();
+#endif
+			ht_detail::SlotArray<HtItem, Allocator> new_slots(new_cap, Probe::TRACKS_DISTANCE, CacheHash, this->slots.alloc);
+			Slots old_view = this->slots.view();
+			Slots new_view = new_slots.view();
+			if (threads > 1 && this->len > 0 && new_cap >= 2 * TableCore::PARALLEL_SPAN) {
+				std::vector<size_t> mixed;
+				size_t placed = 0;
+				auto spilled = this->fill_parallel(
+					new_view,
+					old_cap,
+					threads,
+					mixed,
+					placed,
+					[&](size_t i) { return old_view.full(i); },
+					[&](size_t i) { return this->mixed_at(old_view, i); },
+					// keys are already unique
+					[](size_t, size_t) { return false; },
+					[&](size_t i) -> decltype(auto) { return old_view.items[i].take(); }
+				);
+				for (size_t i : spilled) {
+					this->inner_insert(new_view, mixed[i], old_view.items[i].take());
+				}
+			} else {
+				for (size_t i = 0; i < old_cap; i++) {
+					if (old_view.full(i)) {
+						this->inner_insert(new_view, this->mixed_at(old_view, i), old_view.items[i].take());
+					}
+				}
+			}
+			this->slots = std::move(new_slots);
+			this->capacity = new_cap;
+			this->grow_at = TableCore::limit_for(new_cap, this->load_limit);
+#if defined(HT_STATS)
+			this->counters.resized(std::chrono::steady_clock::now() - started);
+#endif
+		}
+
+		// The incremental form of `reserve_exact`: moves every entry in slots
+		// `[from, from + count)` into `dest`, which mustn't hold any of their
+		// keys and must have room for them without growing. Erasing shifts later
+		// entries back, so each slot is drained until it stays empty; the slots
+		// before `from` must already be empty. Returns the slot to continue from.
+		size_t migrate_to(TableCore& dest, size_t from, size_t count) {
+			Slots slots = this->view();
+			size_t stop = std::min(from + count, slots.cap);
+			for (size_t i = from; i < stop; i++) {
+				while (slots.full(i)) {
+					size_t mixed = this->mixed_at(slots, i);
+					MutableValue pair(slots.items[i].take());
+					this->erase_at(i);
+					dest.len++;
+					dest.inner_insert(dest.view(), mixed, std::move(pair));
+				}
+			}
+			return stop;
+		}
+
+		// Calls `f(entry)`, as a `Value&`, for each full slot in `[first,
+		// last)`, finding them a group of control bytes at a time.
+		template<class Value, class Item, class F>
+		static void scan(Item* items, const ctrl_t* ctrl, size_t first, size_t last, F& f) {
+			for (size_t base = first; base < last; base += Group::WIDTH) {
+				auto full = Group::first(Group(ctrl + base).match_full(), last - base);
+				while (full != 0) {
+					Value& entry = *items[base + Group::lowest(full)];
+					f(entry);
+					full &= full - 1;
+				}
+			}
+		}
+		template<class Value, class Item, class F>
+		void scan_chunk(Item* items, size_t chunk, F& f) const {
+			size_t first = chunk * TableCore::PARALLEL_SPAN;
+			size_t last = std::min(this->capacity, first + TableCore::PARALLEL_SPAN);
+			TableCore::scan<Value>(items, this->slots.ctrl, first, last, f);
+		}
+
+		// An iterator at slot `index`.
+		iterator iterator_at(size_t index) noexcept {
+			return iterator(this->slots.items + index, this->slots.ctrl + index);
+		}
+		const_iterator iterator_at(size_t index) const noexcept {
+			return const_iterator(this->slots.items + index, this->slots.ctrl + index);
+		}
+
+	public:
+		TableCore() noexcept(HashEqualNothrowDefault::value && std::is_nothrow_default_constructible_v<Allocator>) {
+			this->capacity = this->len = this->grow_at = 0;
+			this->load_limit = TableCore::DEFAULT_MAX_LOAD;
+			this->growth = TableCore::DEFAULT_GROWTH;
+			this->hashf = Hash{};
+			this->cmp = KeyEqual{};
+		}
+		explicit TableCore(const allocator_type& alloc) noexcept(HashEqualNothrowDefault::value) : slots(alloc) {
+			this->capacity = this->len = this->grow_at = 0;
+			this->load_limit = TableCore::DEFAULT_MAX_LOAD;
+			this->growth = TableCore::DEFAULT_GROWTH;
+			this->hashf = Hash{};
+			this->cmp = KeyEqual{};
+		}
+		TableCore(size_t bucket_count, const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{}, const allocator_type& alloc = allocator_type{})
+			: slots(bucket_count, Probe::TRACKS_DISTANCE, CacheHash, alloc) {
+			this->load_limit = TableCore::DEFAULT_MAX_LOAD;
+			this->growth = TableCore::DEFAULT_GROWTH;
+			this->capacity = bucket_count;
+			this->len = 0;
+			this->grow_at = TableCore::limit_for(this->capacity, this->load_limit);
+			this->hashf = Hash{hash};
+			this->cmp = KeyEqual{cmp};
+		}
+		TableCore(size_t bucket_count, const allocator_type& alloc) : TableCore(bucket_count, Hash{}, KeyEqual{}, alloc) { }
+		TableCore(size_t bucket_count, const Hash& hash, const allocator_type& alloc) : TableCore(bucket_count, hash, KeyEqual{}, alloc) { }
+		TableCore(std::initializer_list<value_type> init, size_t bucket_count = 0, const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{}, const allocator_type& alloc = allocator_type{})
+			: slots(std::max({ bucket_count, TableCore::capacity_for(init.size(), TableCore::DEFAULT_MAX_LOAD), (size_t) 1 }), Probe::TRACKS_DISTANCE, CacheHash, alloc) {
+			this->load_limit = TableCore::DEFAULT_MAX_LOAD;
+			this->growth = TableCore::DEFAULT_GROWTH;
+			this->capacity = this->slots.cap;
+			this->len = 0;
+			this->grow_at = TableCore::limit_for(this->capacity, this->load_limit);
+			this->hashf = Hash{hash};
+			this->cmp = KeyEqual{cmp};
+			for (auto item : std::move(init)) {
+				this->assign_presized(std::move(item));
+			}
+		}
+		TableCore(std::initializer_list<value_type> init, size_t bucket_count, const allocator_type& alloc)
+			: TableCore(init, bucket_count, Hash{}, KeyEqual{}, alloc) { }
+		// Copy constructor
+		TableCore(const TableCore& other) : slots(other.slots) {
+			this->hashf = Hash{other.hashf};
+			this->cmp = KeyEqual{other.cmp};
+			this->load_limit = other.load_limit;
+			this->growth = other.growth;
+			this->capacity = other.capacity;
+			this->len = other.len;
+			this->grow_at = other.grow_at;
+		}
+		TableCore(const TableCore& other, const allocator_type& alloc) : slots(other.slots, alloc) {
+			this->hashf = Hash{other.hashf};
+			this->cmp = KeyEqual{other.cmp};
+			this->load_limit = other.load_limit;
+			this->growth = other.growth;
+			this->capacity = other.capacity;
+			this->len = other.len;
+			this->grow_at = other.grow_at;
+		}
+		// Move constructor
+		TableCore(TableCore&& other) noexcept(HashEqualNothrowMove::value) : slots(std::move(other.slots)) {
+			this->capacity = other.capacity;
+			this->len = other.len;
+			this->grow_at = other.grow_at;
+			this->load_limit = other.load_limit;
+			this->growth = other.growth;
+			this->hashf = std::move(other.hashf);
+			this->cmp = std::move(other.cmp);
+			other.capacity = other.len = other.grow_at = 0;
+		}
+		// Moves the entries one by one if `alloc` can't free `other`'s storage.
+		TableCore(TableCore&& other, const allocator_type& alloc) : slots(std::move(other.slots), alloc) {
+			this->capacity = other.capacity;
+			this->len = other.len;
+			this->grow_at = other.grow_at;
+			this->load_limit = other.load_limit;
+			this->growth = other.growth;
+			this->hashf = std::move(other.hashf);
+			this->cmp = std::move(other.cmp);
+			other.capacity = other.len = other.grow_at = 0;
+		}
+		~TableCore() noexcept(ItemNothrowDestructible::value && HashEqualNothrowDestructible::value) = default;
+
+		// Copy assignment
+		TableCore& operator=(const TableCore& other) {
+			if (this == &other) {
+				return *this;
+			}
+			this->slots = other.slots;
+			this->capacity = other.capacity;
+			this->len = other.len;
+			this->grow_at = other.grow_at;
+			this->load_limit = other.load_limit;
+			this->growth = other.growth;
+			this->hashf = Hash{other.hashf};
+			this->cmp = KeyEqual{other.cmp};
+			return *this;
+		}
+		// Move assignment
+		TableCore& operator=(TableCore&& other) noexcept(
+			ItemNothrowDestructible::value && HashEqualNothrowMove::value && HashEqualNothrowDestructible::value
+			&& (std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value || std::allocator_traits<Allocator>::is_always_equal::value)
+		) {
+			if (this == &other) {
+				return *this;
+			}
+			this->capacity = other.capacity;
+			this->len = other.len;
+			this->grow_at = other.grow_at;
+			this->load_limit = other.load_limit;
+			this->growth = other.growth;
+			this->slots = std::move(other.slots);
+			this->hashf = std::move(other.hashf);
+			this->cmp = std::move(other.cmp);
+			other.capacity = other.len = other.grow_at = 0;
+			return *this;
+		}
+		// assign from initializer list
+		TableCore& operator=(std::initializer_list<value_type> ilist) {
+			// to keep it below the maximum load factor
+			size_t new_cap = std::max({ this->capacity, TableCore::capacity_for(ilist.size(), this->load_limit), (size_t) 1 });
+			this->capacity = new_cap;
+			this->len = 0;
+			this->grow_at = TableCore::limit_for(new_cap, this->load_limit);
+			this->slots = ht_detail::SlotArray<HtItem, Allocator>(new_cap, Probe::TRACKS_DISTANCE, CacheHash, this->slots.alloc);
+			for (auto item : std::move(ilist)) {
+				this->assign_presized(std::move(item));
+			}
+			return *this;
+		}
+
+		allocator_type get_allocator() const noexcept {
+			return this->slots.alloc;
+		}
+
+
+		bool contains(const Key& key) const noexcept(IndexNothrow::value) {
+			return this->contains_key(key);
+		}
+		template<class K, class = TransparentKey<K>>
+		bool contains(const K& key) const noexcept(LookupNothrow<K>::value) {
+			return this->contains_key(key);
+		}
+		size_t count(const Key& key) const noexcept(IndexNothrow::value) {
+			return this->contains_key(key) ? 1 : 0;
+		}
+		template<class K, class = TransparentKey<K>>
+		size_t count(const K& key) const noexcept(LookupNothrow<K>::value) {
+			return this->contains_key(key) ? 1 : 0;
+		}
+
+		// Makes room for at least `count` entries without growing past the
+		// maximum load factor. Because this specifies only a minimum (without
+		// an upper bound), it never lowers capacity, assuming that if that many
+		// items were ever allocated, that many may be allocated again later. If
+		// lowering memory usage is desired, use `shrink_to_fit`.
+		void reserve(size_t count) {
+			size_t old_cap = this->capacity;
+			size_t new_cap = TableCore::capacity_for(count, this->load_limit);
+			if (new_cap <= old_cap) {
+				return;
+			}
+			this->reserve_exact(old_cap, new_cap);
+		}
+
+		// `reserve`, but rehashing large tables across `threads` threads (or
+		// one per hardware thread, for 0), as `insert_parallel` fills them.
+		// `Hash` is called from several threads at once (unless hashes are
+		// cached).
+		void reserve(size_t count, size_t threads) {
+			size_t old_cap = this->capacity;
+			size_t new_cap = TableCore::capacity_for(count, this->load_limit);
+			if (new_cap <= old_cap) {
+				return;
+			}
+			this->reserve_exact(old_cap, new_cap, ht_detail::thread_count(threads));
+		}
+
+		void shrink_to_fit() {
+			if (this->len == 0) {
+				this->clear();
+				return;
+			}
+			size_t old_cap = this->capacity;
+			size_t new_cap = TableCore::capacity_for(this->len, this->load_limit);
+			if (new_cap >= old_cap) {
+				return;
+			}
+			this->reserve_exact(old_cap, new_cap);
+		}
+
+		// Sets the slot count to at least `bucket_count` (and enough for the
+		// current entries at the maximum load factor), rehashing every entry
+		// even if that doesn't change the capacity. Like `reserve`, it never
+		// lowers capacity.
+		void rehash(size_t bucket_count) {
+			size_t old_cap = this->capacity;
+			size_t new_cap = std::max({ old_cap, bucket_count, TableCore::capacity_for(this->len, this->load_limit) });
+			if (new_cap == 0) {
+				return;
+			}
+			this->reserve_exact(old_cap, new_cap);
+		}
+
+		std::pair<iterator, bool> insert(const value_type& value) {
+			return this->emplace(value);
+		}
+		std::pair<iterator, bool> insert(value_type&& value) {
+			return this->emplace(std::move(value));
+		}
+		void insert(std::initializer_list<value_type> ilist) {
+			// reserve for every item up front (to avoid potentially
+			// double-reserving), assuming they're mostly new keys
+			this->reserve_more(ilist.size());
+			for (auto item : std::move(ilist)) {
+				this->assign_presized(std::move(item));
+			}
+		}
+		// Inserts each entry in `[first, last)` whose key isn't in the table
+		// yet, as `insert` would (so of several with the same key, the first
+		// is kept). With forward iterators, the table grows at most once, for
+		// every entry, assuming their keys are mostly new; entries are copied,
+		// or moved through `std::move_iterator`.
+		template<class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
+		void insert(InputIt first, InputIt last) {
+			using Category = typename std::iterator_traits<InputIt>::iterator_category;
+			if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+				this->reserve_more((size_t) std::distance(first, last));
+			}
+			for (; first != last; ++first) {
+				this->emplace(*first);
+			}
+		}
+		// Puts the entry `node` holds into the table, unless its key is
+		// already there, in which case `node` is handed back in the result.
+		insert_return_type insert(node_type&& node) {
+			if (node.empty()) {
+				return insert_return_type { this->end(), false, node_type() };
+			}
+			// another `Hash` may mix the same key differently
+			bool reuse = std::is_empty_v<Hash> && node.hashed_by == &ht_detail::hash_tag<Hash>;
+			size_t mixed = reuse ? node.mixed : TableCore::mix(Entries::key(*node.entry), this->hashf);
+			if (this->capacity == 0) {
+				this->reserve_exact(0, this->initial_capacity());
+			}
+			auto [contains, index] = this->find_slot(Entries::key(*node.entry), mixed);
+			if (contains) {
+				return insert_return_type { this->iterator_at(index), false, std::move(node) };
+			}
+			iterator position = this->emplace_unique_hint(index, mixed, std::move(*node.entry)).first;
+			return insert_return_type { position, true, node_type() };
+		}
+		iterator insert(const_iterator, node_type&& node) {
+			return this->insert(std::move(node)).position;
+		}
+		// Takes the entry at `pos` out of the table, moving it into a node.
+		node_type extract(const_iterator pos) {
+			size_t index = pos.item - this->slots.items;
+			Slots slots = this->view();
+			size_t mixed = this->mixed_at(slots, index);
+			node_type node(typename node_type::Taken(), slots.items[index].take(), mixed, &ht_detail::hash_tag<Hash>);
+			this->erase_at(index);
+			return node;
+		}
+		// An empty node if `key` isn't in the table.
+		node_type extract(const Key& key) {
+			HtItem* item = this->find_item(key);
+			if (item == nullptr) {
+				return node_type();
+			}
+			return this->extract(this->iterator_at(item - this->slots.items));
+		}
+		// Moves every entry of `source` whose key isn't in this table into it,
+		// leaving the rest in `source`, as the standard containers' `merge`
+		// does, but growing this table at most once. Entries are moved, and
+		// with a stateless `Hash`, `source`'s cached hashes are reused.
+		void merge(TableCore& source) {
+			this->merge_from<false>(source, [](size_t, auto&) { });
+		}
+		void merge(TableCore&& source) {
+			this->merge(source);
+		}
+		// Inserts each entry in `[first, last)` whose key isn't in the table
+		// yet, as `insert` would (so of several with the same key, the first
+		// is kept), using up to `threads` threads, or one per hardware thread
+		// for 0. Entries are hashed in parallel and split between threads by
+		// the range of slots their home is in, so each thread fills only its
+		// own slots without locking; the few whose probe would cross into the
+		// next range are inserted afterwards by the calling thread. The table
+		// is sized for every entry first, and grown in parallel too. `Hash`
+		// and `KeyEqual` are called from several threads at once, and each
+		// entry is copied (or, through `std::move_iterator`, moved) from the
+		// thread filling its range.
+		//
+		// Each thread gets at least `PARALLEL_SPAN` slots, so smaller tables use
+		// fewer threads; with one, this is just a slower `insert` loop.
+		template<class RandomIt>
+		void insert_parallel(RandomIt first, RandomIt last, size_t threads = 0) {
+			size_t count = (size_t) (last - first);
+			if (count == 0) {
+				return;
+			}
+			threads = ht_detail::thread_count(threads);
+			this->reserve_more(count, threads);
+			Slots slots = this->view();
+			std::vector<size_t> mixed;
+			auto spilled = this->fill_parallel(
+				slots,
+				count,
+				threads,
+				mixed,
+				this->len,
+				[](size_t) { return true; },
+				[&](size_t i) { return TableCore::mix(Entries::key(*(first + i)), this->hashf); },
+				[&](size_t index, size_t i) { return this->cmp(Entries::key(*slots.items[index]), Entries::key(*(first + i))); },
+				[&](size_t i) -> decltype(auto) { return *(first + i); }
+			);
+			for (size_t i : spilled) {
+				auto [contains, index] = this->find_slot(Entries::key(*(first + i)), mixed[i]);
+				if (!contains) {
+					this->len++;
+					this->place(slots, index, mixed[i], *(first + i));
+				}
+			}
+		}
+
+		template<class... Args>
+		std::pair<iterator, bool> emplace(Args&&... args) {
+			MutableValue pair(std::forward<Args>(args)...);
+			size_t mixed = TableCore::mix(Entries::key(pair), this->hashf);
+			if (this->capacity == 0) {
+				this->reserve_exact(0, this->initial_capacity());
+				this->len++;
+				return this->inner_insert(this->view(), mixed, std::move(pair));
+			}
+			auto [contains, cur_index] = this->find_slot(Entries::key(pair), mixed);
+			if (contains) {
+				return std::make_pair(this->iterator_at(cur_index), false);
+			}
+			return this->emplace_unique_hint(cur_index, mixed, std::move(pair));
+		}
+
+		// A slot can only hold the key that hashes to it, so the hint is only
+		// useful when it already points at that key.
+		template<class... Args>
+		iterator emplace_hint(const_iterator hint, Args&&... args) {
+			MutableValue pair(std::forward<Args>(args)...);
+			if (hint != this->cend() && *hint.ctrl != ht_detail::CTRL_EMPTY && this->cmp(Entries::key(**hint.item), Entries::key(pair))) {
+				return iterator((HtItem*) hint.item, hint.ctrl);
+			}
+			// hint was bad, ignore it
+			return this->emplace(std::move(pair)).first;
+		}
+
+		template<class... Args>
+		std::pair<iterator, bool> emplace_or_assign(Args&&... args) {
+			MutableValue pair(std::forward<Args>(args)...);
+			size_t mixed = TableCore::mix(Entries::key(pair), this->hashf);
+			if (this->capacity == 0) {
+				this->reserve_exact(0, this->initial_capacity());
+				this->len++;
+				return this->inner_insert(this->view(), mixed, std::move(pair));
+			}
+			auto [contains, cur_index] = this->find_slot(Entries::key(pair), mixed);
+			if (contains) {
+				Entries::assign(*this->slots.items[cur_index], std::move(pair));
+				return std::make_pair(this->iterator_at(cur_index), false);
+			}
+			return this->emplace_unique_hint(cur_index, mixed, std::move(pair));
+		}
+
+		iterator find(const Key& key) noexcept(IndexNothrow::value) {
+			HtItem* item = this->find_item(key);
+			return item == nullptr ? this->end() : this->iterator_at(item - this->slots.items);
+		}
+		template<class K, class = TransparentKey<K>>
+		iterator find(const K& key) noexcept(LookupNothrow<K>::value) {
+			HtItem* item = this->find_item(key);
+			return item == nullptr ? this->end() : this->iterator_at(item - this->slots.items);
+		}
+		const_iterator find(const Key& key) const noexcept(IndexNothrow::value) {
+			const HtItem* item = this->find_item(key);
+			return item == nullptr ? this->cend() : this->iterator_at(item - this->slots.items);
+		}
+		template<class K, class = TransparentKey<K>>
+		const_iterator find(const K& key) const noexcept(LookupNothrow<K>::value) {
+			const HtItem* item = this->find_item(key);
+			return item == nullptr ? this->cend() : this->iterator_at(item - this->slots.items);
+		}
+		// Looks up every key in `[first, last)`, writing an iterator to each
+		// one's entry (or `end()`) to `out`, and returns the advanced `out`.
+		// Faster than calling `find` per key once the table outgrows the cache.
+		// The keys have to be `Key`s, or types the transparent `find` takes.
+		template<class ForwardIt, class OutputIt>
+		OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+			this->find_items(first, last, [&](HtItem* item) {
+				*out++ = item == nullptr ? this->end() : this->iterator_at(item - this->slots.items);
+			});
+			return out;
+		}
+		template<class ForwardIt, class OutputIt>
+		OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+			this->find_items(first, last, [&](const HtItem* item) {
+				*out++ = item == nullptr ? this->cend() : this->iterator_at(item - this->slots.items);
+			});
+			return out;
+		}
+		// As `find_batch`, but writing whether each key is in the table.
+		template<class ForwardIt, class OutputIt>
+		OutputIt contains_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+			this->find_items(first, last, [&](const HtItem* item) {
+				*out++ = item != nullptr;
+			});
+			return out;
+		}
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+		// As `find_batch`, but with lookups run by up to `in_flight` (at most
+		// 64) coroutines, resumed in turn. Each suspends once it has
+		// prefetched a key's home slot, and again, if the key's tag matched
+		// in another cache line, once it has prefetched that slot, so where
+		// `find_batch` would wait on a displaced entry, this looks up other
+		// keys. Resuming a coroutine costs about as much as a miss, though,
+		// so in tables whose entries are mostly in their home slots'
+		// lines, `find_batch` is faster. Dereferencing `first` has to give
+		// references to keys.
+		template<class ForwardIt, class OutputIt>
+		OutputIt find_interleaved(ForwardIt first, ForwardIt last, OutputIt out, size_t in_flight = TableCore::BATCH) {
+			this->find_items_interleaved(first, last, in_flight, [&](HtItem* item) {
+				*out++ = item == nullptr ? this->end() : this->iterator_at(item - this->slots.items);
+			});
+			return out;
+		}
+		template<class ForwardIt, class OutputIt>
+		OutputIt find_interleaved(ForwardIt first, ForwardIt last, OutputIt out, size_t in_flight = TableCore::BATCH) const {
+			this->find_items_interleaved(first, last, in_flight, [&](const HtItem* item) {
+				*out++ = item == nullptr ? this->cend() : this->iterator_at(item - this->slots.items);
+			});
+			return out;
+		}
+		// As `find_interleaved`, but writing whether each key is in the table.
+		template<class ForwardIt, class OutputIt>
+		OutputIt contains_interleaved(ForwardIt first, ForwardIt last, OutputIt out, size_t in_flight = TableCore::BATCH) const {
+			this->find_items_interleaved(first, last, in_flight, [&](const HtItem* item) {
+				*out++ = item != nullptr;
+			});
+			return out;
+		}
+#endif
+
+		std::pair<iterator, iterator> equal_range(const Key& key) {
+			iterator out = this->find(key);
+			return std::make_pair(out, out);
+		}
+		template<class K, class = TransparentKey<K>>
+		std::pair<iterator, iterator> equal_range(const K& key) {
+			iterator out = this->find(key);
+			return std::make_pair(out, out);
+		}
+		std::pair<const_iterator, const_iterator> equal_range(const Key& key) const {
+			const_iterator out = this->find(key);
+			return std::make_pair(out, out);
+		}
+		template<class K, class = TransparentKey<K>>
+		std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+			const_iterator out = this->find(key);
+			return std::make_pair(out, out);
+		}
 
-	std::pair<bool, size_t> index_of(const Key& key) const noexcept(IndexNothrow::value) {
-		size_t cap = this->capacity;
-		size_t index = HashTable::hash(key, cap, this->hashf);
-		size_t attempts = 0;
-		while (this->items[index]) {
-			if (this->cmp((*this->items[index]).first, key)) {
-				return std::make_pair(true, index);
+		// Erasing shifts later entries of the same chain back, so the returned
+		// iterator may point at the slot that was just erased. An entry pulled
+		// back from the start of the array to its end may be visited twice by an
+		// iteration that erases as it goes.
+		iterator erase(const_iterator pos) noexcept(HashNothrow::value && ItemNothrowMove::value && ItemNothrowDestructible::value) {
+			this->erase_at(pos.item - this->slots.items);
+			return iterator((HtItem*) pos.item, pos.ctrl, pos.end);
+		}
+		iterator erase(const_iterator first, const_iterator last) noexcept(HashNothrow::value && ItemNothrowMove::value && ItemNothrowDestructible::value) {
+			if (first == last) {
+				return iterator((HtItem*) last.item, last.ctrl, last.end);
 			}
-			index = (index + 1) & (cap - 1);
-			if (attempts > this->capacity) {
-				return std::make_pair(false, index);
+			// Empty the whole range before moving anything, so entries from
+			// past `last` can't shift into the range and get erased with it.
+			size_t start = first.item - this->slots.items;
+			size_t stop = last.item - this->slots.items;
+			for (size_t i = start; i < stop; i++) {
+				if (this->slots.ctrl[i] != ht_detail::CTRL_EMPTY) {
+					this->slots.items[i].reset();
+					this->view().set_ctrl(i, ht_detail::CTRL_EMPTY);
+					this->len--;
+				}
 			}
+			this->repair_chain(stop == this->capacity ? 0 : stop);
+			return iterator(this->slots.items + start, this->slots.ctrl + start, last.end);
+		}
+		size_t erase(const Key& key) noexcept(IndexNothrow::value && ItemNothrowMove::value && ItemNothrowDestructible::value) {
+			return this->erase_key(key);
+		}
+		template<class K, class = TransparentKey<K>>
+		size_t erase(const K& key) noexcept(LookupNothrow<K>::value && ItemNothrowMove::value && ItemNothrowDestructible::value) {
+			return this->erase_key(key);
 		}
-		return std::make_pair(false, index);
-	}
 
-	// Assumes `key` does not already exist in `items`, so it continues to
-	// hash as long as that slot is occupied.
-	static std::pair<iterator, bool> inner_insert(std::unique_ptr<HtItem[]> &items, size_t cap, value_type pair, Hash &hashf) noexcept(HashNothrow::value) {
-		size_t index = HashTable::hash(pair.first, cap, hashf);
-		while (items[index]) {
-			index = (index + 1) & (cap - 1);
+		void clear() noexcept(ItemNothrowDestructible::value) {
+			this->capacity = this->len = this->grow_at = 0;
+			this->slots.reset();
 		}
-		items[index].emplace(std::move(pair));
-		return std::make_pair(iterator(items.get() + index), true);
-	}
 
-	template<class... Args>
-	std::pair<iterator, bool> emplace_unique_hint(iterator hint, Args&&... args) noexcept(IndexNothrow::value && ItemNothrowMove::value && std::is_nothrow_invocable<value_type, Args...>::value) {
-		value_type pair(std::forward<Args>(args)...);
-		if (hint != this->end() && !hint.item->has_value()) {
-			bool had_value = hint.item->has_value();
-			hint.item->emplace(std::move(pair));
-			if (!had_value) {
-				size_t cap = this->capacity;
-				// test for resize here; still 75% capacity
-				if (this->len++ << 2 > (cap << 1) + cap) {
-					this->reserve_exact(cap, cap << 1);
-				}
-			}
-			return std::make_pair(hint, !had_value);
-		}
-		size_t cap = this->capacity;
-		// resize on 75% capacity
-		if (this->len++ << 2 > (cap << 1) + cap) {
-			this->reserve_exact(cap, cap << 1);
-			return HashTable::inner_insert(this->items, cap << 1, std::move(pair), this->hashf);
-		} else {
-			return HashTable::inner_insert(this->items, cap, std::move(pair), this->hashf);
-		}
-	}
-
-	// `new_cap` must be a power of 2.
-	void reserve_exact(size_t old_cap, size_t new_cap) {
-		std::unique_ptr<HtItem[]> new_items(new HtItem[new_cap]);
-		for (size_t i = 0; i < old_cap; i++) {
-			if (this->items[i]) {
-				HashTable::inner_insert(
-					new_items,
-					new_cap,
-					std::move(*this->items[i]),
-					this->hashf
-				);
-			}
+		void swap(TableCore& other) noexcept(HashEqualNothrowMove::value) {
+			this->slots.swap(other.slots);
+			auto capacity = this->capacity;
+			auto len = this->len;
+			auto grow_at = this->grow_at;
+			auto load_limit = this->load_limit;
+			auto growth = this->growth;
+			auto hashf = std::move(this->hashf);
+			auto cmp = std::move(this->cmp);
+
+			this->capacity = other.capacity;
+			this->len = other.len;
+			this->grow_at = other.grow_at;
+			this->load_limit = other.load_limit;
+			this->growth = other.growth;
+			this->hashf = std::move(other.hashf);
+			this->cmp = std::move(other.cmp);
+
+			other.capacity = capacity;
+			other.len = len;
+			other.grow_at = grow_at;
+			other.load_limit = load_limit;
+			other.growth = growth;
+			other.hashf = std::move(hashf);
+			other.cmp = std::move(cmp);
 		}
-		this->items = std::move(new_items);
-		this->capacity = new_cap;
-	}
 
-public:
-	class iterator {
-		friend class HashTable;
-	private:
-		HtItem* item;
-		const HtItem* end;
-	public:
-		using iterator_category = std::forward_iterator_tag;
-		using value_type = value_type;
-		using difference_type = std::ptrdiff_t;
-		using pointer = value_type*;
-		using reference = value_type&;
-		iterator(HtItem* item) noexcept : item(item), end(item) { }
-		iterator(HtItem* item, const HtItem* end) noexcept : end(end) {
-			while (!item->has_value() && item != end) {
-				item++;
-			}
-			this->item = item;
+		bool empty() const noexcept {
+			return this->len == 0;
 		}
-		iterator& operator++() noexcept {
-			if (this->item == this->end) {
-				return *this;
-			}
-			do {
-				this->item++;
-			} while (!this->item->has_value() && this->item != this->end);
-			return *this;
+		size_t size() const noexcept {
+			return this->len;
 		}
-		iterator operator++(int) noexcept {
-			iterator out = *this;
-			++(*this);
-			return out;
+		size_t max_size() const noexcept {
+			return this->capacity;
 		}
-		bool operator==(const iterator& other) const noexcept {
-			return this->item == other.item && this->end == other.end;
+
+		iterator begin() noexcept {
+			return iterator(this->slots.items, this->slots.ctrl, this->slots.ctrl + this->capacity);
 		}
-		bool operator!=(const iterator& other) const noexcept {
-			return !(*this == other);
+		iterator end() noexcept {
+			return this->iterator_at(this->capacity);
 		}
-		reference operator*() {
-			return this->item->value();
+		const_iterator begin() const noexcept {
+			return const_iterator(this->slots.items, this->slots.ctrl, this->slots.ctrl + this->capacity);
 		}
-		operator const_iterator() const {
-			return const_iterator(this->item, this->end);
+		const_iterator end() const noexcept {
+			return this->iterator_at(this->capacity);
 		}
-	};
-	class const_iterator {
-		friend class HashTable;
-	private:
-		const HtItem* item;
-		const HtItem* end;
-	public:
-		using iterator_category = std::forward_iterator_tag;
-		using value_type = value_type;
-		using difference_type = std::ptrdiff_t;
-		using pointer = const value_type*;
-		using reference = const value_type&;
-		const_iterator(const HtItem* item) noexcept : item(item), end(item) { }
-		const_iterator(const HtItem* item, const HtItem* end) noexcept : end(end) {
-			while (!item->has_value() && item != end) {
-				item++;
-			}
-			this->item = item;
+		const_iterator cbegin() const noexcept {
+			return const_iterator(this->slots.items, this->slots.ctrl, this->slots.ctrl + this->capacity);
 		}
-		const_iterator& operator++() noexcept {
-			if (this->item == this->end) {
-				return *this;
-			}
-			do {
-				this->item++;
-			} while (!this->item->has_value() && this->item != this->end);
-			return *this;
+		const_iterator cend() const noexcept {
+			return this->iterator_at(this->capacity);
 		}
-		const_iterator operator++(int) noexcept {
-			iterator out = *this;
-			++(*this);
-			return out;
+
+		// How many chunks of `PARALLEL_SPAN` slots `for_each_chunk` splits
+		// the table into.
+		size_t chunk_count() const noexcept {
+			return (this->capacity + TableCore::PARALLEL_SPAN - 1) / TableCore::PARALLEL_SPAN;
+		}
+		// Calls `f(entry)` for every entry in chunk `chunk`, below
+		// `chunk_count()`. No entry is in two chunks, so a traversal can be
+		// split across threads by giving each its own chunks, as long as
+		// nothing changes the table meanwhile.
+		template<class F>
+		void for_each_chunk(size_t chunk, F&& f) {
+			this->template scan_chunk<typename Entries::iterator_value>(this->slots.items, chunk, f);
+		}
+		template<class F>
+		void for_each_chunk(size_t chunk, F&& f) const {
+			this->template scan_chunk<const value_type>(static_cast<const HtItem*>(this->slots.items), chunk, f);
+		}
+		// Calls `f(entry)` for every entry, as iterating would, but finding
+		// full slots a whole group of control bytes at a time, so it's
+		// faster when most slots are empty.
+		template<class F>
+		void for_each(F&& f) {
+			TableCore::scan<typename Entries::iterator_value>(this->slots.items, this->slots.ctrl, 0, this->capacity, f);
+		}
+		template<class F>
+		void for_each(F&& f) const {
+			TableCore::scan<const value_type>(static_cast<const HtItem*>(this->slots.items), this->slots.ctrl, 0, this->capacity, f);
+		}
+		// `for_each`, sharing the chunks between up to `threads` threads (or
+		// one per hardware thread, for 0), so `f` is called from several
+		// threads at once, though never twice for one entry.
+		template<class F>
+		void for_each(F&& f, size_t threads) {
+			size_t chunks = this->chunk_count();
+			threads = std::min(ht_detail::thread_count(threads), chunks);
+			ht_detail::parallel_for(std::max<size_t>(threads, 1), [&](size_t t) {
+				for (size_t chunk = t; chunk < chunks; chunk += threads) {
+					this->for_each_chunk(chunk, f);
+				}
+			});
+		}
+		template<class F>
+		void for_each(F&& f, size_t threads) const {
+			size_t chunks = this->chunk_count();
+			threads = std::min(ht_detail::thread_count(threads), chunks);
+			ht_detail::parallel_for(std::max<size_t>(threads, 1), [&](size_t t) {
+				for (size_t chunk = t; chunk < chunks; chunk += threads) {
+					this->for_each_chunk(chunk, f);
+				}
+			});
 		}
-		bool operator==(const const_iterator& other) const noexcept {
-			return this->item == other.item && this->item == other.end;
+
+		local_iterator begin(size_t n) noexcept {
+			if (n >= this->len) {
+				return this->end();
+			} else {
+				return this->iterator_at(n);
+			}
 		}
-		bool operator!=(const const_iterator& other) const noexcept {
-			return !(*this == other);
+		local_iterator end(size_t n) noexcept {
+			return this->begin(n);
 		}
-		const_reference operator*() const {
-			return this->item->value();
+		const_local_iterator begin(size_t n) const noexcept {
+			return this->cbegin(n);
 		}
-	};
-
-	HashTable() noexcept(HashEqualNothrowDefault::value) {
-		this->capacity = this->len = 0;
-		this->items = nullptr;
-		this->hashf = Hash{};
-		this->cmp = KeyEqual{};
-	}
-	HashTable(size_t bucket_count, const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{}, const allocator_type& alloc = allocator_type{}) {
-		if (bucket_count == 0) {
-			this->capacity = 0;
-			this->items = nullptr;
-		} else {
-			// capacity must always be a power of 2
-#if __cplusplus >= 202002L
-			this->capacity = std::bit_ceil(bucket_count);
-#else
-			this->capacity = HashTable::bit_ceil(bucket_count);
-#endif
-			this->items = std::make_unique<HtItem[]>(this->capacity);
+		const_local_iterator end(size_t n) const noexcept {
+			return this->cbegin(n);
 		}
-		this->len = 0;
-		this->hashf = Hash{hash};
-		this->cmp = KeyEqual{cmp};
-	}
-	HashTable(std::initializer_list<value_type> init, size_t bucket_count = 0, const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{}, const allocator_type& alloc = allocator_type{}) {
-		// capacity must always be a power of 2
-#if __cplusplus >= 202002L
-		this->capacity = std::bit_ceil(std::max(bucket_count, init.size()));
-#else
-		this->capacity = HashTable::bit_ceil(std::max(bucket_count, init.size()));
-#endif
-		this->len = 0;
-		this->items = std::make_unique<HtItem[]>(this->capacity);
-		this->hashf = Hash{hash};
-		this->cmp = KeyEqual{cmp};
-		for (auto item : std::move(init)) {
-			auto [contains, index] = this->index_of(item.first);
-			if (contains && this->cmp((*this->items[index]).first, item.first)) {
-				this->items[index].emplace(std::move(item));
-			} else if (!this->items[index].has_value()) {
-				this->len++;
-				this->items[index].emplace(std::move(item));
+		const_local_iterator cbegin(size_t n) const noexcept {
+			if (n >= this->len) {
+				return this->cend();
 			} else {
-				this->len++;
-				HashTable::inner_insert(this->items, this->capacity, std::move(item), this->hashf);
+				return this->iterator_at(n);
 			}
 		}
-	}
-	// Copy constructor
-	HashTable(const HashTable& other) {
-		if (other.capacity == 0) {
-			this->capacity = this->len = 0;
-			this->items = nullptr;
-			return;
-		}
-		this->capacity = other.capacity;
-		this->len = other.len;
-		this->items = std::make_unique<HtItem[]>(other.capacity);
-		this->hashf = Hash{other.hashf};
-		this->cmp = KeyEqual{other.cmp};
-		for (size_t i = 0; i < other.capacity; i++) {
-			if (other.items[i]) {
-				this->items[i].emplace((*other.items[i]).first, (*other.items[i]).second);
-			}
-		}
-	}
-	// Move constructor
-	HashTable(HashTable&& other) noexcept(HashEqualNothrowMove::value) {
-		this->capacity = other.capacity;
-		this->len = other.len;
-		this->items = std::move(other.items);
-		this->hashf = std::move(other.hashf);
-		this->cmp = std::move(other.cmp);
-		other.capacity = other.len = 0;
-		other.items = nullptr;
-	}
-	~HashTable() noexcept(ItemNothrowDestructible::value && HashEqualNothrowDestructible::value) = default;
-
-	// Copy assignment
-	HashTable& operator=(const HashTable& other) {
-		if (this == &other) {
-			return *this;
+		const_local_iterator cend(size_t n) const noexcept {
+			return this->cbegin(n);
 		}
-		std::unique_ptr<HtItem[]> new_items(new HtItem[other.capacity]);
-		for (size_t i = 0; i < other.capacity; i++) {
-			if (other.items[i]) {
-				new_items[i].emplace((*other.items[i]).first, (*other.items[i]).second);
+
+		size_t bucket_count() const noexcept {
+			return this->capacity;
+		}
+		size_t max_bucket_count() const noexcept {
+			return (size_t) -1;
+		}
+		// The home slot of `key`, where its probe starts.
+		size_t bucket(const Key& key) const noexcept(HashNothrow::value) {
+			return this->capacity == 0 ? 0 : TableCore::home(TableCore::mix(key, this->hashf), this->capacity);
+		}
+		// How many entries have slot `n` as their home. They're all in the
+		// run of full slots from `n`, which this walks, hashing every entry in
+		// it unless hashes are cached.
+		size_t bucket_size(size_t n) const noexcept(HashNothrow::value) {
+			if (n >= this->capacity) {
+				return 0;
+			}
+			Slots slots = this->view();
+			auto home_of = this->home_of(slots);
+			size_t count = 0;
+			for (size_t i = n, seen = 0; seen < slots.cap && slots.full(i); i = ht_detail::probe_next(i, 1, slots.cap), seen++) {
+				count += home_of(i) == n;
 			}
+			return count;
+		}
+		// Walks every slot to measure how entries are spread, which hashes
+		// every entry unless hashes are cached.
+		ClusterStats cluster_stats() const noexcept(HashNothrow::value) {
+			ClusterStats out;
+			Slots slots = this->view();
+			if (this->len == 0) {
+				return out;
+			}
+			auto home_of = this->home_of(slots);
+			// start just past an empty slot, so no cluster wraps around
+			size_t start = ht_detail::probe_next(slots.find_empty(0), 1, slots.cap);
+			size_t run = 0;
+			for (size_t n = 0, i = start; n < slots.cap; n++, i = ht_detail::probe_next(i, 1, slots.cap)) {
+				if (slots.full(i)) {
+					size_t displacement = ht_detail::probe_distance(home_of(i), i, slots.cap);
+					out.max_displacement = std::max(out.max_displacement, displacement);
+					out.total_displacement += displacement;
+					run++;
+				} else if (run != 0) {
+					out.clusters++;
+					out.longest_cluster = std::max(out.longest_cluster, run);
+					run = 0;
+				}
+			}
+			out.entries = this->len;
+			return out;
 		}
-		this->capacity = other.capacity;
-		this->len = other.len;
-		this->items = std::move(new_items);
-		this->hashf = Hash{other.hashf};
-		this->cmp = KeyEqual{other.cmp};
-		return *this;
-	}
-	// Move assignment
-	HashTable& operator=(HashTable&& other) noexcept(ItemNothrowDestructible::value && HashEqualNothrowMove::value && HashEqualNothrowDestructible::value) {
-		if (this == &other) {
-			return *this;
+#if defined(HT_STATS)
+		ProbeStats stats() const noexcept {
+			return this->counters.snapshot();
+		}
+		void reset_stats() noexcept {
+			this->counters.reset();
 		}
-		this->capacity = other.capacity;
-		this->len = other.len;
-		this->items = std::move(other.items);
-		this->hashf = std::move(other.hashf);
-		this->cmp = std::move(other.cmp);
-		other.capacity = other.len = 0;
-		other.items = nullptr;
-		return *this;
-	}
-	// assign from initializer list
-	HashTable& operator=(std::initializer_list<value_type> ilist) {
-		// to keep it below the 75% threshold
-		if (ilist.size() + (ilist.size() >> 1) > this->capacity) {
-			// capacity must always be a power of 2
-#if __cplusplus >= 202002L
-			size_t new_cap = std::bit_ceil(ilist.size() + (ilist.size() >> 1));
-#else
-			size_t new_cap = HashTable::bit_ceil(ilist.size() + (ilist.size() >> 1));
 #endif
-			this->reserve_exact(this->capacity, new_cap);
-		}
-		this->len = 0;
-		this->items = std::make_unique<HtItem[]>(this->capacity);
-		for (auto item : std::move(ilist)) {
-			auto [contains, index] = this->index_of(item.first);
-			if (contains && this->cmp((*this->items[index]).first, item.first)) {
-				this->items[index].emplace(std::move(item));
-			} else if (!this->items[index].has_value()) {
-				this->len++;
-				this->items[index].emplace(std::move(item));
-			} else {
-				this->len++;
-				HashTable::inner_insert(this->items, this->capacity, std::move(item), this->hashf);
+		float load_factor() const noexcept {
+			return this->capacity == 0 ? 0.0f : (float) this->len / (float) this->capacity;
+		}
+		float max_load_factor() const noexcept {
+			return this->load_limit;
+		}
+		// Sets how full the table may get before growing; growth checks,
+		// `reserve`, `rehash` and `shrink_to_fit` all size by it. It's clamped to
+		// `[MIN_MAX_LOAD, 1]`, though a slot is always kept empty. Lowering it
+		// below the current load factor grows the table right away.
+		void max_load_factor(float ml) {
+			if (!(ml >= TableCore::MIN_MAX_LOAD)) {
+				ml = TableCore::MIN_MAX_LOAD;
+			} else if (ml > 1.0f) {
+				ml = 1.0f;
+			}
+			this->load_limit = ml;
+			this->grow_at = TableCore::limit_for(this->capacity, ml);
+			if (this->len > this->grow_at) {
+				this->reserve_exact(this->capacity, TableCore::capacity_for(this->len, ml));
 			}
 		}
-		return *this;
+		// How much capacity is multiplied by when the table grows, 2 by
+		// default. Capacities needn't be powers of 2, so something like 1.5
+		// trades more frequent resizes for a smaller peak when growing very large
+		// tables. It's clamped to at least `MIN_GROWTH`.
+		float growth_factor() const noexcept {
+			return this->growth;
+		}
+		void growth_factor(float factor) noexcept {
+			this->growth = factor >= TableCore::MIN_GROWTH ? factor : TableCore::MIN_GROWTH;
+		}
+
+		Hash hash_function() const noexcept(std::is_nothrow_copy_constructible<Hash>::value) {
+			return this->hashf;
+		}
+		KeyEqual key_eq() const noexcept(std::is_nothrow_copy_constructible<KeyEqual>::value) {
+			return this->cmp;
+		}
+	};
+}
+
+template<class Key, class T, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+class IncrementalHashTable;
+template<class Key, class T, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+class ConcurrentHashTable;
+template<class Key, class T, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+class HashTableSnapshot;
+template<class Key, class T, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash, class Clock>
+class EvictingHashTable;
+
+// Note that behavior is undefined if there are two keys `a` and `b` such that
+// `hash(a) != hash(b) && keyequal(a, b)`. (The inverse of `hash(a) == hash(b)
+// && !keyequal(a, b)` is well-defined, since the set of all key items may be
+// larger than the set of all `size_t` integers, so hash collisions are expected
+// and allowed.) Under these circumstances, an `insert` of one after the other
+// may or may not replace the other's contents, and a `find` or similar may
+// return either value.
+//
+// `Probe` is the probing policy, `LinearProbing` or `RobinHoodProbing`.
+// `Allocator` provides the slot array (rebound to the slot and byte types);
+// entries themselves are constructed in place and don't receive it.
+//
+// With `CacheHash`, every slot also keeps its entry's full (mixed) hash, at
+// the cost of a `size_t` per slot. Growing, shrinking and erasing then never
+// call `Hash`, and a probe only calls `KeyEqual` on entries whose whole hash
+// matches, which pays off for keys that are slow to hash or compare, such as
+// long strings.
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class KeyEqual = std::equal_to<Key>,
+	class Probe = LinearProbing,
+	class Allocator = std::allocator<std::pair<const Key, T>>,
+	bool CacheHash = false
+>
+class HashTable : public ht_detail::TableCore<ht_detail::MapEntries<Key, T>, Hash, KeyEqual, Probe, Allocator, CacheHash> {
+	template<class, class, class, class, class, class, bool>
+	friend class IncrementalHashTable;
+	template<class, class, class, class, class, class, bool>
+	friend class ConcurrentHashTable;
+	template<class, class, class, class, class, class, bool>
+	friend class HashTableSnapshot;
+	template<class, class, class, class, class, class, bool, class>
+	friend class EvictingHashTable;
+	using Core = ht_detail::TableCore<ht_detail::MapEntries<Key, T>, Hash, KeyEqual, Probe, Allocator, CacheHash>;
+public:
+	using mapped_type = T;
+	using typename Core::value_type;
+	using typename Core::iterator;
+	using typename Core::const_iterator;
+private:
+	using typename Core::HtItem;
+	using typename Core::HashNothrow;
+	using typename Core::IndexNothrow;
+	template<class K>
+	using LookupNothrow = typename Core::template LookupNothrow<K>;
+	template<class K>
+	using TransparentKey = typename Core::template TransparentKey<K>;
+	using typename Core::ItemNothrowMove;
+	using typename Core::ItemNothrowDestructible;
+
+	template<class K>
+	T& at_key(const K& key) const {
+		HtItem* item = this->find_item(key);
+		if (item == nullptr) {
+			throw std::out_of_range("Key doesn't exist");
+		}
+		return (**item).second;
+	}
+	// Looks `key` up without converting it, and only constructs a `Key`
+	// from it and a `T` from `args` if it has to be inserted.
+	template<class K, class... Args>
+	std::pair<iterator, bool> try_emplace_key(K&& key, Args&&... args) {
+		size_t mixed = HashTable::mix(key, this->hashf);
+		return this->try_emplace_mixed(std::forward<K>(key), mixed, std::forward<Args>(args)...);
+	}
+	// As `try_emplace_key`, for a `key` whose hash is already `mixed`.
+	template<class K, class... Args>
+	std::pair<iterator, bool> try_emplace_mixed(K&& key, size_t mixed, Args&&... args) {
+		if (this->capacity == 0) {
+			this->reserve_exact(0, this->initial_capacity());
+		}
+		auto [contains, index] = this->find_slot(key, mixed);
+		if (contains) {
+			return std::make_pair(this->iterator_at(index), false);
+		}
+		return this->emplace_unique_hint(
+			index,
+			mixed,
+			std::piecewise_construct,
+			std::forward_as_tuple(std::forward<K>(key)),
+			std::forward_as_tuple(std::forward<Args>(args)...)
+		);
+	}
+	template<class K, class M>
+	std::pair<iterator, bool> insert_or_assign_key(K&& key, M&& obj) {
+		size_t mixed = HashTable::mix(key, this->hashf);
+		return this->insert_or_assign_mixed(std::forward<K>(key), mixed, std::forward<M>(obj));
+	}
+	template<class K, class M>
+	std::pair<iterator, bool> insert_or_assign_mixed(K&& key, size_t mixed, M&& obj) {
+		auto out = this->try_emplace_mixed(std::forward<K>(key), mixed, std::forward<M>(obj));
+		if (!out.second) {
+			// `obj` was only used if the key was inserted
+			(*out.first).second = std::forward<M>(obj);
+		}
+		return out;
 	}
 
-	allocator_type get_allocator() const noexcept {
-		return allocator_type{};
+public:
+	using Core::Core;
+	HashTable& operator=(std::initializer_list<value_type> ilist) {
+		Core::operator=(ilist);
+		return *this;
 	}
 
 	bool operator==(const HashTable& other) const noexcept(IndexNothrow::value && std::is_nothrow_invocable_r<bool, decltype(std::declval<T>() == std::declval<T>()), const T&, const T&>::value) {
@@ -418,7 +2753,7 @@ public:
 			return false;
 		}
 		// test pointer equality before doing the more expensive test
-		if (this->items == other.items) {
+		if (this->slots.items == other.slots.items) {
 			return true;
 		}
 		for (const auto& [key, val] : *this) {
@@ -433,213 +2768,67 @@ public:
 		return !(*this == other);
 	}
 
-	bool contains(const Key& key) const noexcept(IndexNothrow::value) {
-		return this->capacity > 0 && this->index_of(key).first;
-	}
-	size_t count(const Key& key) const noexcept(IndexNothrow::value) {
-		return this->capacity > 0 && this->index_of(key).first ? 1 : 0;
-	}
-
-	// Because this specifies only a minimum capacity (without an upper
-	// bound), it never lowers capacity, assuming that if that many items
-	// were ever allocated, that many may be allocated again later. If
-	// lowering memory usage is desired, use `shrink_to_fit`.
-	void reserve(size_t min_capacity) {
-		size_t old_cap = this->capacity;
-		if (min_capacity <= old_cap) {
-			return;
-		}
-
-		// capacity must always be a power of 2
-#if __cplusplus >= 202002L
-		size_t new_cap = std::bit_ceil(min_capacity);
-#else
-		size_t new_cap = HashTable::bit_ceil(min_capacity);
-#endif
-		this->reserve_exact(old_cap, new_cap);
+	template<class M>
+	std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj) {
+		return this->insert_or_assign_key(key, std::forward<M>(obj));
 	}
-
-	void shrink_to_fit() {
-		if (this->len == 0) {
-			this->clear();
-			return;
-		}
-		size_t old_cap = this->capacity;
-		// capacity must always be a power of 2
-#if __cplusplus >= 202002L
-		size_t new_cap = std::bit_ceil(capacity);
-#else
-		size_t new_cap = HashTable::bit_ceil(capacity);
-#endif
-		if (new_cap >= old_cap) {
-			return;
-		}
-		this->reserve_exact(old_cap, new_cap);
+	template<class M>
+	std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj) {
+		return this->insert_or_assign_key(std::move(key), std::forward<M>(obj));
 	}
-
-	void rehash(size_t min_capacity) {
-		size_t old_cap = this->capacity;
-		if (min_capacity > old_cap) {
-			return this->reserve(min_capacity);
-		} else {
-			// to force a rehashing without changing capacity
-			this->reserve_exact(old_cap, old_cap);
-		}
+	template<class K, class M, class = TransparentKey<std::decay_t<K>>, class = std::enable_if_t<std::is_constructible_v<Key, K&&>>>
+	std::pair<iterator, bool> insert_or_assign(K&& key, M&& obj) {
+		return this->insert_or_assign_key(std::forward<K>(key), std::forward<M>(obj));
 	}
 
-	std::pair<iterator, bool> insert(const value_type& value) {
-		return this->emplace(value_type{value});
+	// Unlike `emplace`, the entry is only constructed (from `key` and
+	// `args`) if `key` isn't already in the table.
+	template<class... Args>
+	std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+		return this->try_emplace_key(key, std::forward<Args>(args)...);
 	}
-	std::pair<iterator, bool> insert(value_type&& value) {
-		return this->emplace(std::move(value));
+	template<class... Args>
+	std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+		return this->try_emplace_key(std::move(key), std::forward<Args>(args)...);
 	}
-	void insert(std::initializer_list<value_type> ilist) {
-		// 1.5x size due to the 75% capacity limit (to avoid potentially
-		// double-reserving).
-#if __cplusplus >= 202002L
-		size_t list_size_rounded = std::bit_ceil(ilist.size() + (ilist.size() >> 1));
-#else
-		size_t list_size_rounded = HashTable::bit_ceil(ilist.size() + (ilist.size() >> 1));
-#endif
-		if (this->capacity == 0) {
-			this->reserve_exact(0, std::max(HashTable::INITIAL_CAPACITY, list_size_rounded));
-		}
-		size_t cap = this->capacity;
-		// resize on 75% capacity
-		if ((this->len + ilist.size()) << 2 > (cap << 1) + cap) {
-			this->reserve_exact(cap, std::max(cap << 1, list_size_rounded));
-		}
-		for (auto item : std::move(ilist)) {
-			auto [contains, index] = this->index_of(item.first);
-			if (contains && this->cmp((*this->items[index]).first, item.first)) {
-				this->items[index].emplace(std::move(item));
-			} else if (!this->items[index].has_value()) {
-				this->len++;
-				this->items[index].emplace(std::move(item));
-			} else {
-				this->len++;
-				HashTable::inner_insert(this->items, cap, std::move(item), this->hashf);
-			}
-		}
+	template<class K, class... Args, class = TransparentKey<std::decay_t<K>>, class = std::enable_if_t<std::is_constructible_v<Key, K&&>>>
+	std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+		return this->try_emplace_key(std::forward<K>(key), std::forward<Args>(args)...);
 	}
-	std::pair<iterator, bool> insert_or_assign(const Key& key, const T& value) {
-		return this->emplace_or_assign(Key{key}, T{value});
+	template<class... Args>
+	iterator try_emplace(const_iterator, const Key& key, Args&&... args) {
+		return this->try_emplace_key(key, std::forward<Args>(args)...).first;
 	}
-	std::pair<iterator, bool> insert_or_assign(Key&& key, T&& value) {
-		return this->emplace_or_assign(std::move(key), std::move(value));
+	template<class... Args>
+	iterator try_emplace(const_iterator, Key&& key, Args&&... args) {
+		return this->try_emplace_key(std::move(key), std::forward<Args>(args)...).first;
 	}
 	std::pair<iterator, bool> insert_unique(const Key& key, const T& value) {
 		return this->insert_unique(Key{key}, T{value});
 	}
 	std::pair<iterator, bool> insert_unique(Key&& key, T&& value) {
 		if (this->capacity == 0) {
-			this->reserve_exact(0, HashTable::INITIAL_CAPACITY);
-		}
-		value_type pair(std::move(key), std::move(value));
-		size_t cap = this->capacity;
-		// resize on 75% capacity
-		if (this->len++ << 2 > (cap << 1) + cap) {
-			this->reserve_exact(cap, cap << 1);
-			return HashTable::inner_insert(this->items, cap << 1, std::move(pair), this->hashf);
-		} else {
-			return HashTable::inner_insert(this->items, cap, std::move(pair), this->hashf);
-		}
-	}
-
-	template<class... Args>
-	std::pair<iterator, bool> emplace(Args&&... args) {
-		value_type pair(std::forward<Args>(args)...);
-		if (this->capacity == 0) {
-			this->reserve_exact(0, HashTable::INITIAL_CAPACITY);
-			this->len++;
-			return HashTable::inner_insert(
-				this->items,
-				HashTable::INITIAL_CAPACITY,
-				std::move(pair),
-				this->hashf
-			);
-		}
-		auto [contains, cur_index] = this->index_of(pair.first);
-		if (contains) {
-			return std::make_pair(iterator(this->items.get() + cur_index), false);
-		}
-		return this->emplace_unique_hint(iterator(this->items.get() + cur_index), std::move(pair));
-	}
-
-	template<class... Args>
-	iterator emplace_hint(const_iterator hint, Args&&... args) {
-		value_type pair(std::forward<Args>(args)...);
-		if (hint != this->cend()) {
-			HtItem* item = hint.item;
-			bool had_value = item->has_value();
-			if (!had_value) {
-				this->len++;
-				item->emplace(std::move(pair));
-			}
-			return iterator(item);
-		}
-		// hint was bad, ignore it
-		return this->emplace(std::move(pair)).first;
-	}
-
-	template<class... Args>
-	std::pair<iterator, bool> emplace_or_assign(Args&&... args) {
-		value_type pair(std::forward<Args>(args)...);
-		if (this->capacity == 0) {
-			this->reserve_exact(0, HashTable::INITIAL_CAPACITY);
-			this->len++;
-			return HashTable::inner_insert(
-				this->items,
-				HashTable::INITIAL_CAPACITY,
-				std::move(pair),
-				this->hashf
-			);
+			this->reserve_exact(0, this->initial_capacity());
 		}
-		auto [contains, cur_index] = this->index_of(pair.first);
-		if (contains) {
-			this->items[cur_index].emplace(std::move(pair));
-			return std::make_pair(iterator(this->items.get() + cur_index), false);
+		typename Core::MutableValue pair(std::move(key), std::move(value));
+		size_t mixed = HashTable::mix(pair.first, this->hashf);
+		// resize once past the maximum load factor
+		if (this->len++ >= this->grow_at) {
+			this->reserve_exact(this->capacity, this->next_capacity());
 		}
-		return this->emplace_unique_hint(iterator(this->items.get() + cur_index), std::move(pair));
+		return this->inner_insert(this->view(), mixed, std::move(pair));
 	}
 
-	iterator find(const Key& key) noexcept(IndexNothrow::value) {
-		if (this->capacity == 0) {
-			return this->end();
-		}
-		auto [contains, index] = this->index_of(key);
-		if (contains) {
-			return iterator(this->items.get() + index);
-		} else {
-			return this->end();
-		}
-	}
-	const_iterator find(const Key& key) const noexcept(IndexNothrow::value) {
-		if (this->capacity == 0) {
-			return this->end();
-		}
-		auto [contains, index] = this->index_of(key);
-		if (contains) {
-			return const_iterator(this->items.get() + index);
-		} else {
-			return this->cend();
-		}
-	}
+	// Neither copies `key` nor constructs a `T` unless it has to insert.
 	T& find_or_insert(const Key& key) {
-		return this->find_or_insert(Key{key});
+		return (*this->try_emplace_key(key).first).second;
 	}
 	T& find_or_insert(Key&& key) {
-		if (this->capacity == 0) {
-			this->reserve_exact(0, HashTable::INITIAL_CAPACITY);
-		}
-		auto [contains, index] = this->index_of(key);
-		if (contains) {
-			return (*this->items[index]).second;
-		} else {
-			this->len++;
-			this->items[index].emplace(std::move(key), T{});
-			return (*this->items[index]).second;
-		}
+		return (*this->try_emplace_key(std::move(key)).first).second;
+	}
+	template<class K, class = TransparentKey<std::decay_t<K>>, class = std::enable_if_t<std::is_constructible_v<Key, K&&>>>
+	T& find_or_insert(K&& key) {
+		return (*this->try_emplace_key(std::forward<K>(key)).first).second;
 	}
 
 	T& operator[](const Key& key) {
@@ -650,199 +2839,66 @@ public:
 	}
 
 	T& at(const Key& key) {
-		if (this->capacity == 0) {
-			throw std::out_of_range("Key doesn't exist");
-		}
-		auto [contains, index] = this->index_of(key);
-		if (contains) {
-			return (*this->items[index]).second;
-		} else {
-			throw std::out_of_range("Key doesn't exist");
-		}
-	}
-	const T& at(const Key& key) const {
-		if (this->capacity == 0) {
-			throw std::out_of_range("Key doesn't exist");
-		}
-		auto [contains, index] = this->index_of(key);
-		if (contains) {
-			return (*this->items[index]).second;
-		} else {
-			throw std::out_of_range("Key doesn't exist");
-		}
-	}
-
-	std::pair<iterator, iterator> equal_range(const Key& key) {
-		if (this->capacity == 0) {
-			return std::make_pair(this->end(), this->end());
-		}
-		auto [contains, index] = this->index_of(key);
-		if (contains) {
-			iterator out(this->items.get() + index);
-			return std::make_pair(out, out);
-		} else {
-			return std::make_pair(this->end(), this->end());
-		}
-	}
-	std::pair<const_iterator, const_iterator> equal_range(const Key& key) const {
-		if (this->capacity == 0) {
-			return std::make_pair(this->end(), this->end());
-		}
-		auto [contains, index] = this->index_of(key);
-		if (contains) {
-			const_iterator out(this->items.get() + index);
-			return std::make_pair(out, out);
-		} else {
-			return std::make_pair(this->cend(), this->cend());
-		}
-	}
-
-	iterator erase(iterator pos) noexcept(ItemNothrowDestructible::value) {
-		pos.item->reset();
-		this->len--;
-		return ++pos;
-	}
-	// sort-of cheating, but it works
-	iterator erase(const_iterator pos) noexcept(ItemNothrowDestructible::value) {
-		((HtItem*) (pos.item))->reset();
-		this->len--;
-		return ++pos;
-	}
-	iterator erase(const_iterator first, const_iterator last) noexcept(ItemNothrowDestructible::value) {
-		while (first != last) {
-			((HtItem*) (first.item))->reset();
-			this->len--;
-			++first;
-		}
-		return iterator((HtItem*) last.item, last.end);
-	}
-	size_t erase(const Key& key) noexcept(IndexNothrow::value && ItemNothrowDestructible::value) {
-		if (this->capacity == 0) {
-			return 0;
-		}
-		auto [contains, index] = this->index_of(key);
-		if (contains) {
-			this->items[index].reset();
-			this->len--;
-			return 1;
-		} else {
-			return 0;
-		}
-	}
-
-	void clear() noexcept(ItemNothrowDestructible::value) {
-		this->capacity = this->len = 0;
-		this->items = nullptr;
+		return this->at_key(key);
 	}
-
-	void swap(HashTable<Key, T>& other) noexcept(HashEqualNothrowMove::value) {
-		auto items = std::move(this->items);
-		auto capacity = this->capacity;
-		auto len = this->len;
-		auto hashf = std::move(this->hashf);
-		auto cmp = std::move(this->cmp);
-
-		this->items = std::move(other.items);
-		this->capacity = other.capacity;
-		this->len = other.len;
-		this->hashf = std::move(other.hashf);
-		this->cmp = std::move(other.cmp);
-
-		other.items = std::move(items);
-		other.capacity = capacity;
-		other.len = len;
-		other.hashf = std::move(hashf);
-		other.cmp = std::move(cmp);
-	}
-
-	bool empty() const noexcept {
-		return this->len == 0;
-	}
-	size_t size() const noexcept {
-		return this->len;
-	}
-	size_t max_size() const noexcept {
-		return this->capacity;
-	}
-
-	iterator begin() noexcept {
-		return iterator(this->items.get(), this->items.get() + this->capacity);
-	}
-	iterator end() noexcept {
-		return iterator(this->items.get() + this->capacity);
-	}
-	const_iterator begin() const noexcept {
-		return const_iterator(this->items.get(), this->items.get() + this->capacity);
-	}
-	const_iterator end() const noexcept {
-		return const_iterator(this->items.get() + this->capacity);
-	}
-	const_iterator cbegin() const noexcept {
-		return const_iterator(this->items.get(), this->items.get() + this->capacity);
-	}
-	const_iterator cend() const noexcept {
-		return const_iterator(this->items.get() + this->capacity);
-	}
-
-	local_iterator begin(size_t n) noexcept {
-		if (n >= this->len) {
-			return this->end();
-		} else {
-			return iterator(this->items.get() + n);
-		}
-	}
-	local_iterator end(size_t n) noexcept {
-		return this->begin(n);
-	}
-	const_local_iterator begin(size_t n) const noexcept {
-		return this->cbegin(n);
-	}
-	const_local_iterator end(size_t n) const noexcept {
-		return this->cbegin(n);
+	template<class K, class = TransparentKey<K>>
+	T& at(const K& key) {
+		return this->at_key(key);
 	}
-	const_local_iterator cbegin(size_t n) const noexcept {
-		if (n >= this->len) {
-			return this->cend();
-		} else {
-			return const_iterator(this->items.get() + n);
-		}
+	const T& at(const Key& key) const {
+		return this->at_key(key);
 	}
-	const_local_iterator cend(size_t n) const noexcept {
-		return this->cbegin(n);
+	template<class K, class = TransparentKey<K>>
+	const T& at(const K& key) const {
+		return this->at_key(key);
 	}
 
-	size_t bucket_count() const noexcept {
-		return this->capacity;
-	}
-	size_t max_bucket_count() const noexcept {
-		return (size_t) -1;
-	}
-	float load_factor() const noexcept {
-		return (float) this->len / (float) this->capacity;
-	}
-	float max_load_factor() const noexcept {
-		return 1.0;
-	}
-	void max_load_factor(float ml) noexcept {
-		(void) ml;
-	}
+	using Core::erase;
 
-	Hash hash_function() const noexcept(std::is_nothrow_copy_constructible<Hash>::value) {
-		return this->hashf;
-	}
-	KeyEqual key_eq() const noexcept(std::is_nothrow_copy_constructible<KeyEqual>::value) {
-		return this->cmp;
+	using Core::merge;
+	// As `merge`, but for each key both tables have, calls `combine(value,
+	// std::move(other))` to fold `source`'s value into this table's, so
+	// `source` is always left empty.
+	template<class F>
+	void merge(HashTable& source, F combine) {
+		this->template merge_from<true>(source, [&](size_t index, value_type& other) {
+			combine((*this->slots.items[index]).second, std::move(other.second));
+		});
+	}
+	template<class F>
+	void merge(HashTable&& source, F combine) {
+		this->merge(source, std::move(combine));
+	}
+	iterator erase(iterator pos) noexcept(HashNothrow::value && ItemNothrowMove::value && ItemNothrowDestructible::value) {
+		return Core::erase(const_iterator(pos));
 	}
 };
 
+#if __has_include(<memory_resource>)
+namespace pmr {
+	// A `HashTable` whose slot array comes from a `std::pmr::memory_resource`,
+	// such as a `std::pmr::monotonic_buffer_resource` that frees every table
+	// built from it at once.
+	template<
+		class Key,
+		class T,
+		class Hash = std::hash<Key>,
+		class KeyEqual = std::equal_to<Key>,
+		class Probe = LinearProbing,
+		bool CacheHash = false
+	>
+	using HashTable = ::HashTable<Key, T, Hash, KeyEqual, Probe, std::pmr::polymorphic_allocator<std::pair<const Key, T>>, CacheHash>;
+}
+#endif
+
 namespace std {
-	template<class Key, class T>
-	void swap(HashTable<Key, T>& h1, HashTable<Key, T>& h2) noexcept(noexcept(h1.swap(h2))) {
+	template<class Key, class T, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+	void swap(HashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>& h1, HashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>& h2) noexcept(noexcept(h1.swap(h2))) {
 		h1.swap(h2);
 	}
 
-	template<class Key, class T, class Pred>
-	size_t erase_if(HashTable<Key, T>& c, Pred pred) {
+	template<class Key, class T, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash, class Pred>
+	size_t erase_if(HashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>& c, Pred pred) {
 		auto old_size = c.size();
 		for (auto i = c.begin(), last = c.end(); i != last;) {
 			if (pred(*i)) {
@@ -855,8 +2911,8 @@ namespace std {
 	}
 }
 
-template<class Key, class T>
-std::ostream& operator<<(std::ostream& os, const HashTable<Key, T>& table) {
+template<class Key, class T, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+std::ostream& operator<<(std::ostream& os, const HashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>& table) {
 	if (table.size() == 0) {
 		os << "HashTable {}";
 		return os;
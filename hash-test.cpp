@@ -1,9 +1,27 @@
 #include <catch2/catch_test_macros.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <iostream>
+#include <iterator>
+#include <memory_resource>
+#include <thread>
 
+#include "concurrent-hash-table.hpp"
+#include "evicting-hash-table.hpp"
+#include "frozen-hash-table.hpp"
+#include "hash-set.hpp"
+#include "hash-table-snapshot.hpp"
 #include "hash-table.hpp"
+#include "incremental-hash-table.hpp"
+#include "read-mostly-hash-table.hpp"
+#include "small-hash-table.hpp"
 
 TEST_CASE("new map is empty") {
 	REQUIRE(HashTable<std::string, int>().empty());
@@ -85,6 +103,52 @@ TEST_CASE("can iterate over key/value pairs") {
 	REQUIRE(pairs == 1000);
 }
 
+TEST_CASE("sparse tables iterate only their entries") {
+	HashTable<int, int> x;
+	x.reserve(100000);
+	for (int i = 0; i < 1000; i++) {
+		x[i] = i;
+	}
+	for (int i = 0; i < 1000; i += 3) {
+		x.erase(i);
+	}
+	auto expected = [](int i) { return i >= 0 && i < 1000 && i % 3 != 0; };
+	size_t pairs = 0;
+	for (const auto& [key, val] : x) {
+		REQUIRE(expected(key));
+		pairs++;
+	}
+	REQUIRE(pairs == x.size());
+
+	long sum = 0;
+	x.for_each([&](auto& entry) {
+		REQUIRE(expected(entry.first));
+		entry.second *= 2;
+		sum += entry.first;
+	});
+	REQUIRE(x.at(1) == 2);
+	REQUIRE(x.chunk_count() > 1);
+	long chunked = 0;
+	for (size_t chunk = 0; chunk < x.chunk_count(); chunk++) {
+		std::as_const(x).for_each_chunk(chunk, [&](const auto& entry) {
+			chunked += entry.first;
+		});
+	}
+	REQUIRE(chunked == sum);
+	std::atomic<long> parallel = 0;
+	x.for_each([&](const auto& entry) { parallel += entry.second; }, 4);
+	REQUIRE(parallel == 2 * sum);
+
+	HashSet<int> y;
+	y.reserve(50);
+	y.insert(7);
+	REQUIRE(*y.begin() == 7);
+	y.for_each([](const int& key) { REQUIRE(key == 7); });
+	HashTable<int, int> empty;
+	REQUIRE(empty.begin() == empty.end());
+	empty.for_each([](auto&) { FAIL(); }, 2);
+}
+
 TEST_CASE("copy constructor creates identical map") {
 	HashTable<std::string, int> x;
 	for (int i = 0; i < 1000; i++) {
@@ -220,3 +284,1154 @@ TEST_CASE("custom comparator function") {
 	REQUIRE(x.at("a") == 5);
 	REQUIRE(x.at("d") == 5);
 }
+
+TEST_CASE("colliding hashes are told apart by key") {
+	HashTable<std::string, int, hash_one<std::string>> x;
+	for (int i = 0; i < 100; i++) {
+		x.insert({std::to_string(i), i});
+	}
+	REQUIRE(x.size() == 100);
+	for (int i = 0; i < 100; i++) {
+		REQUIRE(x.at(std::to_string(i)) == i);
+	}
+	REQUIRE(!x.contains("100"));
+	REQUIRE(!x.contains("-1"));
+}
+
+struct avalanching_hash {
+	using is_avalanching = std::true_type;
+	size_t operator()(uint64_t key) const noexcept {
+		return key;
+	}
+};
+struct not_avalanching_hash {
+	using is_avalanching = std::false_type;
+	size_t operator()(uint64_t key) const noexcept {
+		return key;
+	}
+};
+
+TEST_CASE("avalanching hashes aren't mixed again") {
+	STATIC_REQUIRE(ht_detail::is_avalanching<BytesHash>::value);
+	STATIC_REQUIRE(ht_detail::is_avalanching<FingerprintHash>::value);
+	STATIC_REQUIRE(ht_detail::is_avalanching<avalanching_hash>::value);
+	STATIC_REQUIRE(!ht_detail::is_avalanching<not_avalanching_hash>::value);
+	STATIC_REQUIRE(!ht_detail::is_avalanching<std::hash<uint64_t>>::value);
+
+	// fingerprints already vary in their high bits, which pick the home slot
+	HashTable<uint64_t, int, FingerprintHash> x;
+	x.reserve(1000);
+	for (uint64_t i = 0; i < 1000; i++) {
+		x[ht_detail::frozen_mix(i)] = (int) i;
+	}
+	REQUIRE(x.bucket(ht_detail::frozen_mix(5)) == (size_t) (((unsigned __int128) ht_detail::frozen_mix(5) * x.bucket_count()) >> 64));
+	for (uint64_t i = 0; i < 1000; i++) {
+		REQUIRE(x.at(ht_detail::frozen_mix(i)) == (int) i);
+	}
+	REQUIRE(x.cluster_stats().longest_cluster < 100);
+}
+
+TEST_CASE("cluster stats show how well keys spread") {
+	HashTable<int, int, hash_one<int>> bad;
+	REQUIRE(bad.cluster_stats().entries == 0);
+	REQUIRE(bad.bucket_size(0) == 0);
+	for (int i = 0; i < 100; i++) {
+		bad[i] = i;
+	}
+	size_t home = bad.bucket(0);
+	REQUIRE(bad.bucket(99) == home);
+	REQUIRE(bad.bucket_size(home) == 100);
+	REQUIRE(bad.bucket_size(home + 1 == bad.bucket_count() ? 0 : home + 1) == 0);
+	REQUIRE(bad.bucket_size(bad.bucket_count()) == 0);
+	ClusterStats one = bad.cluster_stats();
+	REQUIRE(one.entries == 100);
+	REQUIRE(one.clusters == 1);
+	REQUIRE(one.longest_cluster == 100);
+	REQUIRE(one.max_displacement == 99);
+	REQUIRE(one.total_displacement == 99 * 100 / 2);
+
+	HashTable<int, int> good;
+	for (int i = 0; i < 1000; i++) {
+		good[i] = i;
+	}
+	size_t total = 0;
+	for (size_t n = 0; n < good.bucket_count(); n++) {
+		total += good.bucket_size(n);
+	}
+	REQUIRE(total == 1000);
+	ClusterStats spread = good.cluster_stats();
+	REQUIRE(spread.entries == 1000);
+	REQUIRE(spread.clusters > 100);
+	REQUIRE(spread.longest_cluster < 100);
+	REQUIRE(spread.mean_displacement() < one.mean_displacement());
+
+#if defined(HT_STATS)
+	good.reset_stats();
+	for (int i = 0; i < 2000; i++) {
+		good.contains(i);
+	}
+	ProbeStats stats = good.stats();
+	uint64_t hits = 0, misses = 0;
+	for (size_t b = 0; b < ProbeStats::BUCKETS; b++) {
+		hits += stats.hits[b];
+		misses += stats.misses[b];
+	}
+	REQUIRE(hits == 1000);
+	REQUIRE(misses == 1000);
+	REQUIRE(stats.resizes == 0);
+	REQUIRE(bad.stats().resizes > 0);
+	REQUIRE(bad.stats().longest_probe >= 99);
+	REQUIRE(ProbeStats::bucket(0) == 0);
+	REQUIRE(ProbeStats::bucket(5) == 3);
+	REQUIRE(ProbeStats::bucket((size_t) -1) == ProbeStats::BUCKETS - 1);
+	good.reset_stats();
+	REQUIRE(good.stats().hits[0] == 0);
+#endif
+}
+
+TEST_CASE("tables smaller than a probing group work") {
+	HashTable<int, int> x(1);
+	REQUIRE(x.bucket_count() == 1);
+	x.insert({1, 2});
+	REQUIRE(x.at(1) == 2);
+	REQUIRE(!x.contains(2));
+	for (int i = 2; i < 10; i++) {
+		x[i] = i * 2;
+	}
+	for (int i = 1; i < 10; i++) {
+		REQUIRE(x.at(i) == i * 2);
+	}
+	REQUIRE(!x.contains(10));
+}
+
+TEST_CASE("erasing keeps colliding keys reachable") {
+	HashTable<std::string, int, hash_one<std::string>> x;
+	for (int i = 0; i < 20; i++) {
+		x.insert({std::to_string(i), i});
+	}
+	for (int i = 0; i < 20; i += 2) {
+		REQUIRE(x.erase(std::to_string(i)) == 1);
+	}
+	REQUIRE(x.size() == 10);
+	for (int i = 0; i < 20; i++) {
+		REQUIRE(x.contains(std::to_string(i)) == (i % 2 == 1));
+	}
+}
+
+TEST_CASE("high churn erases in place") {
+	HashTable<int, int> x;
+	for (int i = 0; i < 1000; i++) {
+		x[i] = i;
+	}
+	size_t cap = x.bucket_count();
+	for (int round = 0; round < 20; round++) {
+		for (int i = 0; i < 1000; i++) {
+			REQUIRE(x.erase(round * 1000 + i) == 1);
+			x[(round + 1) * 1000 + i] = i;
+		}
+	}
+	REQUIRE(x.size() == 1000);
+	REQUIRE(x.bucket_count() == cap);
+	for (int i = 0; i < 1000; i++) {
+		REQUIRE(x.at(20000 + i) == i);
+	}
+	REQUIRE(std::erase_if(x, [](const auto& pair) { return pair.second % 3 == 0; }) == 334);
+	for (int i = 0; i < 1000; i++) {
+		REQUIRE(x.contains(20000 + i) == (i % 3 != 0));
+	}
+}
+
+TEST_CASE("max load factor drives growth") {
+	for (float ml : { 0.5f, 0.75f, 0.95f }) {
+		HashTable<int, int> x;
+		x.max_load_factor(ml);
+		REQUIRE(x.max_load_factor() == ml);
+		for (int i = 0; i < 5000; i++) {
+			x[i] = i;
+			REQUIRE(x.load_factor() <= ml);
+		}
+		for (int i = 0; i < 5000; i++) {
+			REQUIRE(x.at(i) == i);
+		}
+	}
+	HashTable<int, int> y;
+	y.max_load_factor(0.9f);
+	y.reserve(900);
+	size_t cap = y.bucket_count();
+	REQUIRE(cap >= 1000);
+	REQUIRE(cap < 1010);
+	for (int i = 0; i < 900; i++) {
+		y[i] = i;
+	}
+	REQUIRE(y.bucket_count() == cap);
+	y.max_load_factor(0.5f);
+	REQUIRE(y.bucket_count() >= 1800);
+	REQUIRE(y.at(899) == 899);
+	y.shrink_to_fit();
+	REQUIRE(y.bucket_count() == 1800);
+}
+
+TEST_CASE("growth factor sets how much tables grow") {
+	HashTable<int, int> x;
+	x.growth_factor(1.5f);
+	REQUIRE(x.growth_factor() == 1.5f);
+	size_t last = 0;
+	for (int i = 0; i < 10000; i++) {
+		x[i] = i;
+		size_t cap = x.bucket_count();
+		if (cap != last && last != 0) {
+			REQUIRE(cap <= last + last / 2 + 1);
+		}
+		last = cap;
+	}
+	for (int i = 0; i < 10000; i++) {
+		REQUIRE(x.at(i) == i);
+	}
+}
+
+TEST_CASE("robin hood probing keeps every key reachable") {
+	using RobinHood = HashTable<std::string, int, hash_one<std::string>, std::equal_to<std::string>, RobinHoodProbing>;
+	RobinHood x;
+	// enough collisions to run past what a stored probe distance can hold
+	for (int i = 0; i < 400; i++) {
+		x.insert({std::to_string(i), i});
+	}
+	REQUIRE(x.size() == 400);
+	for (int i = 0; i < 400; i++) {
+		REQUIRE(x.at(std::to_string(i)) == i);
+	}
+	REQUIRE(!x.contains("400"));
+	for (int i = 0; i < 400; i += 2) {
+		REQUIRE(x.erase(std::to_string(i)) == 1);
+	}
+	for (int i = 0; i < 400; i++) {
+		REQUIRE(x.contains(std::to_string(i)) == (i % 2 == 1));
+	}
+	RobinHood y = x;
+	REQUIRE(x == y);
+
+	HashTable<int, int, std::hash<int>, std::equal_to<int>, RobinHoodProbing> z;
+	for (int round = 0; round < 10; round++) {
+		for (int i = 0; i < 1000; i++) {
+			z[round * 1000 + i] = i;
+		}
+		for (int i = 0; i < 1000; i += 3) {
+			REQUIRE(z.erase(round * 1000 + i) == 1);
+		}
+	}
+	REQUIRE(z.size() == 6660);
+	for (int i = 0; i < 10000; i++) {
+		REQUIRE(z.contains(i) == (i % 1000 % 3 != 0));
+	}
+}
+
+TEST_CASE("slots come from the table's allocator") {
+	char buffer[1 << 16];
+	std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+	pmr::HashTable<int, int> x(&arena);
+	REQUIRE(x.get_allocator().resource() == &arena);
+	for (int i = 0; i < 1000; i++) {
+		x[i] = i * 2;
+	}
+	for (int i = 0; i < 1000; i++) {
+		REQUIRE(x.at(i) == i * 2);
+	}
+
+	pmr::HashTable<int, int> y(x);
+	REQUIRE(y.get_allocator().resource() == std::pmr::get_default_resource());
+	REQUIRE(x == y);
+
+	std::pmr::unsynchronized_pool_resource pool;
+	pmr::HashTable<int, int> z(std::move(x), &pool);
+	REQUIRE(z.get_allocator().resource() == &pool);
+	REQUIRE(x.size() == 0);
+	REQUIRE(z == y);
+	z = y;
+	REQUIRE(z.get_allocator().resource() == &pool);
+	REQUIRE(z == y);
+}
+
+TEST_CASE("incremental tables resize a few slots at a time") {
+	IncrementalHashTable<int, int> x;
+	x.migrate_step(8);
+	bool resized = false;
+	for (int i = 0; i < 20000; i++) {
+		x[i] = i * 2;
+		if (x.resizing()) {
+			resized = true;
+			REQUIRE(x.at(i / 2) == i / 2 * 2);
+		}
+	}
+	REQUIRE(resized);
+	REQUIRE(x.size() == 20000);
+	for (int i = 0; i < 20000; i += 2) {
+		REQUIRE(x.erase(i) == 1);
+	}
+	REQUIRE(x.size() == 10000);
+	size_t seen = 0;
+	for (const auto& [key, val] : x) {
+		REQUIRE(key % 2 == 1);
+		REQUIRE(val == key * 2);
+		seen++;
+	}
+	REQUIRE(seen == 10000);
+	x.finish_resize();
+	REQUIRE(!x.resizing());
+	for (int i = 0; i < 20000; i++) {
+		REQUIRE(x.contains(i) == (i % 2 == 1));
+	}
+	REQUIRE(!x.emplace(1, 5).second);
+	REQUIRE(x.at(1) == 2);
+}
+
+// counts how often it hashes something other than a `std::string`
+struct transparent_hash {
+	using is_transparent = void;
+	static inline int views = 0;
+	size_t operator()(std::string_view val) const {
+		views++;
+		return std::hash<std::string_view>{}(val);
+	}
+	size_t operator()(const std::string& val) const {
+		return std::hash<std::string_view>{}(val);
+	}
+};
+TEST_CASE("transparent lookups don't construct keys") {
+	HashTable<std::string, int, transparent_hash, std::equal_to<>> x;
+	x["alpha"] = 1;
+	x["beta"] = 2;
+	transparent_hash::views = 0;
+	std::string_view alpha = "alpha";
+	REQUIRE(x.contains(alpha));
+	REQUIRE(x.count(std::string_view("gamma")) == 0);
+	REQUIRE(x.at(alpha) == 1);
+	REQUIRE((*x.find(std::string_view("beta"))).second == 2);
+	REQUIRE(x.find(std::string_view("gamma")) == x.end());
+	REQUIRE(x.equal_range(alpha).first == x.find(alpha));
+	REQUIRE_THROWS_AS(x.at(std::string_view("gamma")), std::out_of_range);
+	x.find_or_insert(std::string_view("gamma")) = 3;
+	REQUIRE(x.at(std::string("gamma")) == 3);
+	REQUIRE(x.erase(alpha) == 1);
+	REQUIRE(x.erase(alpha) == 0);
+	REQUIRE(transparent_hash::views == 11);
+	REQUIRE(x.size() == 2);
+}
+
+struct counted_key {
+	static inline int copies = 0;
+	int val;
+	counted_key(int val) : val(val) { }
+	counted_key(const counted_key& other) : val(other.val) {
+		copies++;
+	}
+	counted_key(counted_key&& other) noexcept = default;
+	bool operator==(const counted_key& other) const {
+		return this->val == other.val;
+	}
+};
+struct counted_hash {
+	size_t operator()(const counted_key& key) const {
+		return std::hash<int>{}(key.val);
+	}
+};
+TEST_CASE("hits don't copy keys or build values") {
+	HashTable<counted_key, std::string, counted_hash> x;
+	counted_key one(1);
+	REQUIRE(x.try_emplace(one, 3, 'a').second);
+	REQUIRE(x.at(one) == "aaa");
+	counted_key::copies = 0;
+	for (int i = 0; i < 100; i++) {
+		x[one] += "b";
+		REQUIRE(!x.try_emplace(one, 5, 'c').second);
+		x.insert_or_assign(one, x.at(one) + "d");
+	}
+	REQUIRE(counted_key::copies == 0);
+	REQUIRE(x.at(one).size() == 203);
+	REQUIRE(x.try_emplace(counted_key(2)).second);
+	REQUIRE(x.at(2).empty());
+	// inserting can grow the table while an argument refers into it
+	for (int i = 3; i < 1000; i++) {
+		x.try_emplace(counted_key(i), x.at(one));
+	}
+	REQUIRE(x.at(999) == x.at(one));
+}
+
+struct counting_hash {
+	static inline int calls = 0;
+	size_t operator()(const std::string& val) const {
+		calls++;
+		return std::hash<std::string>{}(val);
+	}
+};
+TEST_CASE("moving entries between slots doesn't copy keys") {
+	HashTable<counted_key, int, counted_hash> x;
+	HashTable<counted_key, int, counted_hash, std::equal_to<counted_key>, RobinHoodProbing> y;
+	counted_key::copies = 0;
+	for (int i = 0; i < 1000; i++) {
+		x.emplace(counted_key(i), i);
+		y.try_emplace(counted_key(i), i);
+	}
+	for (int i = 0; i < 1000; i += 2) {
+		x.erase(counted_key(i));
+		y.erase(counted_key(i));
+	}
+	x.rehash(4096);
+	y.shrink_to_fit();
+	REQUIRE(counted_key::copies == 0);
+	REQUIRE(x.size() == 500);
+	REQUIRE(y.at(counted_key(999)) == 999);
+}
+
+TEST_CASE("cached hashes aren't recomputed") {
+	using Cached = HashTable<std::string, int, counting_hash, std::equal_to<std::string>, LinearProbing, std::allocator<std::pair<const std::string, int>>, true>;
+	Cached x;
+	counting_hash::calls = 0;
+	for (int i = 0; i < 1000; i++) {
+		x[std::to_string(i)] = i;
+	}
+	// one call per insert, however many times the table grew
+	REQUIRE(counting_hash::calls == 1000);
+	for (int i = 0; i < 1000; i += 2) {
+		REQUIRE(x.erase(std::to_string(i)) == 1);
+	}
+	x.shrink_to_fit();
+	REQUIRE(counting_hash::calls == 1500);
+	for (int i = 0; i < 1000; i++) {
+		REQUIRE(x.contains(std::to_string(i)) == (i % 2 == 1));
+	}
+	Cached y = x;
+	REQUIRE(y == x);
+
+	HashTable<std::string, int, hash_one<std::string>, std::equal_to<std::string>, RobinHoodProbing, std::allocator<std::pair<const std::string, int>>, true> z;
+	for (int i = 0; i < 300; i++) {
+		z[std::to_string(i)] = i;
+	}
+	for (int i = 0; i < 300; i++) {
+		REQUIRE(z.at(std::to_string(i)) == i);
+	}
+}
+
+TEST_CASE("bytes hash works for short and long strings") {
+	HashTable<std::string, size_t, BytesHash, std::equal_to<>> x;
+	std::vector<std::string> keys;
+	for (size_t len = 0; len < 2 * HT_HASH_LONG; len += 7) {
+		keys.push_back(std::string(len, 'k') + std::to_string(len));
+	}
+	for (size_t i = 0; i < keys.size(); i++) {
+		x[keys[i]] = i;
+	}
+	for (size_t i = 0; i < keys.size(); i++) {
+		REQUIRE(x.at(std::string_view(keys[i])) == i);
+	}
+	REQUIRE(x.size() == keys.size());
+	REQUIRE(!x.contains("missing"));
+	// the last byte of a long key changes its hash
+	std::string a(HT_HASH_LONG + 64, 'x'), b = a;
+	b.back() = 'y';
+	REQUIRE(BytesHash{}(a) != BytesHash{}(b));
+	REQUIRE(BytesHash{}(a) == BytesHash{}(std::string_view(a)));
+}
+
+TEST_CASE("batched lookups match single ones") {
+	HashTable<int, int> x;
+	std::vector<int> keys;
+	for (int i = 0; i < 1000; i++) {
+		x[i * 2] = i;
+		// every other key is missing
+		keys.push_back(i);
+	}
+	std::vector<HashTable<int, int>::iterator> found;
+	x.find_batch(keys.begin(), keys.end(), std::back_inserter(found));
+	REQUIRE(found.size() == keys.size());
+	for (size_t i = 0; i < keys.size(); i++) {
+		REQUIRE(found[i] == x.find(keys[i]));
+	}
+	std::vector<bool> present;
+	std::as_const(x).contains_batch(keys.begin(), keys.end(), std::back_inserter(present));
+	for (size_t i = 0; i < keys.size(); i++) {
+		REQUIRE(present[i] == (keys[i] % 2 == 0));
+	}
+
+	HashTable<int, int> empty;
+	std::vector<HashTable<int, int>::const_iterator> none;
+	std::as_const(empty).find_batch(keys.begin(), keys.begin() + 3, std::back_inserter(none));
+	REQUIRE(none == std::vector<HashTable<int, int>::const_iterator>(3, empty.cend()));
+
+	HashTable<std::string, int, BytesHash, std::equal_to<>> y = { { "a", 1 }, { "b", 2 } };
+	std::string_view views[] = { "b", "c", "a" };
+	bool hits[3];
+	y.contains_batch(std::begin(views), std::end(views), hits);
+	REQUIRE((hits[0] && !hits[1] && hits[2]));
+}
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+TEST_CASE("interleaved lookups match single ones") {
+	HashTable<int, int> x;
+	std::vector<int> keys;
+	for (int i = 0; i < 5000; i++) {
+		x[i * 2] = i;
+		keys.push_back(i);
+	}
+	// fewer, as many, and more keys than are in flight at once
+	for (size_t in_flight : { 1, 7, 16, 64, 1000 }) {
+		std::vector<HashTable<int, int>::iterator> found;
+		x.find_interleaved(keys.begin(), keys.end(), std::back_inserter(found), in_flight);
+		REQUIRE(found.size() == keys.size());
+		for (size_t i = 0; i < keys.size(); i++) {
+			REQUIRE(found[i] == x.find(keys[i]));
+		}
+	}
+	std::vector<bool> present;
+	x.contains_interleaved(keys.begin(), keys.begin() + 3, std::back_inserter(present));
+	REQUIRE(present == std::vector<bool>({ true, false, true }));
+
+	HashTable<int, int> empty;
+	std::vector<HashTable<int, int>::const_iterator> none;
+	std::as_const(empty).find_interleaved(keys.begin(), keys.begin() + 3, std::back_inserter(none));
+	REQUIRE(none == std::vector<HashTable<int, int>::const_iterator>(3, empty.cend()));
+
+	// with cached hashes, and colliding keys that need probing past a group
+	HashTable<std::string, int, hash_one<std::string>, std::equal_to<std::string>, LinearProbing, std::allocator<std::pair<const std::string, int>>, true> y;
+	std::vector<std::string> names;
+	for (int i = 0; i < 100; i++) {
+		y[std::to_string(i)] = i;
+		names.push_back(std::to_string(i * 3));
+	}
+	std::vector<bool> hits;
+	y.contains_interleaved(names.begin(), names.end(), std::back_inserter(hits));
+	for (int i = 0; i < 100; i++) {
+		REQUIRE(hits[i] == (i * 3 < 100));
+	}
+
+	HashSet<std::string, BytesHash, std::equal_to<>> z = { "a", "b" };
+	std::string_view views[] = { "b", "c", "a" };
+	bool in_set[3];
+	z.contains_interleaved(std::begin(views), std::end(views), in_set);
+	REQUIRE((in_set[0] && !in_set[1] && in_set[2]));
+}
+#endif
+
+TEST_CASE("parallel inserts match serial ones") {
+	// plenty of duplicates, the first of which has to win
+	std::vector<std::pair<int, int>> entries;
+	for (int i = 0; i < 60000; i++) {
+		entries.emplace_back(i * 7 % 40000, i);
+	}
+	auto check = [&](const auto& x) {
+		REQUIRE(x.size() == 40000);
+		for (int i = 0; i < 40000; i++) {
+			REQUIRE(x.at(i * 7 % 40000) == i);
+		}
+	};
+
+	HashTable<int, int> x;
+	x.insert_parallel(entries.begin(), entries.end(), 4);
+	check(x);
+	HashTable<int, int, std::hash<int>, std::equal_to<int>, RobinHoodProbing> y;
+	// keys already in the table are kept
+	y[0] = -1;
+	y.insert_parallel(entries.begin(), entries.end(), 4);
+	REQUIRE(y.at(0) == -1);
+	y[0] = 0;
+	check(y);
+	HashTable<int, int, std::hash<int>, std::equal_to<int>, LinearProbing, std::allocator<std::pair<const int, int>>, true> z;
+	z.insert_parallel(entries.begin(), entries.end(), 3);
+	check(z);
+
+	// rehashing in parallel keeps every entry
+	x.reserve(200000, 4);
+	y.reserve(200000, 4);
+	REQUIRE(x.bucket_count() >= 200000);
+	check(x);
+	check(y);
+
+	std::vector<std::pair<std::string, std::string>> strings = { { "a", "1" }, { "b", "2" }, { "a", "3" } };
+	HashTable<std::string, std::string> w;
+	w.insert_parallel(std::make_move_iterator(strings.begin()), std::make_move_iterator(strings.end()));
+	REQUIRE(w.size() == 2);
+	REQUIRE(w.at("a") == "1");
+	REQUIRE(strings[1].first.empty());
+}
+
+TEST_CASE("tables merge without rehashing each entry") {
+	std::vector<std::pair<int, int>> entries;
+	for (int i = 0; i < 1000; i++) {
+		entries.emplace_back(i % 600, i);
+	}
+	HashTable<int, int> x;
+	x.insert(entries.begin(), entries.end());
+	REQUIRE(x.size() == 600);
+	REQUIRE(x.at(5) == 5);
+	// the first of each key is kept
+	REQUIRE(x.at(599) == 599);
+	x.insert(entries.begin() + 600, entries.end());
+	REQUIRE(x.at(5) == 5);
+	REQUIRE(x.size() == 600);
+
+	HashTable<int, int> y;
+	for (int i = 500; i < 1500; i++) {
+		y[i] = -i;
+	}
+	x.merge(y);
+	REQUIRE(x.size() == 1500);
+	// values for keys both had stay where they were
+	REQUIRE(y.size() == 100);
+	for (int i = 500; i < 600; i++) {
+		REQUIRE(x.at(i) == i);
+		REQUIRE(y.at(i) == -i);
+	}
+	REQUIRE(x.at(1499) == -1499);
+	x.merge(y, [](int& value, int&& other) { value += other; });
+	REQUIRE(y.empty());
+	REQUIRE(x.at(550) == 0);
+	x.merge(HashTable<int, int>({ { 2000, 1 } }));
+	REQUIRE(x.at(2000) == 1);
+
+	using Cached = HashTable<std::string, int, counting_hash, std::equal_to<std::string>, LinearProbing, std::allocator<std::pair<const std::string, int>>, true>;
+	Cached a, b;
+	for (int i = 0; i < 300; i++) {
+		a[std::to_string(i)] = i;
+		b[std::to_string(i + 200)] = i;
+	}
+	counting_hash::calls = 0;
+	a.merge(b);
+	// the cached hashes are reused, even as `b` shifts its duplicates back
+	REQUIRE(counting_hash::calls == 0);
+	REQUIRE(a.size() == 500);
+	REQUIRE(b.size() == 100);
+	for (int i = 0; i < 500; i++) {
+		REQUIRE(a.contains(std::to_string(i)));
+	}
+
+	HashSet<std::string> s = { "a", "b" };
+	HashSet<std::string> t = { "b", "c" };
+	s.merge(t);
+	REQUIRE(s == HashSet<std::string>({ "a", "b", "c" }));
+	REQUIRE(t == HashSet<std::string>({ "b" }));
+}
+
+TEST_CASE("extracted nodes move between tables") {
+	HashTable<std::string, std::string> x = { { "a", "1" }, { "b", "2" } };
+	auto node = x.extract("a");
+	REQUIRE(node);
+	REQUIRE(x.size() == 1);
+	REQUIRE(node.key() == "a");
+	REQUIRE(node.mapped() == "1");
+	REQUIRE(x.extract("z").empty());
+
+	HashTable<std::string, std::string> y;
+	auto out = y.insert(std::move(node));
+	REQUIRE(out.inserted);
+	REQUIRE(out.node.empty());
+	REQUIRE((*out.position).second == "1");
+	REQUIRE(y.at("a") == "1");
+
+	// changing the key is why there are nodes
+	node = y.extract(y.find("a"));
+	node.key() = "b";
+	out = x.insert(std::move(node));
+	REQUIRE(!out.inserted);
+	REQUIRE(out.node.mapped() == "1");
+	REQUIRE((*out.position).second == "2");
+	out.node.key() = "c";
+	x.insert(x.cend(), std::move(out.node));
+	REQUIRE(x.at("c") == "1");
+	REQUIRE(y.empty());
+
+	HashSet<int> s = { 1, 2, 3 };
+	auto key = s.extract(2);
+	key.value() = 4;
+	REQUIRE(s.insert(std::move(key)).inserted);
+	REQUIRE(s == HashSet<int>({ 1, 3, 4 }));
+
+	// a table with another hasher can't reuse the node's hash
+	HashTable<std::string, int> from;
+	HashTable<std::string, int, BytesHash, std::equal_to<>> to;
+	for (int i = 0; i < 100; i++) {
+		from.emplace("key" + std::to_string(i), i);
+	}
+	for (int i = 0; i < 100; i++) {
+		REQUIRE(to.insert(from.extract("key" + std::to_string(i))).inserted);
+	}
+	REQUIRE(from.empty());
+	REQUIRE(to.size() == 100);
+	for (int i = 0; i < 100; i++) {
+		REQUIRE(to.at("key" + std::to_string(i)) == i);
+	}
+}
+
+TEST_CASE("hash sets hold bare keys") {
+	HashSet<uint64_t> x = { 3, 1, 4, 1, 5 };
+	REQUIRE(x.size() == 4);
+	REQUIRE(x.insert(9).second);
+	REQUIRE(!x.insert(3).second);
+	REQUIRE(*x.find(4) == 4);
+	REQUIRE(x.find(2) == x.end());
+	REQUIRE(x.erase(1) == 1);
+	REQUIRE(!x.contains(1));
+	uint64_t sum = 0;
+	for (uint64_t key : x) {
+		sum += key;
+	}
+	REQUIRE(sum == 3 + 4 + 5 + 9);
+	REQUIRE(x == HashSet<uint64_t>({ 9, 5, 4, 3 }));
+	REQUIRE(x != HashSet<uint64_t>({ 9, 5, 4 }));
+
+	std::vector<uint64_t> ids;
+	for (uint64_t i = 0; i < 20000; i++) {
+		ids.push_back(i * 3 % 10000);
+	}
+	HashSet<uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, RobinHoodProbing> y;
+	y.insert_parallel(ids.begin(), ids.end(), 2);
+	REQUIRE(y.size() == 10000);
+	REQUIRE(std::erase_if(y, [](uint64_t key) { return key % 2 == 0; }) == 5000);
+	for (uint64_t i = 0; i < 10000; i++) {
+		REQUIRE(y.contains(i) == (i % 2 == 1));
+	}
+
+	HashSet<std::string, BytesHash, std::equal_to<>> z = { "a", "b" };
+	REQUIRE(z.contains(std::string_view("a")));
+	REQUIRE(z.erase("b") == 1);
+	REQUIRE(z.size() == 1);
+}
+
+TEST_CASE("snapshots are searched in place") {
+	HashTable<uint64_t, uint32_t> x;
+	for (uint64_t i = 0; i < 5000; i++) {
+		x.emplace(i * 7, (uint32_t) i);
+	}
+	x.erase(70);
+	{
+		std::ofstream out("hash-test.snapshot", std::ios::binary);
+		HashTableSnapshot<uint64_t, uint32_t>::write(x, out);
+		REQUIRE(out.good());
+	}
+	auto snapshot = HashTableSnapshot<uint64_t, uint32_t>::open("hash-test.snapshot");
+	std::remove("hash-test.snapshot");
+	REQUIRE(snapshot.size() == x.size());
+	for (uint64_t i = 0; i < 5000; i++) {
+		REQUIRE(snapshot.contains(i * 7) == (i != 10));
+		REQUIRE(!snapshot.contains(i * 7 + 1));
+	}
+	REQUIRE(snapshot.at(49) == 7);
+	REQUIRE_THROWS_AS(snapshot.at(70), std::out_of_range);
+	REQUIRE(snapshot.load() == x);
+
+	// probe distances and cached hashes are saved along with the slots
+	using Cached = HashTableSnapshot<uint64_t, uint32_t, std::hash<uint64_t>, std::equal_to<uint64_t>, RobinHoodProbing, std::allocator<std::pair<const uint64_t, uint32_t>>, true>;
+	Cached::Table y;
+	for (uint64_t i = 0; i < 1000; i++) {
+		y.emplace(i << 32, (uint32_t) i);
+	}
+	std::ostringstream out;
+	Cached::write(y, out);
+	std::string bytes = out.str();
+	std::vector<uint64_t> image((bytes.size() + 7) / 8);
+	std::memcpy(image.data(), bytes.data(), bytes.size());
+	Cached cached(image.data(), bytes.size());
+	size_t seen = 0;
+	cached.for_each([&](const auto& entry) {
+		REQUIRE(entry.first == (uint64_t) entry.second << 32);
+		seen++;
+	});
+	REQUIRE(seen == 1000);
+	REQUIRE((*cached.find(5ull << 32)).second == 5);
+	REQUIRE(cached.find(5) == nullptr);
+
+	// a snapshot of one table type isn't taken for another's
+	using Linear = HashTableSnapshot<uint64_t, uint32_t>;
+	REQUIRE_THROWS_AS(Linear(image.data(), bytes.size()), std::invalid_argument);
+	REQUIRE_THROWS_AS(Cached(image.data(), bytes.size() - 1), std::invalid_argument);
+
+	// damaged slots can't make a lookup run on: with no empty slot left, or
+	// bogus distances, each still stops after a pass over the slots
+	auto ctrl = (char*) image.data() + sizeof(ht_snapshot_header);
+	std::memset(ctrl, 0, cached.bucket_count() + HT_SNAPSHOT_MIRROR);
+	std::memset(ctrl + cached.bucket_count() + HT_SNAPSHOT_MIRROR, 254, cached.bucket_count());
+	REQUIRE(cached.find(5) == nullptr);
+	std::ostringstream linear_out;
+	Linear::write(x, linear_out);
+	std::string linear_bytes = linear_out.str();
+	std::vector<uint64_t> linear_image((linear_bytes.size() + 7) / 8);
+	std::memcpy(linear_image.data(), linear_bytes.data(), linear_bytes.size());
+	Linear full(linear_image.data(), linear_bytes.size());
+	std::memset((char*) linear_image.data() + sizeof(ht_snapshot_header), 0, full.bucket_count() + HT_SNAPSHOT_MIRROR);
+	REQUIRE(!full.contains(1));
+}
+
+TEST_CASE("concurrent tables can be shared between threads") {
+	ConcurrentHashTable<int, int> x(8);
+	REQUIRE(x.shard_count() == 8);
+	// assertions aren't thread-safe, so threads only count mistakes
+	std::atomic<int> made = 0, wrong = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&, t] {
+			for (int i = t; i < 4000; i += 4) {
+				x.insert_or_assign(i, i);
+				wrong += x.find(i) != i;
+			}
+			// every thread asks for the same keys; each is only made once
+			for (int i = 0; i < 500; i++) {
+				int val = x.compute_if_absent(-1 - i, [&] {
+					made++;
+					return i;
+				});
+				wrong += val != i;
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	REQUIRE(wrong == 0);
+	REQUIRE(made == 500);
+	REQUIRE(x.size() == 4500);
+	REQUIRE(x.erase(-1) == 1);
+	REQUIRE(!x.contains(-1));
+	REQUIRE(!x.find(-1).has_value());
+	REQUIRE(x.visit(10, [](const int& val) { REQUIRE(val == 10); }));
+
+	x.for_each([](std::pair<const int, int>& entry) { entry.second++; });
+	long sum = 0;
+	std::as_const(x).for_each([&](const std::pair<const int, int>& entry) { sum += entry.first >= 0 ? entry.second - entry.first : 0; });
+	REQUIRE(sum == 4000);
+	x.clear();
+	REQUIRE(x.empty());
+
+	// with the identity hash, strided keys share their low bits
+	ConcurrentHashTable<size_t, size_t> strided(32);
+	for (size_t i = 0; i < 10000; i++) {
+		strided.insert_or_assign(i * 64, i);
+	}
+	for (size_t i = 0; i < strided.shard_count(); i++) {
+		strided.for_shard(i, [](const auto& shard) {
+			REQUIRE(shard.size() > 10000 / 32 / 2);
+			REQUIRE(shard.size() < 10000 / 32 * 2);
+		});
+	}
+	REQUIRE(strided.size() == 10000);
+	REQUIRE(strided.find(64 * 9999) == 9999);
+}
+
+TEST_CASE("concurrent writes hash each key once") {
+	// cached hashes, so neither growing nor shifting entries back on erase
+	// calls the hasher
+	using Cached = ConcurrentHashTable<std::string, int, counting_hash, std::equal_to<std::string>, LinearProbing, std::allocator<std::pair<const std::string, int>>, true>;
+	Cached x(4);
+	counting_hash::calls = 0;
+	for (int i = 0; i < 1000; i++) {
+		REQUIRE(x.insert_or_assign(std::to_string(i), i));
+	}
+	REQUIRE(counting_hash::calls == 1000);
+	for (int i = 0; i < 1000; i++) {
+		std::string key = std::to_string(i);
+		REQUIRE(!x.insert_or_assign(key, -i));
+	}
+	REQUIRE(counting_hash::calls == 2000);
+	for (int i = 1000; i < 1100; i++) {
+		REQUIRE(x.compute_if_absent(std::to_string(i), [&] { return i; }) == i);
+	}
+	REQUIRE(counting_hash::calls == 2100);
+	for (int i = 0; i < 1100; i += 2) {
+		REQUIRE(x.erase(std::to_string(i)) == 1);
+	}
+	REQUIRE(x.erase("missing") == 0);
+	REQUIRE(counting_hash::calls == 2651);
+	REQUIRE(x.size() == 550);
+	REQUIRE(x.find("999") == -999);
+}
+
+// A clock tests can move by hand.
+struct ManualClock {
+	using duration = std::chrono::nanoseconds;
+	using rep = duration::rep;
+	using period = duration::period;
+	using time_point = std::chrono::time_point<ManualClock>;
+	static constexpr bool is_steady = true;
+	static inline time_point current{};
+	static time_point now() noexcept {
+		return current;
+	}
+};
+
+TEST_CASE("evicting tables stay bounded") {
+	EvictingHashTable<int, std::string> x(100);
+	size_t slots = x.bucket_count();
+	for (int i = 0; i < 100; i++) {
+		REQUIRE(x.insert_or_assign(i, std::to_string(i)));
+	}
+	REQUIRE(x.size() == 100);
+	REQUIRE(x.evictions() == 0);
+	// entries hit since the hand last passed outlive the rest
+	for (int i = 0; i < 100; i += 2) {
+		REQUIRE(*x.find(i) == std::to_string(i));
+	}
+	for (int i = 100; i < 150; i++) {
+		REQUIRE(x.try_emplace(i, "new").second);
+		REQUIRE(x.size() == 100);
+	}
+	REQUIRE(x.evictions() == 50);
+	REQUIRE(x.bucket_count() == slots);
+	// every unmarked entry (old or new) is a candidate before the hand
+	// comes round to the marked ones again
+	size_t unmarked = 0;
+	for (int i = 0; i < 150; i++) {
+		if (i < 100 && i % 2 == 0) {
+			REQUIRE(x.contains(i));
+		} else {
+			unmarked += x.contains(i);
+		}
+	}
+	REQUIRE(unmarked == 50);
+	REQUIRE(!x.try_emplace(0, "ignored").second);
+	REQUIRE(*x.peek(0) == "0");
+	REQUIRE(x.erase(0) == 1);
+	REQUIRE(x.find(0) == nullptr);
+	for (int i = 1000; i < 5000; i++) {
+		x.insert_or_assign(i, "churn");
+		REQUIRE(x.find(i) != nullptr);
+	}
+	REQUIRE(x.size() == 100);
+	REQUIRE(x.bucket_count() == slots);
+	x.clear();
+	REQUIRE(x.empty());
+	REQUIRE(x.bucket_count() == slots);
+
+	EvictingHashTable<int, int, std::hash<int>, std::equal_to<int>, RobinHoodProbing, std::allocator<std::pair<const int, int>>, false, ManualClock> y(10);
+	y.insert_or_assign(1, 1, std::chrono::seconds(5));
+	y.insert_or_assign(2, 2);
+	y.insert_or_assign(3, 3, std::chrono::seconds(20));
+	REQUIRE(y.expire_after(2, std::chrono::seconds(10)));
+	REQUIRE(!y.expire_after(4, std::chrono::seconds(10)));
+	ManualClock::current += std::chrono::seconds(6);
+	REQUIRE(y.find(1) == nullptr);
+	REQUIRE(*y.find(2) == 2);
+	// lookups leave expired entries where they are
+	REQUIRE(y.size() == 3);
+	ManualClock::current += std::chrono::seconds(6);
+	REQUIRE(!y.contains(2));
+	int seen = 0;
+	y.for_each([&](int key, const int& val) { seen += key == 3 && val == 3; });
+	REQUIRE(seen == 1);
+	REQUIRE(y.erase_expired() == 2);
+	REQUIRE(y.size() == 1);
+	// an expired key is inserted anew
+	y.insert_or_assign(3, 30, std::chrono::seconds(1));
+	ManualClock::current += std::chrono::seconds(2);
+	REQUIRE(y.try_emplace(3, 31).second);
+	REQUIRE(*y.find(3) == 31);
+
+	// so pointers from `find` survive lookups of expired keys
+	EvictingHashTable<int, int, std::hash<int>, std::equal_to<int>, LinearProbing, std::allocator<std::pair<const int, int>>, false, ManualClock> z(1000);
+	for (int i = 0; i < 1000; i++) {
+		if (i % 2 == 0) {
+			z.insert_or_assign(i, i, std::chrono::seconds(1));
+		} else {
+			z.insert_or_assign(i, i);
+		}
+	}
+	std::vector<int*> kept;
+	for (int i = 1; i < 1000; i += 2) {
+		kept.push_back(z.find(i));
+	}
+	ManualClock::current += std::chrono::seconds(2);
+	for (int i = 0; i < 1000; i += 2) {
+		REQUIRE(z.find(i) == nullptr);
+		REQUIRE(!z.expire_after(i, std::chrono::seconds(1)));
+	}
+	for (int i = 1; i < 1000; i += 2) {
+		REQUIRE(z.find(i) == kept[i / 2]);
+		REQUIRE(*kept[i / 2] == i);
+	}
+	REQUIRE(z.erase_expired() == 500);
+
+	REQUIRE_THROWS_AS((EvictingHashTable<int, int>(0)), std::invalid_argument);
+}
+
+TEST_CASE("small tables keep few entries inline") {
+	SmallHashTable<std::string, int, 4> x;
+	REQUIRE(x.empty());
+	REQUIRE(x.find("a") == nullptr);
+	for (int i = 0; i < 4; i++) {
+		REQUIRE(x.try_emplace(std::to_string(i), i).second);
+	}
+	REQUIRE(x.is_inline());
+	REQUIRE(!x.try_emplace("2", 20).second);
+	REQUIRE(!x.insert_or_assign("3", 30));
+	REQUIRE(x.at("3") == 30);
+	REQUIRE_THROWS_AS(x.at("4"), std::out_of_range);
+
+	// erasing moves the last entry into the hole
+	REQUIRE(x.erase("0") == 1);
+	REQUIRE(x.erase("0") == 0);
+	REQUIRE(x.size() == 3);
+	REQUIRE(x.at("3") == 30);
+	x["0"] = 0;
+	REQUIRE(x.is_inline());
+
+	SmallHashTable<std::string, int, 4> copy = x;
+	x["4"] = 4;
+	REQUIRE(!x.is_inline());
+	REQUIRE(copy.is_inline());
+	for (int i = 5; i < 100; i++) {
+		x[std::to_string(i)] = i;
+	}
+	REQUIRE(x.size() == 100);
+	int sum = 0;
+	x.for_each([&](const std::string& key, int value) {
+		REQUIRE(value == (key == "3" ? 30 : std::stoi(key)));
+		sum += value;
+	});
+	REQUIRE(sum == 99 * 100 / 2 + 27);
+	REQUIRE(copy.size() == 4);
+	REQUIRE(copy.at("1") == 1);
+
+	SmallHashTable<std::string, int, 4> moved = std::move(copy);
+	REQUIRE(moved.size() == 4);
+	REQUIRE(copy.empty());
+	moved = x;
+	REQUIRE(moved.size() == 100);
+	REQUIRE(moved.at("99") == 99);
+	x = std::move(moved);
+	REQUIRE(x.size() == 100);
+	x.clear();
+	REQUIRE(x.is_inline());
+	REQUIRE(x.empty());
+	x.reserve(10);
+	REQUIRE(!x.is_inline());
+}
+
+TEST_CASE("small tables compare integer keys a vector at a time") {
+	// every length and match position, past the last full vector and the
+	// first 64 keys too; keys past the length are ignored
+	uint64_t wide[70];
+	uint32_t narrow[70];
+	for (size_t i = 0; i < 70; i++) {
+		wide[i] = (i + 1) << 32 | 7;
+		narrow[i] = (uint32_t) i * 3 + 1;
+	}
+	for (size_t n = 0; n <= 70; n++) {
+		for (size_t i = 0; i < 70; i++) {
+			REQUIRE(ht_detail::find_packed<70>(wide, n, wide[i]) == std::min(i, n));
+			REQUIRE(ht_detail::find_packed<70>(narrow, n, narrow[i]) == std::min(i, n));
+		}
+		// matching only the low or only the high half isn't a match
+		REQUIRE(ht_detail::find_packed<70>(wide, n, (uint64_t) 7) == n);
+		REQUIRE(ht_detail::find_packed<70>(wide, n, (uint64_t) 1 << 32) == n);
+		REQUIRE(ht_detail::find_packed<70>(narrow, n, (uint32_t) 2) == n);
+	}
+	REQUIRE(ht_detail::find_packed<3>(wide, 3, wide[2]) == 2);
+
+	SmallHashTable<uint64_t, int, 16> ids;
+	for (uint64_t i = 0; i < 16; i++) {
+		ids[i * 1000] = (int) i;
+	}
+	REQUIRE(ids.is_inline());
+	for (uint64_t i = 0; i < 16; i++) {
+		REQUIRE(ids.at(i * 1000) == (int) i);
+		REQUIRE(!ids.contains(i * 1000 + 1));
+	}
+	REQUIRE(ids.erase(0) == 1);
+	REQUIRE(ids.at(15000) == 15);
+	REQUIRE(!ids.contains(0));
+}
+
+enum class Color { Red, Green, Blue };
+
+TEST_CASE("frozen tables are built at compile time") {
+	static constexpr auto names = make_frozen_hash_table<std::string_view, int>({
+		{"zero", 0}, {"one", 1}, {"two", 2}, {"three", 3}, {"four", 4},
+		{"five", 5}, {"six", 6}, {"seven", 7}, {"eight", 8}, {"nine", 9},
+	});
+	static_assert(names.size() == 10);
+	static_assert(names.at("seven") == 7);
+	static_assert(!names.contains("ten"));
+	REQUIRE(*names.find(std::string("three")) == 3);
+	REQUIRE(names.find("") == nullptr);
+	REQUIRE_THROWS_AS(names.at("eleven"), std::out_of_range);
+	int sum = 0;
+	for (const auto& [name, value] : names) {
+		REQUIRE(names.at(name) == value);
+		sum += value;
+	}
+	REQUIRE(sum == 45);
+
+	static constexpr auto colors = make_frozen_hash_table<Color, std::string_view>({
+		{Color::Red, "red"}, {Color::Green, "green"},
+	});
+	static_assert(colors.at(Color::Green) == "green");
+	REQUIRE(!colors.contains(Color::Blue));
+
+	// big enough that some buckets need several seeds tried
+	static constexpr std::pair<int, int> squares[] = {
+		{0, 0}, {1, 1}, {2, 4}, {3, 9}, {4, 16}, {5, 25}, {6, 36}, {7, 49},
+		{8, 64}, {9, 81}, {10, 100}, {11, 121}, {12, 144}, {13, 169}, {14, 196}, {15, 225},
+		{16, 256}, {17, 289}, {18, 324}, {19, 361}, {20, 400}, {21, 441}, {22, 484}, {23, 529},
+		{24, 576}, {25, 625}, {26, 676}, {27, 729}, {28, 784}, {29, 841}, {30, 900}, {31, 961},
+		{32, 1024}, {33, 1089}, {34, 1156}, {35, 1225}, {36, 1296}, {37, 1369}, {38, 1444}, {39, 1521},
+	};
+	static constexpr FrozenHashTable<int, int, 40> table(squares);
+	for (int i = -10; i < 50; i++) {
+		const int* found = table.find(i);
+		REQUIRE((found != nullptr) == (i >= 0 && i < 40));
+		REQUIRE((found == nullptr || *found == i * i));
+	}
+
+	std::pair<int, int> twice[] = {{1, 1}, {2, 2}, {1, 3}};
+	REQUIRE_THROWS_AS((FrozenHashTable<int, int, 3>(twice)), std::invalid_argument);
+}
+
+TEST_CASE("read-mostly tables publish writes to lock-free readers") {
+	ReadMostlyHashTable<int, int> x;
+	std::atomic<bool> done = false;
+	std::atomic<int> wrong = 0;
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 3; t++) {
+		readers.emplace_back([&] {
+			auto reader = x.reader();
+			while (!done) {
+				// a pinned version is consistent: keys are only ever added
+				// in order, so if `i` is there, every key below it is
+				auto pinned = reader.pin();
+				int size = (int) pinned->size();
+				if (size > 0 && !pinned->contains(size - 1)) {
+					wrong++;
+				}
+				std::optional<int> val = reader.find(0);
+				wrong += val.has_value() && *val != 0;
+			}
+		});
+	}
+	for (int i = 0; i < 300; i++) {
+		REQUIRE(x.insert_or_assign(i, i));
+	}
+	done = true;
+	for (auto& thread : readers) {
+		thread.join();
+	}
+	REQUIRE(wrong == 0);
+	REQUIRE(x.size() == 300);
+	// with no reader pinned, the next write frees every replaced table
+	REQUIRE(!x.insert_or_assign(0, 0));
+	REQUIRE(x.retired_count() == 0);
+
+	auto reader = x.reader();
+	{
+		auto pinned = reader.pin();
+		REQUIRE(x.erase(5) == 1);
+		REQUIRE(x.erase(5) == 0);
+		// the pinned version keeps the old contents, while new lookups
+		// see the write
+		REQUIRE(pinned->contains(5));
+		REQUIRE(!reader.contains(5));
+		REQUIRE(x.retired_count() == 1);
+	}
+	REQUIRE(reader.visit(6, [](const int& val) { REQUIRE(val == 6); }));
+	x.update([](auto& table) {
+		table.clear();
+		table[1] = 2;
+	});
+	REQUIRE(reader.find(1) == 2);
+	REQUIRE(x.retired_count() == 0);
+}
@@ -0,0 +1,419 @@
+// Benchmarks `HashTable` against `std::unordered_map` and the C `ht_*` API.
+//
+// Every result is printed as one JSON object per line, e.g.
+//   {"container":"HashTable","keys":"seq_int","op":"insert","n":200000,"ns_per_op":21.4}
+// so runs can be diffed or loaded into anything that reads JSON Lines.
+//
+// Usage: ht_bench [-n entries] [-r repetitions] [filter...]
+// Only benchmarks whose "container/keys/op" name contains one of the filters
+// are run; the fastest of the repetitions is reported.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hash-table.hpp"
+extern "C" {
+#include "ht-hash.h"
+}
+
+namespace {
+	// Written to after every benchmark so the work can't be optimized away.
+	volatile size_t sink;
+
+	struct Options {
+		size_t n = 200000;
+		int reps = 3;
+		std::vector<std::string> filters;
+	};
+
+	// A key set plus the order lookups visit it in. `order` indexes
+	// `keys`; `misses` are keys that are never inserted.
+	template<class K>
+	struct Workload {
+		const char* name;
+		std::vector<K> keys;
+		std::vector<size_t> order;
+		std::vector<K> misses;
+	};
+
+	std::string short_string(std::mt19937_64& rng) {
+		static const char alnum[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+		std::string out(8 + rng() % 9, ' ');
+		for (char& c : out) {
+			c = alnum[rng() % (sizeof(alnum) - 1)];
+		}
+		return out;
+	}
+	std::string long_string(std::mt19937_64& rng) {
+		std::string out = "https://example.com";
+		size_t segments = 4 + rng() % 5;
+		for (size_t i = 0; i < segments; i++) {
+			out += '/';
+			out += short_string(rng);
+		}
+		out += "?id=" + std::to_string(rng());
+		return out;
+	}
+
+	// Indices in `[0, n)` where index `i` is drawn with weight `1 / (i + 1)^s`.
+	std::vector<size_t> zipf_order(size_t n, size_t count, double s, std::mt19937_64& rng) {
+		std::vector<double> cdf(n);
+		double total = 0;
+		for (size_t i = 0; i < n; i++) {
+			total += 1.0 / std::pow((double) (i + 1), s);
+			cdf[i] = total;
+		}
+		std::uniform_real_distribution<double> uniform(0, total);
+		std::vector<size_t> out(count);
+		for (size_t& index : out) {
+			index = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+		}
+		return out;
+	}
+	std::vector<size_t> uniform_order(size_t n, std::mt19937_64& rng) {
+		std::vector<size_t> out(n);
+		for (size_t i = 0; i < n; i++) {
+			out[i] = i;
+		}
+		std::shuffle(out.begin(), out.end(), rng);
+		return out;
+	}
+
+	std::vector<Workload<uint64_t>> int_workloads(size_t n) {
+		std::mt19937_64 rng(1);
+		std::vector<Workload<uint64_t>> out;
+
+		Workload<uint64_t> seq{ "seq_int", {}, {}, {} };
+		for (size_t i = 0; i < n; i++) {
+			seq.keys.push_back(i);
+			seq.misses.push_back(n + i);
+		}
+		seq.order = uniform_order(n, rng);
+		out.push_back(std::move(seq));
+
+		Workload<uint64_t> random{ "random_int", {}, {}, {} };
+		for (size_t i = 0; i < n; i++) {
+			// odd keys are inserted, even ones miss
+			random.keys.push_back(rng() | 1);
+			random.misses.push_back(rng() & ~(uint64_t) 1);
+		}
+		random.order = uniform_order(n, rng);
+		out.push_back(std::move(random));
+
+		Workload<uint64_t> zipf{ "zipf_int", {}, {}, {} };
+		zipf.keys = out.back().keys;
+		zipf.misses = out.back().misses;
+		zipf.order = zipf_order(n, n, 0.99, rng);
+		out.push_back(std::move(zipf));
+		return out;
+	}
+	std::vector<Workload<std::string>> string_workloads(size_t n) {
+		std::mt19937_64 rng(2);
+		std::vector<Workload<std::string>> out;
+		for (auto [name, make] : {
+			std::make_pair("short_string", &short_string),
+			std::make_pair("long_string", &long_string),
+		}) {
+			Workload<std::string> load{ name, {}, {}, {} };
+			for (size_t i = 0; i < n; i++) {
+				// the suffix keeps keys unique and apart from misses
+				load.keys.push_back(make(rng) + "#" + std::to_string(i));
+				load.misses.push_back(make(rng) + "!" + std::to_string(i));
+			}
+			load.order = uniform_order(n, rng);
+			out.push_back(std::move(load));
+		}
+		return out;
+	}
+	// The C table only stores strings, so integer keys become decimal
+	// strings for it.
+	Workload<std::string> as_strings(const Workload<uint64_t>& load) {
+		Workload<std::string> out{ load.name, {}, load.order, {} };
+		for (uint64_t key : load.keys) {
+			out.keys.push_back(std::to_string(key));
+		}
+		for (uint64_t key : load.misses) {
+			out.misses.push_back(std::to_string(key));
+		}
+		return out;
+	}
+
+	// Counts the `true`s written through it, so batched lookups can be
+	// timed without storing their results.
+	struct CountingOutput {
+		size_t* count;
+		CountingOutput& operator*() { return *this; }
+		CountingOutput& operator++(int) { return *this; }
+		CountingOutput& operator=(bool found) {
+			*this->count += found;
+			return *this;
+		}
+	};
+
+	template<class Map, class = void>
+	struct has_batch : std::false_type { };
+	template<class Map>
+	struct has_batch<Map, std::void_t<decltype(std::declval<const Map&>().contains_batch(
+		std::declval<const typename Map::key_type*>(),
+		std::declval<const typename Map::key_type*>(),
+		std::declval<CountingOutput>()
+	))>> : std::true_type { };
+
+	template<class Map, class = void>
+	struct has_interleaved : std::false_type { };
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+	template<class Map>
+	struct has_interleaved<Map, std::void_t<decltype(std::declval<const Map&>().contains_interleaved(
+		std::declval<const typename Map::key_type*>(),
+		std::declval<const typename Map::key_type*>(),
+		std::declval<CountingOutput>()
+	))>> : std::true_type { };
+#endif
+
+	// Adapters give every container the same small interface. Ones with
+	// `BATCH` also have `find_batch`, returning how many keys were found,
+	// and ones with `INTERLEAVED` have `find_interleaved`.
+	template<class Map>
+	struct StdAdapter {
+		using Key = typename Map::key_type;
+		static constexpr bool BATCH = has_batch<Map>::value;
+		static constexpr bool INTERLEAVED = has_interleaved<Map>::value;
+		Map map;
+		void insert(const Key& key) {
+			this->map[key]++;
+		}
+		bool find(const Key& key) const {
+			return this->map.find(key) != this->map.end();
+		}
+		size_t find_batch(const std::vector<Key>& keys) const {
+			size_t found = 0;
+			if constexpr (BATCH) {
+				this->map.contains_batch(keys.data(), keys.data() + keys.size(), CountingOutput{ &found });
+			}
+			return found;
+		}
+		size_t find_interleaved(const std::vector<Key>& keys) const {
+			size_t found = 0;
+			if constexpr (INTERLEAVED) {
+				this->map.contains_interleaved(keys.data(), keys.data() + keys.size(), CountingOutput{ &found });
+			}
+			return found;
+		}
+		void erase(const Key& key) {
+			this->map.erase(key);
+		}
+		size_t iterate() const {
+			size_t sum = 0;
+			for (const auto& pair : this->map) {
+				sum += pair.second;
+			}
+			return sum;
+		}
+		void grow() {
+			this->map.rehash(this->map.bucket_count() * 2);
+		}
+	};
+	template<unsigned Flags>
+	struct CAdapter {
+		using Key = std::string;
+		static constexpr bool BATCH = true;
+		static constexpr bool INTERLEAVED = false;
+		ht_hash_table table = {};
+		CAdapter() {
+			this->table.flags = Flags;
+		}
+		CAdapter(const CAdapter&) = delete;
+		~CAdapter() {
+			ht_clear(&this->table);
+		}
+		void insert(const Key& key) {
+			ht_insertn(&this->table, key.data(), key.size(), "1", 1);
+		}
+		bool find(const Key& key) const {
+			return ht_searchn(&this->table, key.data(), key.size()) != NULL;
+		}
+		size_t find_batch(const std::vector<Key>& keys) const {
+			constexpr size_t CHUNK = 256;
+			const char* ptrs[CHUNK];
+			size_t lens[CHUNK];
+			char* vals[CHUNK];
+			size_t found = 0;
+			for (size_t start = 0; start < keys.size(); start += CHUNK) {
+				size_t count = std::min(CHUNK, keys.size() - start);
+				for (size_t i = 0; i < count; i++) {
+					ptrs[i] = keys[start + i].data();
+					lens[i] = keys[start + i].size();
+				}
+				found += ht_searchn_batch(&this->table, count, ptrs, lens, vals);
+			}
+			return found;
+		}
+		void erase(const Key& key) {
+			ht_removen(&this->table, key.data(), key.size());
+		}
+		size_t iterate() const {
+			size_t sum = 0;
+			ht_iter iter = ht_iterator(&this->table);
+			char* val;
+			while (ht_iter_next_pair(&iter, NULL, &val)) {
+				sum += (unsigned char) *val;
+			}
+			return sum;
+		}
+		void grow() {
+			ht_resize(&this->table, this->table.capacity * 2);
+		}
+	};
+
+	bool selected(const Options& opts, const std::string& name) {
+		if (opts.filters.empty()) {
+			return true;
+		}
+		for (const auto& filter : opts.filters) {
+			if (name.find(filter) != std::string::npos) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void report(const char* container, const char* keys, const char* op, size_t n, double ns_per_op) {
+		std::printf(
+			"{\"container\":\"%s\",\"keys\":\"%s\",\"op\":\"%s\",\"n\":%zu,\"ns_per_op\":%.2f}\n",
+			container, keys, op, n, ns_per_op
+		);
+		std::fflush(stdout);
+	}
+
+	// Runs `setup` then times `body`, `reps` times, returning the fastest
+	// time per operation. `body` returns a value that goes into `sink`.
+	template<class Adapter, class Setup, class Body>
+	double measure(int reps, size_t ops, Setup&& setup, Body&& body) {
+		double best = INFINITY;
+		for (int rep = 0; rep < reps; rep++) {
+			Adapter adapter;
+			setup(adapter);
+			auto start = std::chrono::steady_clock::now();
+			sink = sink + body(adapter);
+			auto stop = std::chrono::steady_clock::now();
+			double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+			best = std::min(best, ns / (double) ops);
+		}
+		return best;
+	}
+
+	template<class Adapter, class K>
+	void run(const Options& opts, const char* container, const Workload<K>& load) {
+		size_t n = load.keys.size();
+		auto fill = [&](Adapter& adapter) {
+			for (const auto& key : load.keys) {
+				adapter.insert(key);
+			}
+		};
+		auto none = [](Adapter&) { };
+		auto bench = [&](const char* op, size_t ops, auto&& setup, auto&& body) {
+			std::string name = std::string(container) + "/" + load.name + "/" + op;
+			if (selected(opts, name)) {
+				report(container, load.name, op, n, measure<Adapter>(opts.reps, ops, setup, body));
+			}
+		};
+
+		// inserts follow the lookup order, so Zipfian workloads count
+		// repeated keys rather than inserting every key once
+		bench("insert", n, none, [&](Adapter& adapter) {
+			for (size_t index : load.order) {
+				adapter.insert(load.keys[index]);
+			}
+			return (size_t) 0;
+		});
+		bench("find_hit", n, fill, [&](const Adapter& adapter) {
+			size_t found = 0;
+			for (size_t index : load.order) {
+				found += adapter.find(load.keys[index]);
+			}
+			return found;
+		});
+		if constexpr (Adapter::BATCH) {
+			std::vector<K> lookups;
+			for (size_t index : load.order) {
+				lookups.push_back(load.keys[index]);
+			}
+			bench("find_hit_batch", n, fill, [&](const Adapter& adapter) {
+				return adapter.find_batch(lookups);
+			});
+			if constexpr (Adapter::INTERLEAVED) {
+				bench("find_hit_interleaved", n, fill, [&](const Adapter& adapter) {
+					return adapter.find_interleaved(lookups);
+				});
+			}
+		}
+		bench("find_miss", n, fill, [&](const Adapter& adapter) {
+			size_t found = 0;
+			for (const auto& key : load.misses) {
+				found += adapter.find(key);
+			}
+			return found;
+		});
+		// steady-state churn: every erase is followed by an insert
+		bench("erase_churn", n, fill, [&](Adapter& adapter) {
+			for (size_t i = 0; i < n; i++) {
+				adapter.erase(load.keys[i]);
+				adapter.insert(load.misses[i]);
+			}
+			return (size_t) 0;
+		});
+		bench("iterate", n, fill, [&](const Adapter& adapter) {
+			return adapter.iterate();
+		});
+		bench("resize", n, fill, [&](Adapter& adapter) {
+			adapter.grow();
+			return (size_t) 0;
+		});
+	}
+
+	Options parse(int argc, char* argv[]) {
+		Options opts;
+		for (int i = 1; i < argc; i++) {
+			if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+				opts.n = std::strtoull(argv[++i], nullptr, 10);
+			} else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+				opts.reps = std::max(1, std::atoi(argv[++i]));
+			} else {
+				opts.filters.push_back(argv[i]);
+			}
+		}
+		return opts;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options opts = parse(argc, argv);
+	for (const auto& load : int_workloads(opts.n)) {
+		run<StdAdapter<HashTable<uint64_t, size_t>>>(opts, "HashTable", load);
+		run<StdAdapter<std::unordered_map<uint64_t, size_t>>>(opts, "unordered_map", load);
+		run<CAdapter<0>>(opts, "ht_hash_table", as_strings(load));
+		run<CAdapter<HT_ARENA>>(opts, "ht_hash_table_arena", as_strings(load));
+		run<CAdapter<HT_BORROW>>(opts, "ht_hash_table_borrow", as_strings(load));
+	}
+	for (const auto& load : string_workloads(opts.n)) {
+		run<StdAdapter<HashTable<std::string, size_t>>>(opts, "HashTable", load);
+		run<StdAdapter<HashTable<std::string, size_t, BytesHash>>>(opts, "HashTable_BytesHash", load);
+		run<StdAdapter<std::unordered_map<std::string, size_t>>>(opts, "unordered_map", load);
+		run<CAdapter<0>>(opts, "ht_hash_table", load);
+		run<CAdapter<HT_ARENA>>(opts, "ht_hash_table_arena", load);
+		run<CAdapter<HT_BORROW>>(opts, "ht_hash_table_borrow", load);
+	}
+	return 0;
+}
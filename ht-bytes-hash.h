@@ -0,0 +1,187 @@
+/**
+ * \file ht-bytes-hash.h
+ * \brief The byte-string hash shared by the C and C++ tables.
+ *
+ * `ht_hash_bytes` reads keys 8 bytes at a time and folds them together with
+ * 64x64->128-bit multiplies, in the style of wyhash. Keys of at least
+ * `HT_HASH_LONG` bytes instead go through 8 independent accumulators, in the
+ * style of XXH3, which SSE2 or AVX2 update two or four lanes at a time when
+ * the compiler targets them; every path gives the same result. The hash isn't
+ * meant to resist deliberately colliding keys.
+ *
+ * Everything here is `static inline`, so the header works on its own from C
+ * or C++.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#elif defined(__SSE2__)
+#	include <emmintrin.h>
+#endif
+
+/// Keys at least this long use the striped accumulator path.
+#define HT_HASH_LONG 512
+
+/** \internal */
+static const uint64_t HT_HASH_SECRET[24] = {
+	0x2cb0f69f4abea221ull, 0x9417034723148989ull, 0xdd555950609dfe03ull, 0xdbafb150deb12800ull,
+	0x7e789b2e6c442cb6ull, 0xf41e5636c7e4f8c4ull, 0x0959d150f8fba7e4ull, 0xa97316f13cdb9eeaull,
+	0x74cd8258f9520068ull, 0x55c74a62e116868bull, 0xd2f4c799a2023cbdull, 0xdf98cb79a37b51b9ull,
+	0x396f5885524f3905ull, 0xaf1d56386ca3b276ull, 0xa9ffbe6b5104e85aull, 0x6bd0c51b9fd533b3ull,
+	0x980ce91c50ab4b56ull, 0x28ac395780fe62c5ull, 0x768912e3a6bcedc7ull, 0x50b3e8c9332c7c88ull,
+	0xce3bbfe520bd47daull, 0xcba6c8e8e0bb7c4full, 0xbf194db8434a346dull, 0x7d8f2a7b60416d7full,
+};
+
+/** \internal */
+static inline uint64_t ht_hash_r8(const unsigned char *p) {
+	uint64_t out;
+	memcpy(&out, p, 8);
+	return out;
+}
+/** \internal */
+static inline uint64_t ht_hash_r4(const unsigned char *p) {
+	uint32_t out;
+	memcpy(&out, p, 4);
+	return out;
+}
+
+/** \internal Multiplies `a` and `b` to 128 bits and folds the halves. */
+static inline uint64_t ht_hash_fold(uint64_t a, uint64_t b) {
+	unsigned __int128 product = (unsigned __int128) a * b;
+	return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+/** \internal The wyhash-style path, used directly for keys under `HT_HASH_LONG`. */
+__attribute__((pure, nothrow))
+static inline uint64_t ht_hash_short(const unsigned char *p, size_t len, uint64_t seed) {
+	const uint64_t *k = HT_HASH_SECRET;
+	seed ^= ht_hash_fold(seed ^ k[0], k[1]);
+	uint64_t a, b;
+	if (__builtin_expect(len <= 16, 1)) {
+		if (len >= 4) {
+			size_t mid = (len >> 3) << 2;
+			a = (ht_hash_r4(p) << 32) | ht_hash_r4(p + mid);
+			b = (ht_hash_r4(p + len - 4) << 32) | ht_hash_r4(p + len - 4 - mid);
+		} else if (len > 0) {
+			a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t left = len;
+		if (__builtin_expect(left > 48, 0)) {
+			// three independent chains, so the multiplies can overlap
+			uint64_t seed1 = seed, seed2 = seed;
+			do {
+				seed = ht_hash_fold(ht_hash_r8(p) ^ k[1], ht_hash_r8(p + 8) ^ seed);
+				seed1 = ht_hash_fold(ht_hash_r8(p + 16) ^ k[2], ht_hash_r8(p + 24) ^ seed1);
+				seed2 = ht_hash_fold(ht_hash_r8(p + 32) ^ k[3], ht_hash_r8(p + 40) ^ seed2);
+				p += 48;
+				left -= 48;
+			} while (left > 48);
+			seed ^= seed1 ^ seed2;
+		}
+		while (left > 16) {
+			seed = ht_hash_fold(ht_hash_r8(p) ^ k[1], ht_hash_r8(p + 8) ^ seed);
+			p += 16;
+			left -= 16;
+		}
+		// the last 16 bytes, overlapping ones already hashed if need be
+		a = ht_hash_r8(p + left - 16);
+		b = ht_hash_r8(p + left - 8);
+	}
+	unsigned __int128 product = (unsigned __int128) (a ^ k[1]) * (b ^ seed);
+	a = (uint64_t) product;
+	b = (uint64_t) (product >> 64);
+	return ht_hash_fold(a ^ k[0] ^ len, b ^ k[1]);
+}
+
+/** \internal Stripes between scrambles of the accumulators. */
+#define HT_HASH_BLOCK_STRIPES 16
+
+/// \internal Adds one 64-byte stripe into `acc`, keyed by the secret at
+/// `key`: each lane adds the product of its keyed halves, and its neighbour
+/// adds the raw data, so no lane's data is lost to a zero product.
+__attribute__((nonnull(1, 2, 3), nothrow))
+static inline void ht_hash_stripe(uint64_t *acc, const unsigned char *p, const uint64_t *key) {
+#if defined(__AVX2__)
+	for (int i = 0; i < 8; i += 4) {
+		__m256i data = _mm256_loadu_si256((const __m256i *) (p + i * 8));
+		__m256i keyed = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i *) (key + i)));
+		__m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+		__m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		__m256i sum = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *) (acc + i)), _mm256_add_epi64(product, swapped));
+		_mm256_storeu_si256((__m256i *) (acc + i), sum);
+	}
+#elif defined(__SSE2__)
+	for (int i = 0; i < 8; i += 2) {
+		__m128i data = _mm_loadu_si128((const __m128i *) (p + i * 8));
+		__m128i keyed = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *) (key + i)));
+		__m128i product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+		__m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		__m128i sum = _mm_add_epi64(_mm_loadu_si128((const __m128i *) (acc + i)), _mm_add_epi64(product, swapped));
+		_mm_storeu_si128((__m128i *) (acc + i), sum);
+	}
+#else
+	for (int i = 0; i < 8; i++) {
+		uint64_t data = ht_hash_r8(p + i * 8);
+		uint64_t keyed = data ^ key[i];
+		acc[i ^ 1] += data;
+		acc[i] += (keyed & 0xffffffffu) * (keyed >> 32);
+	}
+#endif
+}
+
+/** \internal Mixes each accumulator's high bits down between blocks. */
+__attribute__((nonnull(1), nothrow))
+static inline void ht_hash_scramble(uint64_t *acc) {
+	const uint64_t *key = HT_HASH_SECRET + HT_HASH_BLOCK_STRIPES;
+	for (int i = 0; i < 8; i++) {
+		uint64_t x = acc[i];
+		x ^= x >> 47;
+		x ^= key[i];
+		acc[i] = x * 0x9e3779b1u;
+	}
+}
+
+/** \internal The XXH3-style path for keys of at least `HT_HASH_LONG` bytes. */
+__attribute__((pure, nothrow))
+static inline uint64_t ht_hash_long(const unsigned char *p, size_t len, uint64_t seed) {
+	const uint64_t *k = HT_HASH_SECRET;
+	uint64_t acc[8] = { k[0], k[1], k[2], k[3], k[4], k[5], k[6], k[7] };
+	// every full stripe but the last byte's, which the tail below covers
+	size_t stripes = (len - 1) / 64;
+	for (size_t stripe = 0; stripe < stripes; stripe++) {
+		ht_hash_stripe(acc, p + stripe * 64, k + stripe % HT_HASH_BLOCK_STRIPES);
+		if (stripe % HT_HASH_BLOCK_STRIPES == HT_HASH_BLOCK_STRIPES - 1) {
+			ht_hash_scramble(acc);
+		}
+	}
+	uint64_t merged = len * k[0] ^ seed;
+	for (int i = 0; i < 8; i += 2) {
+		merged += ht_hash_fold(acc[i] ^ k[8 + i], acc[i + 1] ^ k[9 + i]);
+	}
+	size_t done = stripes * 64;
+	return ht_hash_short(p + done, len - done, merged);
+}
+
+/**
+ * \brief Hashes the `len` bytes at `data`, starting from `seed`.
+ *
+ * All 64 bits of the result are well mixed, so it can be reduced with either
+ * a mask or a multiply. `data` can be `NULL` if `len` is 0.
+ */
+__attribute__((pure, nothrow))
+static inline uint64_t ht_hash_bytes(const void *data, size_t len, uint64_t seed) {
+	const unsigned char *p = (const unsigned char *) data;
+	if (__builtin_expect(len >= HT_HASH_LONG, 0)) {
+		return ht_hash_long(p, len, seed);
+	}
+	return ht_hash_short(p, len, seed);
+}
@@ -1,8 +1,26 @@
+// for `mmap` and friends
+#if !defined(_POSIX_C_SOURCE) && (defined(__unix__) || defined(__APPLE__))
+#	define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <assert.h>
+#include <errno.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HT_STATS
+#	include <time.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#	define HT_POSIX 1
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
 
+#include "ht-bytes-hash.h"
 #include "ht-hash.h"
 
 // Many functions with `n` variants have their unspecified-length-variant call
@@ -11,85 +29,391 @@
 // I'm wrong, then this is going to hurt performance.
 
 const size_t HT_INITIAL_CAPACITY = 64;
+/// Bytes in each arena slab; pairs bigger than a quarter of this get a slab of
+/// their own, so they don't waste the rest of the current one.
+static const size_t HT_SLAB_SIZE = 64 * 1024;
 
 /** \internal */
 struct _ht_item {
 	char *key;
 	char *value;
+	/// Lengths of `key` and `value`, not counting the terminator `ht_dupn`
+	/// adds; neither is `strlen`-ed after insertion.
+	size_t key_len;
+	size_t val_len;
+#ifdef HT_CACHE_HASH
+	/// The key's full hash, so resizing never rehashes keys and probes can
+	/// skip keys with a different hash without comparing them.
+	size_t hash;
+#endif
 };
 
+/// `items` is followed, in the same allocation, by one bit per slot saying
+/// whether it's full, so iterating skips 64 empty slots with a single `ctz`.
+__attribute__((const, nothrow))
+static inline size_t ht_bitmap_words(size_t cap) {
+	return (cap + 63) / 64;
+}
+
+__attribute__((nonnull(1), const, nothrow))
+static inline uint64_t *ht_occupied(struct _ht_item *items, size_t cap) {
+	return (uint64_t *) (items + cap);
+}
+
+/// Allocates `cap` empty slots and their (empty) occupancy bitmap.
+__attribute__((nothrow, malloc))
+static struct _ht_item *ht_alloc_items(size_t cap) {
+	return calloc(1, cap * sizeof(struct _ht_item) + ht_bitmap_words(cap) * sizeof(uint64_t));
+}
+
+/// Copies the first `len` bytes of `s` into a new buffer with a terminating
+/// NUL; unlike `strndup`, NULs within those bytes are copied too.
+__attribute__((nonnull(1), nothrow, malloc))
+static char *ht_dupn(const char *s, size_t len) {
+	char *out = malloc(len + 1);
+	if (__builtin_expect(out != NULL, 1)) {
+		memcpy(out, s, len);
+		out[len] = '\0';
+	}
+	return out;
+}
+
+/** \internal */
+struct _ht_slab {
+	struct _ht_slab *next;
+	size_t used;
+	size_t cap;
+	char data[];
+};
+
+__attribute__((nothrow))
+static void ht_free_slabs(struct _ht_slab *slab) {
+	while (slab != NULL) {
+		struct _ht_slab *next = slab->next;
+		free(slab);
+		slab = next;
+	}
+}
+
+/// Bump-allocates `len` bytes from `ht`'s slabs, adding a slab if the current
+/// one is too full.
+__attribute__((nonnull(1), nothrow, malloc))
+static char *ht_arena_alloc(ht_hash_table *ht, size_t len) {
+	struct _ht_slab *head = ht->slabs;
+	if (__builtin_expect(head != NULL && head->cap - head->used >= len, 1)) {
+		char *out = head->data + head->used;
+		head->used += len;
+		return out;
+	}
+	bool own_slab = len > HT_SLAB_SIZE / 4;
+	size_t cap = own_slab ? len : HT_SLAB_SIZE;
+	struct _ht_slab *slab = malloc(sizeof(struct _ht_slab) + cap);
+	if (__builtin_expect(slab == NULL, 0)) {
+		return NULL;
+	}
+	slab->used = len;
+	slab->cap = cap;
+	if (own_slab && head != NULL) {
+		// keep filling the current slab; this one is already full
+		slab->next = head->next;
+		head->next = slab;
+	} else {
+		slab->next = head;
+		ht->slabs = slab;
+	}
+	return slab->data;
+}
+
+/// Whether keys and values in `ht` were allocated one by one, and so have to
+/// be freed one by one.
+__attribute__((nonnull(1), pure, nothrow))
+static inline bool ht_owns_pairs(const ht_hash_table *ht) {
+	return !(ht->flags & (HT_ARENA | HT_BORROW));
+}
+
+/// Copies `key` and `value` (each with a terminating NUL) into storage owned
+/// by `ht`, and records them in `item`. In arena mode the two are packed next
+/// to each other in one allocation; in borrowing mode, nothing is copied.
+__attribute__((nonnull(1, 2, 3, 5), nothrow))
+static bool ht_store_pair(ht_hash_table *ht, struct _ht_item *item, const char *key, size_t key_len, const char *value, size_t val_len) {
+	if (ht->flags & HT_BORROW) {
+		item->key = (char *) key;
+		item->value = (char *) value;
+	} else if (ht->flags & HT_ARENA) {
+		char *block = ht_arena_alloc(ht, key_len + val_len + 2);
+		if (__builtin_expect(block == NULL, 0)) {
+			return false;
+		}
+		memcpy(block, key, key_len);
+		block[key_len] = '\0';
+		item->key = block;
+		item->value = block + key_len + 1;
+		memcpy(item->value, value, val_len);
+		item->value[val_len] = '\0';
+	} else {
+		char *key_clone = ht_dupn(key, key_len), *val_clone = ht_dupn(value, val_len);
+		if (__builtin_expect(key_clone == NULL || val_clone == NULL, 0)) {
+			// one of them is 0, so logical OR works fine for getting either
+			// (and avoids a potential branch for logical OR)
+			free((void *) ((uintptr_t) key_clone | (uintptr_t) val_clone));
+			return false;
+		}
+		item->key = key_clone;
+		item->value = val_clone;
+	}
+	item->key_len = key_len;
+	item->val_len = val_len;
+	return true;
+}
+
+/// Replaces the value in `item` with a copy of `value`.
+__attribute__((nonnull(1, 2, 3), nothrow))
+static bool ht_store_value(ht_hash_table *ht, struct _ht_item *item, const char *value, size_t val_len) {
+	char *val_clone;
+	if (ht->flags & HT_BORROW) {
+		val_clone = (char *) value;
+	} else if (ht->flags & HT_ARENA) {
+		// the old value stays in its slab until `ht_compact`
+		if (__builtin_expect((val_clone = ht_arena_alloc(ht, val_len + 1)) == NULL, 0)) {
+			return false;
+		}
+		memcpy(val_clone, value, val_len);
+		val_clone[val_len] = '\0';
+	} else {
+		if (__builtin_expect((val_clone = ht_dupn(value, val_len)) == NULL, 0)) {
+			return false;
+		}
+		free(item->value);
+	}
+	item->value = val_clone;
+	item->val_len = val_len;
+	return true;
+}
+
+/// Frees the key and value in `item`, unless they live in `ht`'s arena or
+/// belong to the caller.
+__attribute__((nonnull(1, 2), nothrow))
+static void ht_release_pair(const ht_hash_table *ht, struct _ht_item *item) {
+	if (ht_owns_pairs(ht)) {
+		free(item->key);
+		free(item->value);
+	}
+}
+
 void ht_clear(ht_hash_table *ht) {
-	for (size_t i = 0; i < ht->capacity; i++) {
-		if (ht->items[i].key != NULL) {
-			free(ht->items[i].key);
-			free(ht->items[i].value);
-			ht->items[i].key = NULL;
+	if (ht_owns_pairs(ht)) {
+		for (size_t i = 0; i < ht->capacity; i++) {
+			if (ht->items[i].key != NULL) {
+				ht_release_pair(ht, &ht->items[i]);
+			}
 		}
 	}
 	free(ht->items);
+	ht_free_slabs(ht->slabs);
+	unsigned flags = ht->flags;
+	size_t (*hash)(const char *, size_t) = ht->hash;
+	ht_stats *stats = ht->stats;
 	memset(ht, 0, sizeof(ht_hash_table));
+	ht->flags = flags;
+	ht->hash = hash;
+	ht->stats = stats;
+}
+
+bool ht_compact(ht_hash_table *ht) {
+	if ((ht->flags & (HT_ARENA | HT_BORROW)) != HT_ARENA) {
+		return true;
+	}
+	size_t live = 0;
+	for (size_t i = 0; i < ht->capacity; i++) {
+		if (ht->items[i].key != NULL) {
+			live += ht->items[i].key_len + ht->items[i].val_len + 2;
+		}
+	}
+	struct _ht_slab *slab = NULL;
+	if (live != 0) {
+		slab = malloc(sizeof(struct _ht_slab) + live);
+		if (__builtin_expect(slab == NULL, 0)) {
+			return false;
+		}
+		slab->next = NULL;
+		slab->used = 0;
+		slab->cap = live;
+		for (size_t i = 0; i < ht->capacity; i++) {
+			struct _ht_item *item = &ht->items[i];
+			if (item->key == NULL) {
+				continue;
+			}
+			char *block = slab->data + slab->used;
+			memcpy(block, item->key, item->key_len + 1);
+			memcpy(block + item->key_len + 1, item->value, item->val_len + 1);
+			item->key = block;
+			item->value = block + item->key_len + 1;
+			slab->used += item->key_len + item->val_len + 2;
+		}
+	}
+	ht_free_slabs(ht->slabs);
+	ht->slabs = slab;
+	return true;
 }
 
 static const size_t FIB_MULT = 11400714819323198485ull;
-static const size_t HT_PRIME = 151;
 
-__attribute__((nonnull(1), pure, nothrow))
-static size_t ht_hash(const char *s, size_t len, size_t cap) {
-	if (cap == 0) {
+/// The full hash of a key, before it's reduced to an index by `ht_home`. A
+/// custom `hash` hook's result is multiplied out, since `ht_home` only uses
+/// the high bits, unless `HT_HASH_MIXED` says it's mixed already, as
+/// `ht_hash_bytes` is.
+__attribute__((nonnull(1, 2), pure, nothrow))
+static size_t ht_mix(const ht_hash_table *ht, const char *s, size_t len) {
+	if (__builtin_expect(ht->hash != NULL, 0)) {
+		size_t hash = ht->hash(s, len);
+		return ht->flags & HT_HASH_MIXED ? hash : hash * FIB_MULT;
+	}
+	return ht_hash_bytes(s, len, 0);
+}
+
+/// The slot a key with hash `mixed` belongs in, for a power-of-2 capacity.
+__attribute__((const, nothrow))
+static size_t ht_home(size_t mixed, size_t cap) {
+	if (cap <= 1) {
 		return 0;
 	}
-	int shift = 64 - __builtin_ctz(cap);
-	size_t hash = 0;
-	size_t mult = 1;
-	for (size_t i = 0; i < len; i++) {
-		if (__builtin_expect(s[i] == 0, 0)) {
-			break;
+	int shift = 64 - __builtin_ctzll(cap);
+	return mixed >> shift;
+}
+
+/// The hash of the key in `item`, which has to be recomputed unless
+/// `HT_CACHE_HASH` is defined.
+__attribute__((nonnull(1, 2), pure, nothrow))
+static inline size_t ht_item_hash(const ht_hash_table *ht, const struct _ht_item *item) {
+#ifdef HT_CACHE_HASH
+	(void) ht;
+	return item->hash;
+#else
+	return ht_mix(ht, item->key, item->key_len);
+#endif
+}
+
+/// Whether the key in `item` could be one with hash `mixed`; always `true`
+/// without `HT_CACHE_HASH`.
+__attribute__((nonnull(1), pure, nothrow))
+static inline bool ht_hash_may_match(const struct _ht_item *item, size_t mixed) {
+#ifdef HT_CACHE_HASH
+	return item->hash == mixed;
+#else
+	(void) item;
+	(void) mixed;
+	return true;
+#endif
+}
+
+#ifdef HT_STATS
+/// A monotonic time in nanoseconds, for timing resizes.
+__attribute__((nothrow))
+static uint64_t ht_now_ns(void) {
+	struct timespec now;
+#	ifdef HT_POSIX
+	clock_gettime(CLOCK_MONOTONIC, &now);
+#	else
+	timespec_get(&now, TIME_UTC);
+#	endif
+	return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+#endif
+
+/// Counts a lookup that probed `length` slots past its home in `ht`'s stats,
+/// if it has any; does nothing without `HT_STATS`.
+__attribute__((nonnull(1), nothrow))
+static inline void ht_count_lookup(const ht_hash_table *ht, bool hit, size_t length) {
+#ifdef HT_STATS
+	ht_stats *stats = ht->stats;
+	if (stats == NULL) {
+		return;
+	}
+	size_t bucket = 0;
+	for (size_t rest = length; rest != 0 && bucket < HT_STATS_BUCKETS - 1; rest >>= 1) {
+		bucket++;
+	}
+	(hit ? stats->hits : stats->misses)[bucket]++;
+	if (length > stats->longest_probe) {
+		stats->longest_probe = length;
+	}
+#else
+	(void) ht;
+	(void) hit;
+	(void) length;
+#endif
+}
+
+/// `ht_find` for a non-empty table, given the key's hash from `ht_mix`.
+__attribute__((nonnull(1, 2, 5), nothrow))
+static bool ht_find_mixed(const ht_hash_table *ht, const char *key, size_t key_len, size_t mixed, size_t *out_index) {
+	size_t cap = ht->capacity;
+	size_t home = ht_home(mixed, cap);
+	size_t index = home;
+	// the table never fills, so there's always an empty slot to stop at
+	while (ht->items[index].key != NULL) {
+		const struct _ht_item *item = &ht->items[index];
+		// lengths are compared first, so most mismatches never touch the key
+		if (item->key_len == key_len && ht_hash_may_match(item, mixed) && memcmp(item->key, key, key_len) == 0) {
+			*out_index = index;
+			ht_count_lookup(ht, true, (index - home) & (cap - 1));
+			return true;
 		}
-		hash += mult * s[i];
-		mult *= HT_PRIME;
+		index = (index + 1) & (cap - 1);
 	}
-	return (hash * FIB_MULT) >> shift;
+	ht_count_lookup(ht, false, (index - home) & (cap - 1));
+	return false;
 }
 
 /// Generalizes `search` and `contains`; returns `true` if `key` is in `ht`, and
 /// assigns the index of the key in `items` to `out_index` upon finding.
 /// `out_index` is assumed to be non-`NULL`, since the function is private;
 /// calling it with `NULL` for `out_index` will seg-fault.
-__attribute__((nonnull(1, 2, 4), pure, nothrow))
+__attribute__((nonnull(1, 2, 4), nothrow))
 static bool ht_find(const ht_hash_table *ht, const char *key, size_t key_len, size_t *out_index) {
-	size_t cap = ht->capacity;
-	if (cap == 0) {
+	if (ht->capacity == 0) {
 		return false;
 	}
-	size_t index = ht_hash(key, key_len, cap);
-	size_t attempts = 0;
-	while (ht->items[index].key != NULL) {
-		if (strncmp(ht->items[index].key, key, key_len) == 0) {
-			*out_index = index;
-			return true;
-		}
-		index = (index + (attempts << 1) + 1) & (cap - 1);
-		if (attempts++ > ht->size << 1) {
-			return false;
-		}
-	}
-	return false;
+	return ht_find_mixed(ht, key, key_len, ht_mix(ht, key, key_len), out_index);
 }
 
-/// Insert without checking for existing keys or testing capacity.
-__attribute__((nonnull(1, 3, 5), nothrow))
-static bool ht_insert_inner(struct _ht_item *items, size_t cap, char *key, size_t key_len, char *value) {
+/// Insert `item` without checking for existing keys or testing capacity;
+/// `mixed` is the key's hash from `ht_mix`.
+__attribute__((nonnull(1, 3), nothrow))
+static bool ht_insert_inner(struct _ht_item *items, size_t cap, const struct _ht_item *item, size_t mixed) {
 	assert(cap != 0);
-	size_t index = ht_hash(key, key_len, cap);
-	size_t attempts = 0;
+	size_t index = ht_home(mixed, cap);
 	while (items[index].key != NULL) {
-		index = (index + (attempts++ << 1) + 1) & (cap - 1);
+		index = (index + 1) & (cap - 1);
 	}
-	items[index].key = key;
-	items[index].value = value;
+	items[index] = *item;
+#ifdef HT_CACHE_HASH
+	items[index].hash = mixed;
+#endif
+	ht_occupied(items, cap)[index >> 6] |= (uint64_t) 1 << (index & 63);
 	return true;
 }
 
+/// Empties slot `index`, shifting later keys in its probe chain back so none
+/// of them become unreachable.
+__attribute__((nonnull(1), nothrow))
+static void ht_erase_at(ht_hash_table *ht, size_t index) {
+	struct _ht_item *items = ht->items;
+	size_t cap = ht->capacity;
+	size_t mask = cap - 1;
+	for (size_t next = (index + 1) & mask; items[next].key != NULL; next = (next + 1) & mask) {
+		size_t home = ht_home(ht_item_hash(ht, &items[next]), cap);
+		// `next` can fill the hole if the hole is between its home and it
+		if (((next - home) & mask) >= ((next - index) & mask)) {
+			items[index] = items[next];
+			index = next;
+		}
+	}
+	// slots moved into stay full, so only the last one emptied changes
+	items[index].key = NULL;
+	ht_occupied(items, cap)[index >> 6] &= ~((uint64_t) 1 << (index & 63));
+}
+
 bool ht_containsn(const ht_hash_table *ht, const char *key, size_t key_len) {
 	size_t _drop;
 	return ht_find(ht, key, key_len, &_drop);
@@ -101,21 +425,28 @@ bool ht_contains(const ht_hash_table *ht, const char *key) {
 
 __attribute__((nonnull(1), nothrow))
 static void ht_resize_exact(ht_hash_table *ht, size_t old_cap, size_t new_cap) {
+#ifdef HT_STATS
+	uint64_t started = ht->stats != NULL ? ht_now_ns() : 0;
+#endif
 	struct _ht_item *old_items = ht->items;
-	struct _ht_item *new_items = calloc(new_cap, sizeof(struct _ht_item));
+	struct _ht_item *new_items = ht_alloc_items(new_cap);
 	if (__builtin_expect(new_items == NULL, 0)) {
 		return;
 	}
 	for (size_t i = 0; i < old_cap; i++) {
-		char *key = old_items[i].key;
-		if (key != NULL) {
-			size_t len = strlen(key);
-			ht_insert_inner(new_items, new_cap, key, len, old_items[i].value);
+		if (old_items[i].key != NULL) {
+			ht_insert_inner(new_items, new_cap, &old_items[i], ht_item_hash(ht, &old_items[i]));
 		}
 	}
 	ht->items = new_items;
 	ht->capacity = new_cap;
 	free(old_items);
+#ifdef HT_STATS
+	if (ht->stats != NULL) {
+		ht->stats->resizes++;
+		ht->stats->resize_ns += ht_now_ns() - started;
+	}
+#endif
 }
 
 void ht_resize(ht_hash_table *ht, size_t min_size) {
@@ -138,23 +469,24 @@ void ht_resize(ht_hash_table *ht, size_t min_size) {
 	ht_resize_exact(ht, old_cap, new_cap);
 }
 
+/// The smallest power-of-2 capacity that keeps `size` pairs at most 75% full,
+/// with at least one slot empty; probing relies on finding one to stop at.
+__attribute__((const, nothrow))
+static size_t ht_capacity_for(size_t size) {
+	size_t cap = 1;
+	while (cap - (cap >> 2) <= size) {
+		cap <<= 1;
+	}
+	return cap;
+}
+
 void ht_shrink_to_fit(ht_hash_table *ht) {
 	size_t old_cap = ht->capacity;
-	// round up to next power of 2
-	size_t new_cap = ht->size;
 	if (ht->size == 0) {
 		return ht_clear(ht);
 	}
-	new_cap--;
-	new_cap |= new_cap >> 1;
-	new_cap |= new_cap >> 2;
-	new_cap |= new_cap >> 4;
-	new_cap |= new_cap >> 8;
-	new_cap |= new_cap >> 16;
-	new_cap |= new_cap >> 32;
-	new_cap++;
-
-	if (new_cap == old_cap) {
+	size_t new_cap = ht_capacity_for(ht->size);
+	if (new_cap >= old_cap) {
 		return;
 	}
 	ht_resize_exact(ht, old_cap, new_cap);
@@ -164,63 +496,153 @@ bool ht_insertn(ht_hash_table *ht, const char *key, size_t key_len, const char *
 	size_t cur_index = 0;
 	bool contains = ht_find(ht, key, key_len, &cur_index);
 	if (contains) {
-		char *val_clone = strndup(value, val_len);
-		if (__builtin_expect(val_clone == NULL, 0)) {
-			return false;
-		}
-		free(ht->items[cur_index].value);
-		ht->items[cur_index].value = val_clone;
-		return true;
+		return ht_store_value(ht, &ht->items[cur_index], value, val_len);
 	}
 	return ht_insertn_unique(ht, key, key_len, value, val_len);
 }
 
 bool ht_insertn_unique(ht_hash_table *ht, const char *key, size_t key_len, const char *value, size_t val_len) {
-	char *key_clone = strndup(key, key_len), *val_clone = strndup(value, val_len);
-	if (__builtin_expect(key_clone == NULL || val_clone == NULL, 0)) {
-		// one of them is 0, so logical OR works fine for getting either
-		// (and avoids a potential branch for logical OR)
-		free((void *) ((uintptr_t) key_clone | (uintptr_t) val_clone));
+	struct _ht_item item;
+	if (__builtin_expect(!ht_store_pair(ht, &item, key, key_len, value, val_len), 0)) {
 		return false;
 	}
 	size_t cap = ht->capacity;
+	size_t mixed = ht_mix(ht, key, key_len);
 	// in case there haven't been any items added yet
 	if (__builtin_expect(cap == 0, 0)) {
-		ht->items = calloc(HT_INITIAL_CAPACITY, sizeof(struct _ht_item));
+		ht->items = ht_alloc_items(HT_INITIAL_CAPACITY);
 		if (__builtin_expect(ht->items == NULL, 0)) {
-			free(key_clone);
-			free(val_clone);
+			ht_release_pair(ht, &item);
 			return false;
 		}
 		cap = ht->capacity = HT_INITIAL_CAPACITY;
-		// no need to use `ht_insert_inner` for the first item
-		size_t idx = ht_hash(key_clone, key_len, cap);
-		ht->items[idx].key = key_clone;
-		ht->items[idx].value = val_clone;
-		return true;
+		ht->size = 1;
+		return ht_insert_inner(ht->items, cap, &item, mixed);
 	}
 	// resize on 75% capacity; expect it to have enough size, normally
 	if (__builtin_expect(ht->size++ << 2 > (cap << 1) + cap, 0)) {
 		ht_resize_exact(ht, cap, cap << 1);
-		return ht_insert_inner(ht->items, cap << 1, key_clone, key_len, val_clone);
+		return ht_insert_inner(ht->items, cap << 1, &item, mixed);
 	} else {
-		return ht_insert_inner(ht->items, cap, key_clone, key_len, val_clone);
+		return ht_insert_inner(ht->items, cap, &item, mixed);
 	}
 }
 
-bool ht_insert(ht_hash_table *ht, const char *key, const char *value) {
-	size_t key_len = strlen(key), cur_index = 0;
-	bool contains = ht_find(ht, key, key_len, &cur_index);
-	if (contains) {
-		char *val_clone;
-		if (__builtin_expect((val_clone = strdup(value)) == NULL, 0)) {
-			return false;
+/// How `ht` stores its pairs: `HT_BORROW`, `HT_ARENA` or 0 for one allocation
+/// each. Pairs can be moved between tables that store them the same way.
+__attribute__((nonnull(1), pure, nothrow))
+static inline unsigned ht_storage(const ht_hash_table *ht) {
+	return ht->flags & HT_BORROW ? HT_BORROW : ht->flags & HT_ARENA;
+}
+
+/// Moves every pair of `src` into `dest`, which has room for them all,
+/// handing over the pointers and any arena slabs; the two store pairs the
+/// same way.
+__attribute__((nonnull(1, 2), nothrow))
+static void ht_merge_moving(ht_hash_table *dest, ht_hash_table *src, bool same_hash) {
+	bool owned = ht_owns_pairs(dest);
+	for (size_t i = 0; i < src->capacity; i++) {
+		struct _ht_item *item = &src->items[i];
+		if (item->key == NULL) {
+			continue;
+		}
+		size_t mixed = same_hash ? ht_item_hash(src, item) : ht_mix(dest, item->key, item->key_len);
+		size_t index;
+		if (ht_find_mixed(dest, item->key, item->key_len, mixed, &index)) {
+			struct _ht_item *existing = &dest->items[index];
+			if (owned) {
+				free(existing->value);
+				free(item->key);
+			}
+			// the arena's copies stay in their slabs until `ht_compact`
+			existing->value = item->value;
+			existing->val_len = item->val_len;
+		} else {
+			ht_insert_inner(dest->items, dest->capacity, item, mixed);
+			dest->size++;
+		}
+		// `dest` owns the pair now, so clearing `src` mustn't free it
+		item->key = NULL;
+	}
+	if (src->slabs != NULL) {
+		// `dest`'s head slab is the one still being filled
+		struct _ht_slab *last = src->slabs;
+		while (last->next != NULL) {
+			last = last->next;
 		}
-		free(ht->items[cur_index].value);
-		ht->items[cur_index].value = val_clone;
+		if (dest->slabs != NULL) {
+			last->next = dest->slabs->next;
+			dest->slabs->next = src->slabs;
+		} else {
+			dest->slabs = src->slabs;
+		}
+		src->slabs = NULL;
+	}
+}
+
+/// Copies every pair of `src` into `dest`, which has room for them all,
+/// erasing each from `src` once it's copied, so a failed copy leaves the
+/// pairs not yet merged in `src`.
+__attribute__((nonnull(1, 2), nothrow))
+static bool ht_merge_copying(ht_hash_table *dest, ht_hash_table *src, bool same_hash) {
+	// erasing shifts later pairs back, so each slot is drained until it's
+	// empty
+	for (size_t i = 0; i < src->capacity; i++) {
+		struct _ht_item *item;
+		while ((item = &src->items[i])->key != NULL) {
+			size_t mixed = same_hash ? ht_item_hash(src, item) : ht_mix(dest, item->key, item->key_len);
+			size_t index;
+			if (ht_find_mixed(dest, item->key, item->key_len, mixed, &index)) {
+				if (__builtin_expect(!ht_store_value(dest, &dest->items[index], item->value, item->val_len), 0)) {
+					return false;
+				}
+			} else {
+				struct _ht_item copy;
+				if (__builtin_expect(!ht_store_pair(dest, &copy, item->key, item->key_len, item->value, item->val_len), 0)) {
+					return false;
+				}
+				ht_insert_inner(dest->items, dest->capacity, &copy, mixed);
+				dest->size++;
+			}
+			ht_release_pair(src, item);
+			ht_erase_at(src, i);
+			src->size--;
+		}
+	}
+	return true;
+}
+
+bool ht_merge(ht_hash_table *dest, ht_hash_table *src) {
+	if (__builtin_expect(dest == src || src->size == 0, 0)) {
 		return true;
 	}
-	return ht_insertn_unique(ht, key, key_len, value, strlen(value));
+	// `dest` would point to strings it can't keep alive
+	if (__builtin_expect((dest->flags & HT_BORROW) && !(src->flags & HT_BORROW), 0)) {
+		return false;
+	}
+	// size `dest` once, for every key of `src` being new
+	size_t total = dest->size + src->size;
+	size_t min_cap = (total * 4 + 2) / 3;
+	if (min_cap < HT_INITIAL_CAPACITY) {
+		min_cap = HT_INITIAL_CAPACITY;
+	}
+	ht_resize(dest, min_cap);
+	if (__builtin_expect(dest->capacity < min_cap, 0)) {
+		return false;
+	}
+	bool same_hash = dest->hash == src->hash && !((dest->flags ^ src->flags) & HT_HASH_MIXED);
+	if (ht_storage(dest) == ht_storage(src)) {
+		ht_merge_moving(dest, src, same_hash);
+	} else if (__builtin_expect(!ht_merge_copying(dest, src, same_hash), 0)) {
+		return false;
+	}
+	// every pair is gone, so this only frees the slots
+	ht_clear(src);
+	return true;
+}
+
+bool ht_insert(ht_hash_table *ht, const char *key, const char *value) {
+	return ht_insertn(ht, key, strlen(key), value, strlen(value));
 }
 
 bool ht_insert_unique(ht_hash_table *ht, const char *key, const char *value) {
@@ -237,25 +659,79 @@ char *ht_searchn(const ht_hash_table *ht, const char *key, size_t key_len) {
 	}
 }
 
+char *ht_searchn_len(const ht_hash_table *ht, const char *key, size_t key_len, size_t *val_len) {
+	size_t index = 0;
+	if (__builtin_expect(ht_find(ht, key, key_len, &index), 1)) {
+		val_len != NULL && (*val_len = ht->items[index].val_len);
+		return ht->items[index].value;
+	} else {
+		return NULL;
+	}
+}
+
+size_t ht_searchn_batch(const ht_hash_table *ht, size_t count, const char *const *keys, const size_t *key_lens, char **out) {
+	if (__builtin_expect(ht->capacity == 0, 0)) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = NULL;
+		}
+		return 0;
+	}
+	enum { BATCH = 16 };
+	size_t mixed[BATCH];
+	size_t found = 0;
+	for (size_t start = 0; start < count; start += BATCH) {
+		size_t batch = count - start < BATCH ? count - start : BATCH;
+		// hash the whole batch and start loading its home slots before
+		// probing any, so the cache misses overlap
+		for (size_t i = 0; i < batch; i++) {
+			mixed[i] = ht_mix(ht, keys[start + i], key_lens[start + i]);
+			__builtin_prefetch(&ht->items[ht_home(mixed[i], ht->capacity)]);
+		}
+		for (size_t i = 0; i < batch; i++) {
+			size_t index = 0;
+			if (ht_find_mixed(ht, keys[start + i], key_lens[start + i], mixed[i], &index)) {
+				out[start + i] = ht->items[index].value;
+				found++;
+			} else {
+				out[start + i] = NULL;
+			}
+		}
+	}
+	return found;
+}
+
 char *ht_search(const ht_hash_table *ht, const char *key) {
 	return ht_searchn(ht, key, strlen(key));
 }
 
 bool ht_removen(ht_hash_table *ht, const char *key, size_t key_len) {
-	char *value = ht_removen_get(ht, key, key_len);
-	// `free` on a null-pointer is a no-op, so this is safe.
-	free(value);
-	return value != NULL;
+	size_t index = 0;
+	if (__builtin_expect(ht_find(ht, key, key_len, &index), 1)) {
+		ht_release_pair(ht, &ht->items[index]);
+		ht->size--;
+		ht_erase_at(ht, index);
+		return true;
+	}
+	return false;
 }
 
 char *ht_removen_get(ht_hash_table *ht, const char *key, size_t key_len) {
 	size_t index = 0;
 	// keys being removed probably exist
 	if (__builtin_expect(ht_find(ht, key, key_len, &index), 1)) {
-		free(ht->items[index].key);
+		char *value = ht->items[index].value;
+		if (!ht_owns_pairs(ht)) {
+			// the caller frees what this returns, so it can't be in a slab
+			// or be the caller's own string
+			if (__builtin_expect((value = ht_dupn(value, ht->items[index].val_len)) == NULL, 0)) {
+				return NULL;
+			}
+		} else {
+			free(ht->items[index].key);
+		}
 		ht->size--;
-		ht->items[index].key = NULL;
-		return ht->items[index].value;
+		ht_erase_at(ht, index);
+		return value;
 	}
 	return NULL;
 }
@@ -269,36 +745,121 @@ char *ht_remove_get(ht_hash_table *ht, const char *key) {
 }
 
 ht_iter ht_iterator(const ht_hash_table *ht) {
+	return ht_iterator_range(ht, 0, ht->capacity);
+}
+
+ht_iter ht_iterator_range(const ht_hash_table *ht, size_t first, size_t last) {
+	size_t cap = ht->capacity;
+	last = last < cap ? last : cap;
 	return (ht_iter) {
-		.next = ht->items,
-		.end = ht->items + ht->capacity,
+		.items = ht->items,
+		.occupied = cap != 0 ? ht_occupied(ht->items, cap) : NULL,
+		.next = first < last ? first : last,
+		.end = last,
 	};
 }
 
-char *ht_iter_next(ht_iter *iter) {
+/// Advances `iter` past the next full slot and returns it, or returns `NULL`
+/// if there are none left. The bitmap is read afresh every time, since the
+/// caller may have removed keys since the last call.
+__attribute__((nonnull(1), nothrow))
+static inline struct _ht_item *ht_iter_advance(ht_iter *iter) {
+	size_t index = iter->next;
 	// a caller will probably stop advancing an iterator after it finishes,
 	// so most calls will probably continue to yield values
-	while (__builtin_expect(iter->next != iter->end, 1)) {
-		struct _ht_item *item = iter->next++;
-		if (item->key != NULL) {
-			return item->key;
+	while (__builtin_expect(index < iter->end, 1)) {
+		uint64_t word = iter->occupied[index >> 6] >> (index & 63);
+		if (word != 0) {
+			index += __builtin_ctzll(word);
+			if (__builtin_expect(index >= iter->end, 0)) {
+				break;
+			}
+			iter->next = index + 1;
+			return &iter->items[index];
 		}
+		index = (index | 63) + 1;
 	}
+	iter->next = iter->end;
 	return NULL;
 }
 
+char *ht_iter_next(ht_iter *iter) {
+	struct _ht_item *item = ht_iter_advance(iter);
+	return item != NULL ? item->key : NULL;
+}
+
 bool ht_iter_next_pair(ht_iter *iter, char **key, char **val) {
-	// a caller will probably stop advancing an iterator after it finishes,
-	// so most calls will probably continue to yield values
-	while (__builtin_expect(iter->next != iter->end, 1)) {
-		struct _ht_item *item = iter->next++;
+	struct _ht_item *item = ht_iter_advance(iter);
+	if (item == NULL) {
+		return false;
+	}
+	key != NULL && (*key = item->key);
+	val != NULL && (*val = item->value);
+	return true;
+}
+
+bool ht_iter_next_pairn(ht_iter *iter, char **key, size_t *key_len, char **val, size_t *val_len) {
+	struct _ht_item *item = ht_iter_advance(iter);
+	if (item == NULL) {
+		return false;
+	}
+	key != NULL && (*key = item->key);
+	key_len != NULL && (*key_len = item->key_len);
+	val != NULL && (*val = item->value);
+	val_len != NULL && (*val_len = item->val_len);
+	return true;
+}
+
+size_t ht_bucketn(const ht_hash_table *ht, const char *key, size_t key_len) {
+	if (ht->capacity == 0) {
+		return 0;
+	}
+	return ht_home(ht_mix(ht, key, key_len), ht->capacity);
+}
+
+size_t ht_bucket(const ht_hash_table *ht, const char *key) {
+	return ht_bucketn(ht, key, strlen(key));
+}
+
+size_t ht_bucket_size(const ht_hash_table *ht, size_t n) {
+	size_t cap = ht->capacity;
+	size_t count = 0;
+	if (n >= cap) {
+		return 0;
+	}
+	// every key whose home is `n` is before the next empty slot
+	for (size_t index = n; ht->items[index].key != NULL; index = (index + 1) & (cap - 1)) {
+		count += ht_home(ht_item_hash(ht, &ht->items[index]), cap) == n;
+	}
+	return count;
+}
+
+ht_cluster_stats ht_clusters(const ht_hash_table *ht) {
+	ht_cluster_stats out = { .entries = ht->size };
+	size_t cap = ht->capacity;
+	if (ht->size == 0) {
+		return out;
+	}
+	// start just past an empty slot, so no cluster wraps around the end
+	size_t start = 0;
+	while (ht->items[start].key != NULL) {
+		start++;
+	}
+	size_t run = 0;
+	for (size_t n = 0, index = (start + 1) & (cap - 1); n < cap; n++, index = (index + 1) & (cap - 1)) {
+		const struct _ht_item *item = &ht->items[index];
 		if (item->key != NULL) {
-			key != NULL && (*key = item->key);
-			val != NULL && (*val = item->value);
-			return true;
+			size_t displacement = (index - ht_home(ht_item_hash(ht, item), cap)) & (cap - 1);
+			out.max_displacement = displacement > out.max_displacement ? displacement : out.max_displacement;
+			out.total_displacement += displacement;
+			run++;
+		} else if (run != 0) {
+			out.clusters++;
+			out.longest_cluster = run > out.longest_cluster ? run : out.longest_cluster;
+			run = 0;
 		}
 	}
-	return false;
+	return out;
 }
 
 /// Much simpler version of `ht_json_stringify` in the event `out` is `NULL`, to
@@ -307,12 +868,12 @@ __attribute__((nonnull(1), nothrow))
 static size_t ht_json_dry_run(const ht_hash_table *ht) {
 	size_t len = 1;
 	ht_iter iter = ht_iterator(ht);
-	char *key, *val;
-	while (ht_iter_next_pair(&iter, &key, &val)) {
+	size_t key_len, val_len;
+	while (ht_iter_next_pairn(&iter, NULL, &key_len, NULL, &val_len)) {
 		len++; // quote
-		len += strlen(key);
+		len += key_len;
 		len += 3; // close quote, colon, open quote
-		len += strlen(val);
+		len += val_len;
 		len += 2; // close quote, comma
 	}
 	// closing comma becomes closing bracket for length
@@ -335,8 +896,8 @@ size_t ht_json_stringify(const ht_hash_table *ht, char **out) {
 
 	ht_iter iter = ht_iterator(ht);
 	char *key, *val;
-	while (ht_iter_next_pair(&iter, &key, &val)) {
-		size_t key_len = strlen(key), val_len = strlen(val);
+	size_t key_len, val_len;
+	while (ht_iter_next_pairn(&iter, &key, &key_len, &val, &val_len)) {
 		while (pos + key_len + val_len + 6 > cap) {
 			// test no overflow
 			assert(cap * 2 > cap);
@@ -377,15 +938,14 @@ static size_t ht_json_dry_run_escape(const ht_hash_table *ht) {
 	size_t len = 1;
 	ht_iter iter = ht_iterator(ht);
 	char *key, *val;
-	while (ht_iter_next_pair(&iter, &key, &val)) {
+	size_t key_len, val_len;
+	while (ht_iter_next_pairn(&iter, &key, &key_len, &val, &val_len)) {
 		len++; // quote
-		size_t key_len = strlen(key);
 		len += key_len;
 		for (size_t i = 0; i < key_len; i++) {
 			len += key[i] == '"';
 		}
 		len += 3; // close quote, colon, open quote
-		size_t val_len = strlen(val);
 		len += val_len;
 		for (size_t i = 0; i < val_len; i++) {
 			len += val[i] == '"';
@@ -411,10 +971,9 @@ size_t ht_json_stringify_escape(const ht_hash_table *ht, char **out) {
 	size_t pos = 1;
 
 	ht_iter iter = ht_iterator(ht);
-	char *key, *val;
-	while (ht_iter_next_pair(&iter, &key, &val)) {
-		char *base_key = key, *base_val = val;
-		size_t key_len = strlen(key), val_len = strlen(val);
+	char *key, *val, *quote;
+	size_t key_len, val_len;
+	while (ht_iter_next_pairn(&iter, &key, &key_len, &val, &val_len)) {
 		// Double length of key/value length for determining capacity,
 		// in the event the key or value consists only of quotes.
 		while (pos + key_len * 2 + val_len * 2 + 6 > cap) {
@@ -428,32 +987,30 @@ size_t ht_json_stringify_escape(const ht_hash_table *ht, char **out) {
 			buf = new_buf;
 		}
 		buf[pos++] = '"';
-		while ((key = strchr(key, '"')) != NULL) {
-			size_t diff = key - base_key;
-			memcpy(buf + pos, base_key, diff);
+		while ((quote = memchr(key, '"', key_len)) != NULL) {
+			size_t diff = quote - key;
+			memcpy(buf + pos, key, diff);
 			pos += diff;
-			key_len -= diff;
-			key_len--;
-			base_key = ++key;
+			key_len -= diff + 1;
+			key = quote + 1;
 			buf[pos++] = '\\';
 			buf[pos++] = '"';
 		}
-		memcpy(buf + pos, base_key, key_len);
+		memcpy(buf + pos, key, key_len);
 		pos += key_len;
 		buf[pos++] = '"';
 		buf[pos++] = ':';
 		buf[pos++] = '"';
-		while ((val = strchr(val, '"')) != NULL) {
-			size_t diff = val - base_val;
-			memcpy(buf + pos, base_val, diff);
+		while ((quote = memchr(val, '"', val_len)) != NULL) {
+			size_t diff = quote - val;
+			memcpy(buf + pos, val, diff);
 			pos += diff;
-			val_len -= diff;
-			val_len--;
-			base_val = ++val;
+			val_len -= diff + 1;
+			val = quote + 1;
 			buf[pos++] = '\\';
 			buf[pos++] = '"';
 		}
-		memcpy(buf + pos, base_val, val_len);
+		memcpy(buf + pos, val, val_len);
 		pos += val_len;
 		buf[pos++] = '"';
 		buf[pos++] = ',';
@@ -468,3 +1025,460 @@ size_t ht_json_stringify_escape(const ht_hash_table *ht, char **out) {
 	*out = buf;
 	return pos;
 }
+
+/// Bytes `ht_json_write` collects before passing them to its sink.
+enum { HT_JSON_CHUNK = 16 * 1024 };
+
+/** \internal Output of `ht_json_write` on its way to the sink. */
+struct ht_json_out {
+	ht_json_sink sink;
+	void *ctx;
+	size_t used;
+	size_t total;
+	bool failed;
+	char buf[HT_JSON_CHUNK];
+};
+
+__attribute__((nonnull(1), nothrow))
+static void ht_json_flush(struct ht_json_out *out) {
+	if (out->used != 0 && !out->failed) {
+		out->failed = !out->sink(out->ctx, out->buf, out->used);
+	}
+	out->used = 0;
+}
+
+/// `ht_json_put` for data that doesn't fit in what's left of the buffer.
+__attribute__((nonnull(1, 2), nothrow, noinline, cold))
+static void ht_json_put_flushing(struct ht_json_out *out, const char *data, size_t len) {
+	ht_json_flush(out);
+	if (len < HT_JSON_CHUNK) {
+		memcpy(out->buf, data, len);
+		out->used = len;
+	} else if (!out->failed) {
+		// too big to be worth copying; the sink can take it as it is
+		out->failed = !out->sink(out->ctx, data, len);
+	}
+}
+
+__attribute__((nonnull(1, 2), nothrow))
+static inline void ht_json_put(struct ht_json_out *out, const char *data, size_t len) {
+	out->total += len;
+	if (__builtin_expect(len <= HT_JSON_CHUNK - out->used, 1)) {
+		memcpy(out->buf + out->used, data, len);
+		out->used += len;
+	} else {
+		ht_json_put_flushing(out, data, len);
+	}
+}
+
+__attribute__((nonnull(1), nothrow))
+static inline void ht_json_putc(struct ht_json_out *out, char c) {
+	if (__builtin_expect(out->used == HT_JSON_CHUNK, 0)) {
+		ht_json_flush(out);
+	}
+	out->buf[out->used++] = c;
+	out->total++;
+}
+
+/// Whether any byte of `word` is one a JSON string can't hold as it is:
+/// a quote, a backslash, or below 0x20.
+__attribute__((const, nothrow))
+static inline bool ht_json_special64(uint64_t word) {
+	const uint64_t ones = 0x0101010101010101ull, high = 0x8080808080808080ull;
+	uint64_t quote = word ^ (ones * '"'), backslash = word ^ (ones * '\\');
+	// `(x - ones) & ~x` sets some high bit exactly when `x` has a zero byte
+	// (though borrows can set it in later bytes too, so it can't say which);
+	// subtracting `0x20`s does the same for bytes below 0x20
+	uint64_t special = ((quote - ones) & ~quote) | ((backslash - ones) & ~backslash) | ((word - ones * 0x20) & ~word);
+	return (special & high) != 0;
+}
+
+/// `ht_json_plain_run` one byte at a time, from `i`.
+__attribute__((nonnull(1), pure, nothrow))
+static size_t ht_json_plain_bytes(const char *s, size_t i, size_t len) {
+	for (; i < len; i++) {
+		unsigned char c = (unsigned char) s[i];
+		if (c == '"' || c == '\\' || c < 0x20) {
+			break;
+		}
+	}
+	return i;
+}
+
+#if defined(__SSE2__)
+/// Bits set for the bytes of `bytes` a JSON string can't hold as they are.
+__attribute__((const, nothrow))
+static inline uint32_t ht_json_special16(__m128i bytes) {
+	const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1f);
+	// a byte is at most 0x1f if raising it to 0x1f leaves it there
+	__m128i special = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, backslash)),
+		_mm_cmpeq_epi8(_mm_max_epu8(bytes, control), control)
+	);
+	return (uint32_t) _mm_movemask_epi8(special);
+}
+#endif
+#if defined(__AVX2__)
+__attribute__((const, nothrow))
+static inline uint32_t ht_json_special32(__m256i bytes) {
+	const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\'), control = _mm256_set1_epi8(0x1f);
+	__m256i special = _mm256_or_si256(
+		_mm256_or_si256(_mm256_cmpeq_epi8(bytes, quote), _mm256_cmpeq_epi8(bytes, backslash)),
+		_mm256_cmpeq_epi8(_mm256_max_epu8(bytes, control), control)
+	);
+	return (uint32_t) _mm256_movemask_epi8(special);
+}
+#endif
+
+/// The number of bytes at the start of `s` a JSON string can hold as they
+/// are: anything but quotes, backslashes and control characters. Checks 32
+/// bytes at a time with AVX2, or 16 with SSE2, finishing with one check of
+/// the last 32 or 16 bytes (overlapping ones already checked, which can't
+/// match); shorter strings, and other targets, go 8 bytes at a time in a
+/// `uint64_t`. Bytes are only looked at one by one around a match.
+__attribute__((nonnull(1), pure, nothrow))
+static size_t ht_json_plain_run(const char *s, size_t len) {
+	size_t i = 0;
+	uint32_t mask;
+#if defined(__AVX2__)
+	if (len >= 32) {
+		for (; i + 32 <= len; i += 32) {
+			if ((mask = ht_json_special32(_mm256_loadu_si256((const __m256i *) (s + i)))) != 0) {
+				return i + __builtin_ctz(mask);
+			}
+		}
+		if (i == len) {
+			return len;
+		}
+		mask = ht_json_special32(_mm256_loadu_si256((const __m256i *) (s + len - 32)));
+		return mask != 0 ? len - 32 + __builtin_ctz(mask) : len;
+	}
+#endif
+#if defined(__SSE2__)
+	if (len >= 16) {
+		for (; i + 16 <= len; i += 16) {
+			if ((mask = ht_json_special16(_mm_loadu_si128((const __m128i *) (s + i)))) != 0) {
+				return i + __builtin_ctz(mask);
+			}
+		}
+		if (i == len) {
+			return len;
+		}
+		mask = ht_json_special16(_mm_loadu_si128((const __m128i *) (s + len - 16)));
+		return mask != 0 ? len - 16 + __builtin_ctz(mask) : len;
+	}
+#endif
+	(void) mask;
+	uint64_t word;
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&word, s + i, sizeof(word));
+		if (ht_json_special64(word)) {
+			return ht_json_plain_bytes(s, i, len);
+		}
+	}
+	if (i == len) {
+		return len;
+	}
+	// what's left is checked as one more word, made of bytes already
+	// checked if need be, so short strings don't go byte by byte
+	if (len >= 8) {
+		memcpy(&word, s + len - 8, sizeof(word));
+	} else if (len >= 4) {
+		uint32_t low, high;
+		memcpy(&low, s, sizeof(low));
+		memcpy(&high, s + len - 4, sizeof(high));
+		word = ((uint64_t) high << 32) | low;
+	} else {
+		return ht_json_plain_bytes(s, i, len);
+	}
+	return ht_json_special64(word) ? ht_json_plain_bytes(s, i, len) : len;
+}
+
+/// Writes `s` as the inside of a JSON string.
+__attribute__((nonnull(1, 2), nothrow))
+static void ht_json_put_escaped(struct ht_json_out *out, const char *s, size_t len) {
+	static const char hex[] = "0123456789abcdef";
+	while (true) {
+		size_t run = ht_json_plain_run(s, len);
+		ht_json_put(out, s, run);
+		if (run == len) {
+			return;
+		}
+		unsigned char c = (unsigned char) s[run];
+		char escaped[6] = { '\\', (char) c, '0', '0', hex[c >> 4], hex[c & 0xf] };
+		size_t escaped_len = 2;
+		switch (c) {
+		case '"': case '\\': break;
+		case '\b': escaped[1] = 'b'; break;
+		case '\f': escaped[1] = 'f'; break;
+		case '\n': escaped[1] = 'n'; break;
+		case '\r': escaped[1] = 'r'; break;
+		case '\t': escaped[1] = 't'; break;
+		default:
+			escaped[1] = 'u';
+			escaped_len = 6;
+		}
+		ht_json_put(out, escaped, escaped_len);
+		s += run + 1;
+		len -= run + 1;
+	}
+}
+
+size_t ht_json_write(const ht_hash_table *ht, bool escape, ht_json_sink sink, void *ctx) {
+	struct ht_json_out out = {
+		.sink = sink,
+		.ctx = ctx,
+	};
+	ht_json_putc(&out, '{');
+	ht_iter iter = ht_iterator(ht);
+	char *key, *val;
+	size_t key_len, val_len;
+	// once the sink fails, there's no point producing more
+	while (!out.failed && ht_iter_next_pairn(&iter, &key, &key_len, &val, &val_len)) {
+		if (out.total != 1) {
+			ht_json_putc(&out, ',');
+		}
+		ht_json_putc(&out, '"');
+		escape ? ht_json_put_escaped(&out, key, key_len) : ht_json_put(&out, key, key_len);
+		ht_json_put(&out, "\":\"", 3);
+		escape ? ht_json_put_escaped(&out, val, val_len) : ht_json_put(&out, val, val_len);
+		ht_json_putc(&out, '"');
+	}
+	ht_json_putc(&out, '}');
+	ht_json_flush(&out);
+	return out.failed ? 0 : out.total;
+}
+
+#ifdef HT_POSIX
+bool ht_json_fd_sink(void *fd, const char *data, size_t len) {
+	while (len != 0) {
+		ssize_t written = write(*(const int *) fd, data, len);
+		if (__builtin_expect(written < 0, 0)) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		len -= (size_t) written;
+	}
+	return true;
+}
+#endif
+
+_Static_assert(sizeof(ht_snapshot_header) == 64, "snapshot headers have no padding");
+_Static_assert(sizeof(ht_snapshot_slot) == 32, "snapshot slots have no padding");
+
+bool ht_snapshot_write(const ht_hash_table *ht, FILE *out) {
+	size_t cap = ht_capacity_for(ht->size);
+	ht_snapshot_slot *slots = calloc(cap, sizeof(ht_snapshot_slot));
+	if (__builtin_expect(slots == NULL, 0)) {
+		return false;
+	}
+	// the heap starts with a NUL, so no key is at offset 0
+	uint64_t heap_size = 1;
+	ht_iter iter = ht_iterator(ht);
+	char *key, *val;
+	size_t key_len, val_len;
+	while (ht_iter_next_pairn(&iter, &key, &key_len, NULL, &val_len)) {
+		uint64_t hash = ht_hash_bytes(key, key_len, 0);
+		size_t index = ht_home(hash, cap);
+		while (slots[index].key != 0) {
+			index = (index + 1) & (cap - 1);
+		}
+		slots[index] = (ht_snapshot_slot) {
+			.hash = hash,
+			.key = heap_size,
+			.key_len = key_len,
+			.val_len = val_len,
+		};
+		heap_size += key_len + val_len + 2;
+	}
+	ht_snapshot_header header = {
+		.magic = HT_SNAPSHOT_MAGIC,
+		.version = HT_SNAPSHOT_VERSION,
+		.byte_order = HT_SNAPSHOT_BYTE_ORDER,
+		.kind = HT_SNAPSHOT_STRINGS,
+		.slot_size = sizeof(ht_snapshot_slot),
+		.capacity = cap,
+		.size = ht->size,
+		.slots_offset = sizeof(ht_snapshot_header),
+		.heap_size = heap_size,
+	};
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+		&& fwrite(slots, sizeof(ht_snapshot_slot), cap, out) == cap
+		&& fputc('\0', out) != EOF;
+	free(slots);
+	// the pairs go in the order the slots were given their offsets
+	iter = ht_iterator(ht);
+	while (ok && ht_iter_next_pairn(&iter, &key, &key_len, &val, &val_len)) {
+		ok = fwrite(key, 1, key_len, out) == key_len
+			&& fputc('\0', out) != EOF
+			&& fwrite(val, 1, val_len, out) == val_len
+			&& fputc('\0', out) != EOF;
+	}
+	return ok;
+}
+
+bool ht_snapshot_view(ht_snapshot *snap, const void *data, size_t len) {
+	const ht_snapshot_header *header = data;
+	if (len < sizeof(ht_snapshot_header) || (uintptr_t) data % _Alignof(ht_snapshot_slot) != 0) {
+		return false;
+	}
+	if (memcmp(header->magic, HT_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+		|| header->version != HT_SNAPSHOT_VERSION
+		|| header->byte_order != HT_SNAPSHOT_BYTE_ORDER
+		|| header->kind != HT_SNAPSHOT_STRINGS
+		|| header->slot_size != sizeof(ht_snapshot_slot)
+		|| header->slots_offset != sizeof(ht_snapshot_header)) {
+		return false;
+	}
+	uint64_t cap = header->capacity;
+	size_t room = len - sizeof(ht_snapshot_header);
+	// only the header is checked, so opening never touches the slots; each
+	// slot is checked as lookups reach it
+	if (cap == 0 || (cap & (cap - 1)) != 0 || header->size >= cap
+		|| cap > room / sizeof(ht_snapshot_slot)
+		|| header->heap_size == 0 || header->heap_size != room - cap * sizeof(ht_snapshot_slot)) {
+		return false;
+	}
+	const ht_snapshot_slot *slots = (const ht_snapshot_slot *) ((const char *) data + sizeof(ht_snapshot_header));
+	*snap = (ht_snapshot) {
+		.capacity = cap,
+		.size = header->size,
+		.slots = slots,
+		.heap = (const char *) (slots + cap),
+		.heap_size = header->heap_size,
+	};
+	return true;
+}
+
+bool ht_snapshot_open(ht_snapshot *snap, const char *path) {
+	size_t len;
+	void *map;
+#ifdef HT_POSIX
+	int fd = open(path, O_RDONLY);
+	if (__builtin_expect(fd < 0, 0)) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uintmax_t) st.st_size > SIZE_MAX) {
+		close(fd);
+		return false;
+	}
+	len = (size_t) st.st_size;
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (__builtin_expect(map == MAP_FAILED, 0)) {
+		return false;
+	}
+	// lookups land all over the file, so reading ahead only wastes I/O
+	posix_madvise(map, len, POSIX_MADV_RANDOM);
+#else
+	FILE *in = fopen(path, "rb");
+	if (__builtin_expect(in == NULL, 0)) {
+		return false;
+	}
+	long end;
+	if (fseek(in, 0, SEEK_END) != 0 || (end = ftell(in)) <= 0 || fseek(in, 0, SEEK_SET) != 0) {
+		fclose(in);
+		return false;
+	}
+	len = (size_t) end;
+	map = malloc(len);
+	if (__builtin_expect(map == NULL, 0) || fread(map, 1, len, in) != len) {
+		free(map);
+		fclose(in);
+		return false;
+	}
+	fclose(in);
+#endif
+	if (!ht_snapshot_view(snap, map, len)) {
+#ifdef HT_POSIX
+		munmap(map, len);
+#else
+		free(map);
+#endif
+		return false;
+	}
+	snap->map = map;
+	snap->map_len = len;
+	return true;
+}
+
+void ht_snapshot_close(ht_snapshot *snap) {
+	if (snap->map != NULL) {
+#ifdef HT_POSIX
+		munmap(snap->map, snap->map_len);
+#else
+		free(snap->map);
+#endif
+	}
+	memset(snap, 0, sizeof(ht_snapshot));
+}
+
+/// Finds the key and value `slot` points to, returning `false` if they
+/// aren't within `snap`'s heap or either one's NUL is missing.
+__attribute__((nonnull(1, 2, 3), nothrow))
+static inline bool ht_snapshot_pair(const ht_snapshot *snap, const ht_snapshot_slot *slot, const char **key) {
+	if (__builtin_expect(slot->key >= snap->heap_size, 0)) {
+		return false;
+	}
+	// the key, value and their NULs have to fit in what's left of the heap
+	uint64_t room = snap->heap_size - slot->key;
+	if (__builtin_expect(slot->key_len >= room || slot->val_len >= room - slot->key_len - 1, 0)) {
+		return false;
+	}
+	// and the NULs have to be there, or `strlen` on either runs off the end
+	const char *stored = snap->heap + slot->key;
+	if (__builtin_expect(stored[slot->key_len] != '\0' || stored[slot->key_len + 1 + slot->val_len] != '\0', 0)) {
+		return false;
+	}
+	*key = stored;
+	return true;
+}
+
+const char *ht_snapshot_searchn(const ht_snapshot *snap, const char *key, size_t key_len, size_t *val_len) {
+	size_t cap = snap->capacity;
+	if (__builtin_expect(cap == 0, 0)) {
+		return NULL;
+	}
+	uint64_t hash = ht_hash_bytes(key, key_len, 0);
+	size_t index = ht_home(hash, cap);
+	// a damaged snapshot may have no empty slot to stop at
+	for (size_t probes = 0; probes < cap; probes++) {
+		const ht_snapshot_slot *slot = &snap->slots[index];
+		if (slot->key == 0) {
+			return NULL;
+		}
+		const char *stored;
+		if (slot->hash == hash && slot->key_len == key_len && ht_snapshot_pair(snap, slot, &stored)
+			&& memcmp(stored, key, key_len) == 0) {
+			val_len != NULL && (*val_len = slot->val_len);
+			return stored + key_len + 1;
+		}
+		index = (index + 1) & (cap - 1);
+	}
+	return NULL;
+}
+
+const char *ht_snapshot_search(const ht_snapshot *snap, const char *key) {
+	return ht_snapshot_searchn(snap, key, strlen(key), NULL);
+}
+
+bool ht_snapshot_load(const ht_snapshot *snap, ht_hash_table *ht) {
+	// grow once up front rather than doubling through the inserts
+	ht_resize(ht, (ht->size + snap->size) / 3 * 4 + 4);
+	for (size_t i = 0; i < snap->capacity; i++) {
+		const ht_snapshot_slot *slot = &snap->slots[i];
+		const char *key;
+		if (slot->key == 0) {
+			continue;
+		}
+		if (!ht_snapshot_pair(snap, slot, &key)
+			|| !ht_insertn(ht, key, slot->key_len, key + slot->key_len + 1, slot->val_len)) {
+			return false;
+		}
+	}
+	return true;
+}
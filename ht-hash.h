@@ -3,21 +3,131 @@
  * \brief A hash table implementation.
  *
  * A simple hash table in C. Only supports string keys and string values.
+ *
+ * Every item stores the lengths of its key and value, so lookups skip keys of
+ * a different length without comparing them, and resizing and serializing
+ * never call `strlen`. Through the `n` functions, keys and values may contain
+ * NUL bytes; everything stored still gets a terminating NUL, so values read
+ * through the other functions stay usable as C strings.
+ *
+ * Tables whose `flags` include `HT_ARENA` copy keys and values into large
+ * slabs rather than making two allocations per pair, so `ht_clear` only frees a
+ * few slabs. Removed or replaced pairs keep their slab space until
+ * `ht_compact` is called. With `HT_BORROW`, the table stores the caller's
+ * pointers instead of copies.
+ *
+ * Keys are hashed with `ht_hash_bytes` from ht-bytes-hash.h, which C++'s
+ * `BytesHash` also uses, unless the table's `hash` hook is set.
+ *
+ * Defining `HT_CACHE_HASH` when compiling ht-hash.c stores each key's full
+ * hash next to it. Resizing then never rehashes keys, and lookups only compare
+ * keys whose hashes match, at the cost of a `size_t` per slot. The table's
+ * layout is private, so this doesn't change the API.
+ *
+ * `ht_snapshot_write` saves a table in the binary format of ht-snapshot.h,
+ * which `ht_snapshot_open` maps back into memory as a read-only
+ * `ht_snapshot`; lookups then read the file's pages in place, so opening one
+ * takes the same time however large it is.
  */
 
 #pragma once
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ht-snapshot.h"
+
+/**
+ * \internal
+ * Marks the lookup functions `pure`, except when `HT_STATS` is defined: they
+ * then add to the table's `stats`, so calls to them mustn't be merged or
+ * dropped.
+ */
+#ifdef HT_STATS
+#define HT_PURE
+#else
+#define HT_PURE __attribute__((pure))
+#endif
 
 /** \internal */
 struct _ht_item;
+/** \internal */
+struct _ht_slab;
+
+/**
+ * \brief Flags for the `flags` field of `ht_hash_table`.
+ */
+enum {
+	/// Store keys and values in slabs owned by the table. Must be set before
+	/// anything is inserted; `ht_clear` keeps it set.
+	HT_ARENA = 1 << 0,
+	/// Store the caller's key and value pointers without copying them, and
+	/// never free them; the strings have to outlive their time in the table.
+	/// Strings returned by searching and iterating are then the caller's
+	/// bytes, which are only NUL-terminated if the caller's were. Takes
+	/// precedence over `HT_ARENA`; like it, must be set before inserting.
+	HT_BORROW = 1 << 1,
+	/// Every bit of the `hash` hook's results is already well mixed, as with
+	/// precomputed fingerprints, so they're used as they are instead of being
+	/// multiplied out first. Like the hook, must be set before inserting.
+	HT_HASH_MIXED = 1 << 2,
+};
+
+enum {
+	/// Buckets in each of `ht_stats`' probe-length histograms.
+	HT_STATS_BUCKETS = 16,
+};
+
+/**
+ * \struct ht_stats
+ * \brief Counters a table keeps when built with `HT_STATS`.
+ *
+ * With `ht-hash.c` compiled with `HT_STATS` defined, a table whose `stats`
+ * points to one of these adds to it as it's used; otherwise it's never
+ * touched. Code calling the lookup functions has to be compiled with
+ * `HT_STATS` too, or they're declared `pure` and repeated calls may be
+ * merged into one, counting only once. A lookup's probe length is how many slots past the key's home slot
+ * it went before finding the key (for `hits`) or an empty slot (for `misses`),
+ * and bucket `b` counts the lookups whose probe length has `b` significant
+ * bits: 0 for 0, 1 for 1, 2 for 2 to 3, 3 for 4 to 7 and so on, with the last
+ * bucket also taking anything longer. Inserts and removals count as lookups.
+ */
+typedef struct {
+	uint64_t hits[HT_STATS_BUCKETS];
+	uint64_t misses[HT_STATS_BUCKETS];
+	/// The longest probe of any lookup.
+	size_t longest_probe;
+	/// How many times the slot array was reallocated.
+	uint64_t resizes;
+	/// Nanoseconds spent reallocating it and moving every pair.
+	uint64_t resize_ns;
+} ht_stats;
+
+/**
+ * \struct ht_cluster_stats
+ * \brief How a table's pairs are laid out, from `ht_clusters`.
+ *
+ * A cluster is a run of full slots between two empty ones, and a pair's
+ * displacement is how many slots past its home slot it sits, which is how far
+ * a lookup for it has to probe. A good hash keeps both short.
+ */
+typedef struct {
+	size_t entries;
+	size_t clusters;
+	size_t longest_cluster;
+	size_t max_displacement;
+	/// Divided by `entries`, the mean displacement.
+	size_t total_displacement;
+} ht_cluster_stats;
 
 /**
  * \struct ht_hash_table
  * \brief The hash table class.
  *
- * A hash table for string keys and values. Should be zero-initialized.
+ * A hash table for string keys and values. Should be zero-initialized, apart
+ * from `flags`, e.g. `ht_hash_table table = { .flags = HT_ARENA };`.
  * `_ht_item` is intentionally kept opaque; access to stored values should only
  * be through `ht` functions.
  * `ht_clear` should be called before a table exits scope if any values were
@@ -27,6 +137,18 @@ typedef struct {
 	size_t capacity;
 	size_t size;
 	struct _ht_item *items;
+	/// `HT_` flags controlling how pairs are stored.
+	unsigned flags;
+	/// Hashes keys in place of `ht_hash_bytes` if non-`NULL`. Has to be set
+	/// before inserting, and must give equal keys equal hashes without side
+	/// effects; only its high bits need to vary, and keys may contain NULs.
+	/// `ht_clear` keeps it set.
+	size_t (*hash)(const char *key, size_t key_len);
+	/// Counters to add to if non-`NULL` and `ht-hash.c` was built with
+	/// `HT_STATS`; `ht_clear` keeps it set.
+	ht_stats *stats;
+	/** \internal */
+	struct _ht_slab *slabs;
 } ht_hash_table;
 
 /**
@@ -36,10 +158,39 @@ typedef struct {
  * An iterator over a hash table. Created through the `ht_iterator` function.
  */
 typedef struct {
-	struct _ht_item *next;
-	struct _ht_item *end;
+	/** \internal */
+	struct _ht_item *items;
+	/** \internal */
+	const uint64_t *occupied;
+	/** \internal */
+	size_t next;
+	/** \internal */
+	size_t end;
 } ht_iter;
 
+/**
+ * \struct ht_snapshot
+ * \brief A read-only table in a binary snapshot.
+ *
+ * Created by `ht_snapshot_open` or `ht_snapshot_view`, searched with
+ * `ht_snapshot_searchn`, and released with `ht_snapshot_close`. Its fields
+ * point into the snapshot itself, and nothing is ever written through them.
+ */
+typedef struct {
+	size_t capacity;
+	size_t size;
+	/** \internal */
+	const ht_snapshot_slot *slots;
+	/** \internal */
+	const char *heap;
+	/** \internal */
+	size_t heap_size;
+	/** \internal The mapping or buffer `ht_snapshot_open` made, if any. */
+	void *map;
+	/** \internal */
+	size_t map_len;
+} ht_snapshot;
+
 #ifndef MAKE_DOCS
 __attribute__((nonnull(1), nothrow))
 #endif
@@ -47,9 +198,9 @@ __attribute__((nonnull(1), nothrow))
  * \brief Removes all items from `ht`.
  *
  * Removes all items from `ht`, freeing the memory associated with them and
- * resetting `size` and `capacity` to 0. Must be called to avoid memory leaks
- * before letting a hash table leave scope, if any values were added to the
- * table.
+ * resetting `size` and `capacity` to 0. `flags`, `hash` and `stats` are kept.
+ * Must be called to avoid memory leaks before letting a hash table leave
+ * scope, if any values were added to the table.
  *
  * \memberof ht_hash_table
  * \param ht The hash table to clear
@@ -57,7 +208,7 @@ __attribute__((nonnull(1), nothrow))
 void ht_clear(ht_hash_table *ht);
 
 #ifndef MAKE_DOCS
-__attribute__((nonnull(1, 2), nothrow, pure))
+__attribute__((nonnull(1, 2), nothrow)) HT_PURE
 #endif
 /**
  * \brief Tests if `ht` contains `key`, with specified key length.
@@ -72,7 +223,7 @@ __attribute__((nonnull(1, 2), nothrow, pure))
 bool ht_containsn(const ht_hash_table *ht, const char *key, size_t key_len);
 
 #ifndef MAKE_DOCS
-__attribute__((nonnull(1, 2), nothrow, pure))
+__attribute__((nonnull(1, 2), nothrow)) HT_PURE
 #endif
 /**
  * \brief Tests if `ht` contains `key`.
@@ -108,15 +259,33 @@ __attribute__((nonnull(1), nothrow))
 /**
  * \brief Shrinks `ht` to the smallest size it can be.
  *
- * Reduces the capacity of `ht` to the smallest that can hold all of its items.
- * Note that, as currently implemented, capacity has to be a power of two, so
- * capacity may still end up significantly larger than the number of items.
+ * Reduces the capacity of `ht` to the smallest that can hold all of its items
+ * while keeping it at most 75% full, as inserting does. Note that, as
+ * currently implemented, capacity has to be a power of two, so capacity may
+ * still end up significantly larger than the number of items.
  *
  * \memberof ht_hash_table
  * \param ht The table to resize
  */
 void ht_shrink_to_fit(ht_hash_table *ht);
 
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1), nothrow))
+#endif
+/**
+ * \brief Reclaims arena space held by removed or replaced pairs.
+ *
+ * Copies every pair in `ht` into one slab and frees the old slabs, so memory
+ * freed by `ht_remove` or by replacing values can be reused. Moves every key
+ * and value, so pointers from `ht_search` or iterators are invalidated. Returns
+ * `false` and leaves `ht` unchanged if allocation fails; does nothing and
+ * returns `true` unless `ht` is in `HT_ARENA` mode without `HT_BORROW`.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table to compact
+ */
+bool ht_compact(ht_hash_table *ht);
+
 #ifndef MAKE_DOCS
 __attribute__((nonnull(1, 2, 4), nothrow))
 #endif
@@ -197,7 +366,32 @@ __attribute__((nonnull(1, 2, 3), nothrow))
 bool ht_insert_unique(ht_hash_table *ht, const char *key, const char *value);
 
 #ifndef MAKE_DOCS
-__attribute__((nonnull(1, 2), nothrow, pure))
+__attribute__((nonnull(1, 2), nothrow))
+#endif
+/**
+ * \brief Moves every pair of `src` into `dest`.
+ *
+ * Pairs whose key `dest` already has replace its values. `dest` is resized at
+ * most once, for all of `src`'s pairs; if the two tables hash keys the same
+ * way (the same `hash` hook and `HT_HASH_MIXED` flag), hashes `ht-hash.c`
+ * caches are reused, and if they store pairs the same way (by their
+ * `HT_ARENA` and `HT_BORROW` flags), the pairs are handed over without being
+ * copied, arena slabs and all. `src` is left empty, keeping its flags, `hash`
+ * and `stats`.
+ *
+ * Returns `true` on success and `false` on error, in which case the pairs not
+ * yet merged are still in `src`. An `HT_BORROW` table can only merge another
+ * one, since it couldn't keep `src`'s copies alive; otherwise, `false` is
+ * returned without merging anything.
+ *
+ * \memberof ht_hash_table
+ * \param dest The table to merge into
+ * \param src The table to empty into `dest`
+ */
+bool ht_merge(ht_hash_table *dest, ht_hash_table *src);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow)) HT_PURE
 #endif
 /**
  * \brief Returns the value associated with `key`, with specified key length.
@@ -213,7 +407,49 @@ __attribute__((nonnull(1, 2), nothrow, pure))
 char *ht_searchn(const ht_hash_table *ht, const char *key, size_t key_len);
 
 #ifndef MAKE_DOCS
-__attribute__((nonnull(1, 2), nothrow, pure))
+__attribute__((nonnull(1, 2), nothrow))
+#endif
+/**
+ * \brief Returns the value associated with `key` and its length, with
+ * specified key length.
+ *
+ * Looks up `key` in `ht` and returns the associated value, or `NULL` if the key
+ * doesn't exist in `ht`. If the key exists and `val_len` is non-`NULL`, it's
+ * set to the length the value was inserted with, which is needed for values
+ * that contain NUL bytes.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table to search through
+ * \param key The key to search for
+ * \param key_len The length of `key`, in bytes
+ * \param val_len If non-`NULL`, is set to the value's length, in bytes
+ */
+char *ht_searchn_len(const ht_hash_table *ht, const char *key, size_t key_len, size_t *val_len);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1), nothrow))
+#endif
+/**
+ * \brief Looks up a batch of keys, with specified key lengths.
+ *
+ * Sets `out[i]` to the value associated with `keys[i]` (whose length is
+ * `key_lens[i]`), or to `NULL` if it doesn't exist in `ht`, for every `i`
+ * below `count`, and returns how many were found. All keys in a batch are
+ * hashed and their slots prefetched before any is compared, so for tables
+ * larger than the CPU's caches this is considerably faster than calling
+ * `ht_searchn` for each key.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table to search through
+ * \param count The number of keys
+ * \param keys The keys to search for
+ * \param key_lens The length of each key, in bytes
+ * \param out Where to write each key's value
+ */
+size_t ht_searchn_batch(const ht_hash_table *ht, size_t count, const char *const *keys, const size_t *key_lens, char **out);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow)) HT_PURE
 #endif
 /**
  * \brief Returns the value associated with `key`.
@@ -254,7 +490,10 @@ __attribute__((nonnull(1, 2), nothrow, warn_unused_result))
  *
  * Removes `key` from `ht` and returns the value that was associated with it.
  * The caller is made responsible for freeing the returned value. This returns
- * `NULL` and has no effect on `ht` if `key` doesn't exist in `ht`.
+ * `NULL` and has no effect on `ht` if `key` doesn't exist in `ht`. In
+ * `HT_ARENA` or `HT_BORROW` mode, the returned value is a copy made with
+ * `malloc`, and `NULL` is also returned (leaving `key` in `ht`) if that copy
+ * can't be allocated.
  *
  * \memberof ht_hash_table
  * \param ht The table to remove from
@@ -290,7 +529,8 @@ __attribute__((nonnull(1, 2), nothrow, warn_unused_result))
  * Removes `key` from `ht` and returns the value that was associated with it.
  * The caller is made responsible for freeing the returned value. This returns
  * `NULL` and has no effect on `ht` if `key` doesn't exist in `ht`. Key length
- * is determined via the `strlen` function.
+ * is determined via the `strlen` function. As with `ht_removen_get`, an
+ * `HT_ARENA` or `HT_BORROW` table returns a `malloc`-ed copy of the value.
  *
  * \memberof ht_hash_table
  * \param ht The table to remove from
@@ -308,14 +548,36 @@ __attribute__((nonnull(1), nothrow, pure))
  * either `ht_iter_next` or `ht_iter_next_pair`.
  * Note that using any operations which may reallocate the buffer will
  * invalidate the iterator; this includes `ht_resize`, `ht_shrink_to_fit`, and
- * both `ht_insert` functions. `const` operations are safe to use, as well as
- * (in the current implementation) `ht_remove`.
+ * both `ht_insert` functions. `const` operations are safe to use; `ht_remove`
+ * doesn't reallocate, but it can move later items back into the removed slot,
+ * so an iterator may skip or repeat items after a removal.
+ * The table tracks which slots are full in a bitmap, which iterators skip
+ * through 64 slots at a time, so iterating over a sparse table costs little
+ * more than its size.
  *
  * \memberof ht_hash_table
  * \param ht The table to iterate over
  */
 ht_iter ht_iterator(const ht_hash_table *ht);
 
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1), nothrow, pure))
+#endif
+/**
+ * \brief Creates an iterator over some of `ht`'s slots.
+ *
+ * As `ht_iterator`, but only yielding the pairs in slots `first` up to (not
+ * including) `last`, out of `ht->capacity`; `last` is clamped to the capacity.
+ * Since iterators only read the table, a traversal can be split across
+ * threads by giving each its own range of slots.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table to iterate over
+ * \param first The first slot to look at
+ * \param last The slot past the last one to look at
+ */
+ht_iter ht_iterator_range(const ht_hash_table *ht, size_t first, size_t last);
+
 #ifndef MAKE_DOCS
 __attribute__((nonnull(1), nothrow))
 #endif
@@ -348,6 +610,85 @@ __attribute__((nonnull(1), nothrow))
  */
 bool ht_iter_next_pair(ht_iter *iter, char **key, char **val);
 
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1), nothrow))
+#endif
+/**
+ * \brief Gets the next pair from `iter`, with their lengths.
+ *
+ * As `ht_iter_next_pair`, but also sets `key_len` and `val_len` (if
+ * non-`NULL`) to the lengths of the pair's key and value, in bytes.
+ *
+ * \memberof ht_hash_table
+ * \param iter The iterator to advance
+ * \param key If non-`NULL`, is set to the pair's key
+ * \param key_len If non-`NULL`, is set to the length of the pair's key
+ * \param val If non-`NULL`, is set to the pair's value
+ * \param val_len If non-`NULL`, is set to the length of the pair's value
+ */
+bool ht_iter_next_pairn(ht_iter *iter, char **key, size_t *key_len, char **val, size_t *val_len);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow, pure))
+#endif
+/**
+ * \brief Returns the home slot of a key, with a specified length.
+ *
+ * Returns the slot a lookup for `key` starts probing from, below
+ * `ht->capacity`, or 0 for a table with no slots.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table the key would be in
+ * \param key The key to place
+ * \param key_len The length of the key, in bytes
+ */
+size_t ht_bucketn(const ht_hash_table *ht, const char *key, size_t key_len);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow, pure))
+#endif
+/**
+ * \brief Returns the home slot of a key.
+ *
+ * As `ht_bucketn`, using `strlen` for the key's length.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table the key would be in
+ * \param key The key to place
+ */
+size_t ht_bucket(const ht_hash_table *ht, const char *key);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1), nothrow, pure))
+#endif
+/**
+ * \brief Counts the keys whose home is a slot.
+ *
+ * Returns how many keys in `ht` have slot `n` as their home slot, or 0 if `n`
+ * isn't below `ht->capacity`. Walks the run of full slots from `n`, hashing
+ * each key in it unless `HT_CACHE_HASH` is defined.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table to look in
+ * \param n The slot
+ */
+size_t ht_bucket_size(const ht_hash_table *ht, size_t n);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1), nothrow, pure))
+#endif
+/**
+ * \brief Measures how a table's pairs are spread across its slots.
+ *
+ * Walks every slot of `ht`, hashing each key unless `HT_CACHE_HASH` is
+ * defined, and returns its clusters and displacements; long ones at a normal
+ * load factor mean the hash function spreads keys badly.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table to measure
+ */
+ht_cluster_stats ht_clusters(const ht_hash_table *ht);
+
 #ifndef MAKE_DOCS
 __attribute__((nonnull(1), nothrow))
 #endif
@@ -396,3 +737,174 @@ __attribute__((nonnull(1), nothrow))
  * \param out Where to place the created buffer
  */
 size_t ht_json_stringify_escape(const ht_hash_table *ht, char **out);
+
+/**
+ * \brief Receives the output of `ht_json_write`.
+ *
+ * Called with each chunk of output in turn, along with the `ctx` passed to
+ * `ht_json_write`; should return `true` if all `len` bytes of `data` were
+ * written, or `false` to stop writing.
+ */
+typedef bool (*ht_json_sink)(void *ctx, const char *data, size_t len);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 3)))
+#endif
+/**
+ * \brief Writes `ht` as JSON to `sink`, a chunk at a time.
+ *
+ * Writes the same JSON object as `ht_json_stringify`, but passes it to `sink`
+ * in chunks of up to 16 KiB (and strings that are larger than that, each as
+ * a chunk of its own) rather than building it in one buffer, so memory use
+ * doesn't grow with the table. With `escape`, keys and values are written as
+ * JSON strings of their bytes: quotes, backslashes and control characters are
+ * escaped, which a vectorized scan finds many bytes at a time. Without it,
+ * they're written as they are, like `ht_json_stringify`. Returns the number
+ * of bytes written, or 0 if `sink` returned `false`, after which it isn't
+ * called again.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table to write
+ * \param escape Whether to escape keys and values
+ * \param sink Where to send the output
+ * \param ctx Passed to each call of `sink`
+ */
+size_t ht_json_write(const ht_hash_table *ht, bool escape, ht_json_sink sink, void *ctx);
+
+#if defined(__unix__) || defined(__APPLE__) || defined(MAKE_DOCS)
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2)))
+#endif
+/**
+ * \brief An `ht_json_sink` writing to a file descriptor.
+ *
+ * Writes `data` to the file descriptor `fd` points to, an `int`, retrying
+ * partial and interrupted writes. Only available where `write` is.
+ *
+ * \param fd Points to the file descriptor to write to
+ * \param data The bytes to write
+ * \param len The number of bytes to write
+ */
+bool ht_json_fd_sink(void *fd, const char *data, size_t len);
+#endif
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow))
+#endif
+/**
+ * \brief Writes `ht` to `out` as a binary snapshot.
+ *
+ * Writes the pairs in `ht` in the format of ht-snapshot.h, to be read back by
+ * `ht_snapshot_open` or `ht_snapshot_view`. Pairs are placed by
+ * `ht_hash_bytes` whatever `ht`'s `hash` hook is, since a hook can't be saved
+ * with them. `out` should be opened in binary mode; the slots are built in
+ * memory first, taking 32 bytes each, at most 75% full. Returns `true` on
+ * success, or `false` if memory couldn't be allocated or writing failed, in
+ * which case `out` may hold part of a snapshot.
+ *
+ * \memberof ht_hash_table
+ * \param ht The table to write
+ * \param out The stream to write to
+ */
+bool ht_snapshot_write(const ht_hash_table *ht, FILE *out);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow))
+#endif
+/**
+ * \brief Opens the snapshot in the file at `path`.
+ *
+ * Maps the file read-only into memory (or, where `mmap` isn't available,
+ * reads it into a buffer) and checks its header, leaving the slots and heap
+ * to be paged in as lookups reach them. Returns `true` and sets up `snap` on
+ * success; returns `false`, leaving `snap` unchanged, if the file couldn't be
+ * mapped or isn't a snapshot of a C table this build can read. A snapshot
+ * opened this way has to be closed with `ht_snapshot_close`.
+ *
+ * \memberof ht_snapshot
+ * \param snap The snapshot to set up
+ * \param path The file to open
+ */
+bool ht_snapshot_open(ht_snapshot *snap, const char *path);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow))
+#endif
+/**
+ * \brief Views the snapshot in the `len` bytes at `data`.
+ *
+ * As `ht_snapshot_open`, but for a snapshot already in memory, which isn't
+ * copied: `data` has to stay valid, and unchanged, for as long as `snap` is
+ * used, and be aligned to 8 bytes.
+ *
+ * \memberof ht_snapshot
+ * \param snap The snapshot to set up
+ * \param data The snapshot's bytes
+ * \param len The number of bytes at `data`
+ */
+bool ht_snapshot_view(ht_snapshot *snap, const void *data, size_t len);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1), nothrow))
+#endif
+/**
+ * \brief Releases `snap`.
+ *
+ * Unmaps the file `ht_snapshot_open` mapped, if any, and empties `snap`;
+ * strings returned by searching it are no longer valid.
+ *
+ * \memberof ht_snapshot
+ * \param snap The snapshot to close
+ */
+void ht_snapshot_close(ht_snapshot *snap);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow))
+#endif
+/**
+ * \brief Returns the value associated with `key` in `snap` and its length,
+ * with specified key length.
+ *
+ * As `ht_searchn_len`, but reading the snapshot in place; the value returned
+ * points into the snapshot, and is NUL-terminated. Slots that point outside
+ * the snapshot are treated as holding nothing, so a damaged file can't make
+ * a lookup read past its end.
+ *
+ * \memberof ht_snapshot
+ * \param snap The snapshot to search
+ * \param key The key to look for
+ * \param key_len The length of `key`
+ * \param val_len If non-`NULL`, is set to the value's length if found
+ */
+const char *ht_snapshot_searchn(const ht_snapshot *snap, const char *key, size_t key_len, size_t *val_len);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow))
+#endif
+/**
+ * \brief Returns the value associated with `key` in `snap`.
+ *
+ * As `ht_snapshot_searchn`, using `strlen` to find `key`'s length.
+ *
+ * \memberof ht_snapshot
+ * \param snap The snapshot to search
+ * \param key The key to look for
+ */
+const char *ht_snapshot_search(const ht_snapshot *snap, const char *key);
+
+#ifndef MAKE_DOCS
+__attribute__((nonnull(1, 2), nothrow))
+#endif
+/**
+ * \brief Inserts every pair in `snap` into `ht`.
+ *
+ * Replaces the values of keys `ht` already has. With `HT_BORROW`, `ht` then
+ * points into the snapshot rather than copying it, and has to be cleared
+ * before the snapshot is closed. Returns `false` if an insertion failed or
+ * the snapshot is damaged, in which case `ht` may hold some of its pairs.
+ *
+ * \memberof ht_snapshot
+ * \param snap The snapshot to read
+ * \param ht The table to insert into
+ */
+bool ht_snapshot_load(const ht_snapshot *snap, ht_hash_table *ht);
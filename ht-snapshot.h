@@ -0,0 +1,85 @@
+/**
+ * \file ht-snapshot.h
+ * \brief The binary snapshot format shared by the C and C++ tables.
+ *
+ * A snapshot is a table laid out so it can be searched where it lies, e.g.
+ * straight from a file mapped into memory, with no pointers in it. It starts
+ * with an `ht_snapshot_header`, whose `slots_offset` gives where its slot
+ * array starts; anything the slots refer to comes after them, as offsets into
+ * a heap of `heap_size` bytes.
+ *
+ * The C table's snapshots (`HT_SNAPSHOT_STRINGS`) hold `ht_snapshot_slot`s:
+ * a power-of-2 number of them, filled by linear probing from the slot the top
+ * bits of each key's `ht_hash_bytes` pick. Each key is stored in the heap,
+ * followed by a NUL, its value and another NUL. The heap starts with a NUL no
+ * key is stored at, so a slot whose `key` is 0 is empty.
+ *
+ * `HashTableSnapshot` (in hash-table-snapshot.hpp) writes `HT_SNAPSHOT_SLOTS`
+ * snapshots, whose slots are a `HashTable`'s own, preceded by its control
+ * bytes (with `HT_SNAPSHOT_MIRROR` bytes mirroring the first slots' after
+ * them) and any probe distances and cached hashes.
+ *
+ * Fields are written in the writer's byte order; readers refuse snapshots
+ * whose `byte_order` doesn't read as `HT_SNAPSHOT_BYTE_ORDER`, or whose
+ * `version` they don't know.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** \brief The first 8 bytes of every snapshot. */
+#define HT_SNAPSHOT_MAGIC "HTSNAP\r\n"
+
+enum {
+	/// The format version this header describes.
+	HT_SNAPSHOT_VERSION = 1,
+	/// Written as a native `uint32_t`, so readers can tell the byte order.
+	HT_SNAPSHOT_BYTE_ORDER = 0x01020304,
+	/// `kind` of the C table's snapshots.
+	HT_SNAPSHOT_STRINGS = 1,
+	/// `kind` of `HashTableSnapshot`'s snapshots.
+	HT_SNAPSHOT_SLOTS = 2,
+	/// `flags` bit: probe distances follow the control bytes.
+	HT_SNAPSHOT_DIST = 1 << 0,
+	/// `flags` bit: cached hashes follow the control bytes (and distances).
+	HT_SNAPSHOT_HASHES = 1 << 1,
+	/// Control bytes stored past the last slot's, enough for any group width.
+	HT_SNAPSHOT_MIRROR = 31,
+};
+
+/**
+ * \struct ht_snapshot_header
+ * \brief The start of every snapshot.
+ */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	/// `HT_SNAPSHOT_STRINGS` or `HT_SNAPSHOT_SLOTS`.
+	uint32_t kind;
+	/// Bytes per slot, which readers check against their own.
+	uint32_t slot_size;
+	uint64_t capacity;
+	uint64_t size;
+	/// Offset of the slot array from the start of the snapshot.
+	uint64_t slots_offset;
+	/// Bytes in the heap, which directly follows the slot array and ends the
+	/// snapshot.
+	uint64_t heap_size;
+	/// `HT_SNAPSHOT_` flag bits.
+	uint64_t flags;
+} ht_snapshot_header;
+
+/**
+ * \struct ht_snapshot_slot
+ * \brief One slot of a C table's snapshot.
+ */
+typedef struct {
+	/// The key's `ht_hash_bytes` with seed 0.
+	uint64_t hash;
+	/// Offset of the key in the heap, or 0 for an empty slot.
+	uint64_t key;
+	uint64_t key_len;
+	uint64_t val_len;
+} ht_snapshot_slot;
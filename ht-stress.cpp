@@ -0,0 +1,584 @@
+// Stress-tests `ConcurrentHashTable` and `ReadMostlyHashTable` from many
+// threads at once, and measures how they scale.
+//
+// Each run prefills a table with keys `[0, n)`, then has every thread pick
+// keys uniformly from `[0, 2n)` for a fixed time, so about half of lookups
+// miss. Writes are half `insert_or_assign`s and half `erase`s, which keeps
+// the size near `n`. Every value stored is a function of its key, so a
+// lookup that returns anything else (or an entry left behind with one) is
+// a bug; any is reported and makes the exit status 1.
+//
+// Runs cover every read/write mix, thread count, and two NUMA-related
+// settings: whether threads are pinned to CPUs (filling one node's CPUs
+// before the next), and where large slot arrays are placed:
+//   first_touch  wherever the thread that first writes each page runs
+//   local        on the node of the thread that allocates the array
+//   interleave   page by page across every node
+// Placement uses `mbind`, so it only has an effect on Linux; on a single
+// node, every placement is the same.
+//
+// Every result is printed as one JSON object per line, e.g.
+//   {"container":"ConcurrentHashTable","mix":"reads_90","placement":"local","pinned":true,"threads":8,"n":1048576,"mops_per_s":41.2,"scaling":0.87,"p50_ns":112,"p99_ns":870,"p999_ns":4100,"max_ns":40211}
+// `scaling` is the throughput divided by `threads` times that of the same
+// run on one thread. Latencies are of every 8th operation, timed alone.
+//
+// Usage: ht_stress [-n entries] [-d milliseconds] [-t threads,...] [filter...]
+// Only runs whose "container/mix/placement/pinned" (or ".../unpinned") name
+// contains one of the filters are run.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "concurrent-hash-table.hpp"
+#include "read-mostly-hash-table.hpp"
+
+namespace {
+	struct Options {
+		size_t n = 1 << 20;
+		int ms = 200;
+		std::vector<size_t> threads = { 1, 2, 4, 8, 16, 32, 64 };
+		std::vector<std::string> filters;
+	};
+
+	enum class Placement { first_touch, local, interleave };
+	const char* placement_name(Placement placement) {
+		switch (placement) {
+		case Placement::first_touch:
+			return "first_touch";
+		case Placement::local:
+			return "local";
+		default:
+			return "interleave";
+		}
+	}
+
+	// The CPUs this process may run on, by NUMA node.
+	struct Topology {
+		std::vector<int> nodes;
+		std::vector<std::vector<int>> cpus;
+
+		size_t cpu_count() const {
+			size_t count = 0;
+			for (const auto& list : this->cpus) {
+				count += list.size();
+			}
+			return count;
+		}
+		// The CPU thread `i` is pinned to: every CPU of the first node,
+		// then every CPU of the next, and so on, wrapping around.
+		int cpu_for(size_t i) const {
+			i %= this->cpu_count();
+			for (const auto& list : this->cpus) {
+				if (i < list.size()) {
+					return list[i];
+				}
+				i -= list.size();
+			}
+			return 0;
+		}
+	};
+
+	// Read by every `PlacedAllocator`, and only changed between runs.
+	Placement placement = Placement::first_touch;
+	Topology topology;
+	std::atomic<bool> mbind_failed = false;
+
+	// A list like "0-3,8,10-11", as in `/sys/devices/system/node`.
+	std::vector<int> parse_list(const std::string& text) {
+		std::vector<int> out;
+		const char* at = text.c_str();
+		while (*at >= '0' && *at <= '9') {
+			char* end;
+			int first = (int) std::strtol(at, &end, 10);
+			int last = first;
+			if (*end == '-') {
+				last = (int) std::strtol(end + 1, &end, 10);
+			}
+			for (int i = first; i <= last; i++) {
+				out.push_back(i);
+			}
+			at = *end == ',' ? end + 1 : end;
+		}
+		return out;
+	}
+
+	Topology find_topology() {
+		Topology out;
+#ifdef __linux__
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		sched_getaffinity(0, sizeof(allowed), &allowed);
+		std::string online;
+		std::ifstream("/sys/devices/system/node/online") >> online;
+		for (int node : parse_list(online)) {
+			std::string list;
+			std::ifstream("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist") >> list;
+			std::vector<int> cpus;
+			for (int cpu : parse_list(list)) {
+				if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+					cpus.push_back(cpu);
+				}
+			}
+			if (!cpus.empty()) {
+				out.nodes.push_back(node);
+				out.cpus.push_back(std::move(cpus));
+			}
+		}
+		if (out.cpus.empty()) {
+			// no sysfs; call it one node
+			std::vector<int> cpus;
+			for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+				if (CPU_ISSET(cpu, &allowed)) {
+					cpus.push_back(cpu);
+				}
+			}
+			out.nodes.push_back(0);
+			out.cpus.push_back(std::move(cpus));
+		}
+#else
+		std::vector<int> cpus;
+		for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+			cpus.push_back((int) cpu);
+		}
+		out.nodes.push_back(0);
+		out.cpus.push_back(std::move(cpus));
+#endif
+		return out;
+	}
+
+	// Runs the calling thread on `cpu` only, or on any allowed CPU if
+	// `cpu` is negative.
+	void pin_to(int cpu) {
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (cpu >= 0) {
+			CPU_SET(cpu, &set);
+		} else {
+			for (const auto& list : topology.cpus) {
+				for (int allowed : list) {
+					CPU_SET(allowed, &set);
+				}
+			}
+		}
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+		(void) cpu;
+#endif
+	}
+
+	// Smaller allocations come from `operator new`, where they may share
+	// pages with anything else.
+	constexpr size_t PLACED_MIN = 1 << 16;
+
+	// Maps fresh pages for an allocation of `bytes`, and sets the policy
+	// the kernel places them by when they're first written.
+	void* place_bytes(size_t bytes, size_t align) {
+		if (bytes < PLACED_MIN) {
+			return ::operator new(bytes, std::align_val_t(align));
+		}
+#ifdef __linux__
+		void* out = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (out == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+#ifdef SYS_mbind
+		// from <numaif.h>, which comes with libnuma rather than libc
+		constexpr int MPOL_PREFERRED = 1, MPOL_INTERLEAVE = 3;
+		long failed = 0;
+		if (placement == Placement::local) {
+			// preferring no nodes means the local one; `MPOL_LOCAL` is newer
+			failed = syscall(SYS_mbind, out, bytes, MPOL_PREFERRED, nullptr, 0, 0);
+		} else if (placement == Placement::interleave) {
+			std::vector<unsigned long> mask((size_t) topology.nodes.back() / 64 + 1);
+			for (int node : topology.nodes) {
+				mask[node / 64] |= 1ul << (node % 64);
+			}
+			failed = syscall(SYS_mbind, out, bytes, MPOL_INTERLEAVE, mask.data(), mask.size() * 64 + 1, 0);
+		}
+		if (failed != 0) {
+			mbind_failed = true;
+		}
+#endif
+		return out;
+#else
+		return ::operator new(bytes, std::align_val_t(align));
+#endif
+	}
+	void free_bytes(void* ptr, size_t bytes, size_t align) noexcept {
+#ifdef __linux__
+		if (bytes >= PLACED_MIN) {
+			munmap(ptr, bytes);
+			return;
+		}
+#endif
+		::operator delete(ptr, bytes, std::align_val_t(align));
+	}
+
+	// Puts the tables' slot arrays where `placement` says.
+	template<class T>
+	struct PlacedAllocator {
+		using value_type = T;
+
+		PlacedAllocator() noexcept = default;
+		template<class U>
+		PlacedAllocator(const PlacedAllocator<U>&) noexcept { }
+
+		T* allocate(size_t n) {
+			return static_cast<T*>(place_bytes(n * sizeof(T), alignof(T)));
+		}
+		void deallocate(T* ptr, size_t n) noexcept {
+			free_bytes(ptr, n * sizeof(T), alignof(T));
+		}
+	};
+	template<class T, class U>
+	bool operator==(const PlacedAllocator<T>&, const PlacedAllocator<U>&) noexcept {
+		return true;
+	}
+	template<class T, class U>
+	bool operator!=(const PlacedAllocator<T>&, const PlacedAllocator<U>&) noexcept {
+		return false;
+	}
+
+	using Entry = std::pair<const uint64_t, uint64_t>;
+	using Alloc = PlacedAllocator<Entry>;
+
+	// The only value ever stored for `key`.
+	uint64_t value_for(uint64_t key) noexcept {
+		return ~key * 0x9e3779b97f4a7c15ull;
+	}
+
+	// The SplitMix64 generator, which is cheap enough not to be measured.
+	struct Rng {
+		uint64_t state;
+
+		uint64_t operator()() noexcept {
+			uint64_t x = this->state += 0x9e3779b97f4a7c15ull;
+			x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+			x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+			return x ^ (x >> 31);
+		}
+	};
+
+	// Each target is a table plus a `Session` per thread, through which
+	// that thread reads and writes, and `check`, which counts entries with
+	// a wrong key or value once every thread is done.
+	struct Sharded {
+		using Table = ConcurrentHashTable<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, LinearProbing, Alloc>;
+		static constexpr const char* NAME = "ConcurrentHashTable";
+		static constexpr unsigned MIN_READS = 0;
+
+		Table table;
+
+		explicit Sharded(size_t n) {
+			// room for every key there could be, so there's no growing
+			// while threads run
+			this->table.reserve(2 * n);
+			for (uint64_t key = 0; key < n; key++) {
+				this->table.insert_or_assign(key, value_for(key));
+			}
+		}
+
+		struct Session {
+			Table& table;
+
+			bool read(uint64_t key) {
+				auto value = this->table.find(key);
+				return !value || *value == value_for(key);
+			}
+			void write(uint64_t key, bool insert) {
+				if (insert) {
+					this->table.insert_or_assign(key, value_for(key));
+				} else {
+					this->table.erase(key);
+				}
+			}
+		};
+		Session session() {
+			return Session{ this->table };
+		}
+
+		size_t check(size_t n) const {
+			size_t bad = 0, seen = 0;
+			this->table.for_each([&](const auto& entry) {
+				bad += entry.first >= 2 * n || entry.second != value_for(entry.first);
+				seen++;
+			});
+			return bad + (seen != this->table.size());
+		}
+	};
+
+	// Every write copies the whole table, so this only runs the mixes
+	// it's meant for.
+	struct ReadMostly {
+		using Table = ReadMostlyHashTable<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, LinearProbing, Alloc>;
+		static constexpr const char* NAME = "ReadMostlyHashTable";
+		static constexpr unsigned MIN_READS = 999;
+
+		Table table;
+
+		explicit ReadMostly(size_t n) {
+			this->table.update([&](auto& inner) {
+				inner.reserve(2 * n);
+				for (uint64_t key = 0; key < n; key++) {
+					inner.insert_or_assign(key, value_for(key));
+				}
+			});
+		}
+
+		struct Session {
+			Table& table;
+			typename Table::Reader reader;
+
+			bool read(uint64_t key) {
+				auto value = this->reader.find(key);
+				return !value || *value == value_for(key);
+			}
+			void write(uint64_t key, bool insert) {
+				if (insert) {
+					this->table.insert_or_assign(key, value_for(key));
+				} else {
+					this->table.erase(key);
+				}
+			}
+		};
+		Session session() {
+			return Session{ this->table, this->table.reader() };
+		}
+
+		size_t check(size_t n) {
+			Table::Reader reader = this->table.reader();
+			auto pinned = reader.pin();
+			size_t bad = 0;
+			pinned->for_each([&](const auto& entry) {
+				bad += entry.first >= 2 * n || entry.second != value_for(entry.first);
+			});
+			return bad;
+		}
+	};
+
+	struct Mix {
+		const char* name;
+		// Out of every 1000 operations.
+		unsigned reads;
+	};
+	const Mix MIXES[] = {
+		{ "reads_100", 1000 },
+		{ "reads_99.9", 999 },
+		{ "reads_99", 990 },
+		{ "reads_90", 900 },
+		{ "reads_50", 500 },
+	};
+
+	constexpr size_t SAMPLE_EVERY = 8;
+
+	// What one thread did, on its own cache lines.
+	struct alignas(64) Counts {
+		uint64_t ops = 0;
+		uint64_t errors = 0;
+		std::vector<uint32_t> samples;
+	};
+
+	struct Result {
+		double mops_per_s;
+		uint64_t errors;
+		uint32_t p50, p99, p999, max;
+	};
+
+	uint32_t percentile(std::vector<uint32_t>& samples, double p) {
+		if (samples.empty()) {
+			return 0;
+		}
+		auto at = samples.begin() + (ptrdiff_t) (p * (double) (samples.size() - 1));
+		std::nth_element(samples.begin(), at, samples.end());
+		return *at;
+	}
+
+	template<class Target>
+	Result run_once(const Options& opts, const Mix& mix, bool pinned, size_t threads) {
+		using clock = std::chrono::steady_clock;
+
+		// with pinning, the table is allocated on the first thread's node
+		pin_to(pinned ? topology.cpu_for(0) : -1);
+		Target target(opts.n);
+		uint64_t space = 2 * (uint64_t) opts.n;
+
+		std::vector<Counts> counts(threads);
+		std::atomic<size_t> ready = 0;
+		std::atomic<bool> start = false, stop = false;
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < threads; t++) {
+			workers.emplace_back([&, t] {
+				if (pinned) {
+					pin_to(topology.cpu_for(t));
+				}
+				auto session = target.session();
+				Counts& mine = counts[t];
+				mine.samples.reserve(1 << 16);
+				Rng rng{ t + 1 };
+				ready++;
+				while (!start.load(std::memory_order_acquire)) {
+					std::this_thread::yield();
+				}
+				while (!stop.load(std::memory_order_relaxed)) {
+					for (size_t i = 0; i < SAMPLE_EVERY; i++) {
+						uint64_t r = rng();
+						uint64_t key = (r >> 12) % space;
+						bool read = r % 1000 < mix.reads;
+						bool timed = i == 0;
+						clock::time_point before;
+						if (timed) {
+							before = clock::now();
+						}
+						if (read) {
+							mine.errors += !session.read(key);
+						} else {
+							session.write(key, (r >> 10) & 1);
+						}
+						if (timed) {
+							auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - before).count();
+							mine.samples.push_back((uint32_t) std::min<int64_t>(ns, UINT32_MAX));
+						}
+					}
+					mine.ops += SAMPLE_EVERY;
+				}
+			});
+		}
+		while (ready.load() != threads) {
+			std::this_thread::yield();
+		}
+		auto began = clock::now();
+		start.store(true, std::memory_order_release);
+		std::this_thread::sleep_for(std::chrono::milliseconds(opts.ms));
+		stop = true;
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		double seconds = std::chrono::duration<double>(clock::now() - began).count();
+		pin_to(-1);
+
+		Result out{};
+		uint64_t ops = 0;
+		std::vector<uint32_t> samples;
+		for (const auto& count : counts) {
+			ops += count.ops;
+			out.errors += count.errors;
+			samples.insert(samples.end(), count.samples.begin(), count.samples.end());
+		}
+		out.errors += target.check(opts.n);
+		out.mops_per_s = (double) ops / seconds / 1e6;
+		out.p50 = percentile(samples, 0.5);
+		out.p99 = percentile(samples, 0.99);
+		out.p999 = percentile(samples, 0.999);
+		out.max = samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+		return out;
+	}
+
+	bool selected(const Options& opts, const std::string& name) {
+		if (opts.filters.empty()) {
+			return true;
+		}
+		for (const auto& filter : opts.filters) {
+			if (name.find(filter) != std::string::npos) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Runs `Target` with every setting; returns how many wrong entries
+	// and lookups there were.
+	template<class Target>
+	uint64_t run(const Options& opts) {
+		uint64_t errors = 0;
+		for (const Mix& mix : MIXES) {
+			if (mix.reads < Target::MIN_READS) {
+				continue;
+			}
+			for (Placement where : { Placement::first_touch, Placement::local, Placement::interleave }) {
+				for (bool pinned : { false, true }) {
+					std::string name = std::string(Target::NAME) + "/" + mix.name + "/" + placement_name(where) + (pinned ? "/pinned" : "/unpinned");
+					if (!selected(opts, name)) {
+						continue;
+					}
+					placement = where;
+					double single = 0;
+					for (size_t threads : opts.threads) {
+						Result result = run_once<Target>(opts, mix, pinned, threads);
+						if (threads == 1) {
+							single = result.mops_per_s;
+						}
+						std::printf(
+							"{\"container\":\"%s\",\"mix\":\"%s\",\"placement\":\"%s\",\"pinned\":%s,\"threads\":%zu,\"n\":%zu,"
+								"\"mops_per_s\":%.2f,\"scaling\":%.2f,\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u}\n",
+							Target::NAME, mix.name, placement_name(where), pinned ? "true" : "false", threads, opts.n,
+							result.mops_per_s, result.mops_per_s / ((double) threads * single),
+							result.p50, result.p99, result.p999, result.max
+						);
+						std::fflush(stdout);
+						if (result.errors != 0) {
+							std::fprintf(stderr, "%s with %zu threads: %llu wrong lookups or entries\n", name.c_str(), threads, (unsigned long long) result.errors);
+						}
+						errors += result.errors;
+					}
+				}
+			}
+		}
+		return errors;
+	}
+
+	Options parse(int argc, char* argv[]) {
+		Options opts;
+		for (int i = 1; i < argc; i++) {
+			if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+				opts.n = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+			} else if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+				opts.ms = std::max(1, std::atoi(argv[++i]));
+			} else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+				opts.threads.clear();
+				for (int threads : parse_list(argv[++i])) {
+					opts.threads.push_back((size_t) std::max(1, threads));
+				}
+			} else {
+				opts.filters.push_back(argv[i]);
+			}
+		}
+		// scaling is relative to one thread, so that always runs first
+		std::sort(opts.threads.begin(), opts.threads.end());
+		opts.threads.erase(std::unique(opts.threads.begin(), opts.threads.end()), opts.threads.end());
+		if (opts.threads.empty() || opts.threads[0] != 1) {
+			opts.threads.insert(opts.threads.begin(), 1);
+		}
+		return opts;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options opts = parse(argc, argv);
+	topology = find_topology();
+	std::fprintf(stderr, "%zu NUMA nodes, %zu CPUs\n", topology.nodes.size(), topology.cpu_count());
+	uint64_t errors = run<Sharded>(opts) + run<ReadMostly>(opts);
+	if (mbind_failed) {
+		std::fprintf(stderr, "mbind failed, so some slot arrays were placed by first touch\n");
+	}
+	return errors == 0 ? 0 : 1;
+}
@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#if defined(__unix__) || defined(__APPLE__)
+#	include <unistd.h>
+#endif
 
 #ifdef NDEBUG
 #undef NDEBUG
@@ -9,6 +12,38 @@
 
 #include "ht-hash.h"
 
+// every key collides, so only probing keeps them apart
+static size_t constant_hash(const char *key, size_t key_len) {
+	(void) key; (void) key_len;
+	return 42;
+}
+
+// puts the key's first byte in the top bits, where home slots come from
+static size_t first_byte_hash(const char *key, size_t key_len) {
+	return key_len == 0 ? 0 : (size_t) (unsigned char) key[0] << 56;
+}
+
+// collects `ht_json_write` output, failing once it would pass `limit` bytes
+struct json_buffer {
+	char *data;
+	size_t len;
+	size_t limit;
+	size_t calls;
+};
+
+static bool json_buffer_sink(void *ctx, const char *data, size_t len) {
+	struct json_buffer *buf = ctx;
+	buf->calls++;
+	if (buf->len + len > buf->limit) {
+		return false;
+	}
+	buf->data = realloc(buf->data, buf->len + len + 1);
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+	buf->data[buf->len] = '\0';
+	return true;
+}
+
 int main(int argc, char *argv[]) {
 	(void) argc; (void) argv;
 
@@ -54,6 +89,66 @@ int main(int argc, char *argv[]) {
 	assert(strncmp("val0", ht_search(&table, "key0"), 4) == 0);
 	assert(strncmp("val999", ht_search(&table, "key999"), 6) == 0);
 
+	// overwriting keys frees the value each one had, not another's
+	for (int i = 0; i < 1000; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		sprintf(val_buf + 3, "%d", 999 - i);
+		ht_insert(&table, base_buf, val_buf);
+	}
+	for (int i = 0; i < 1000; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		sprintf(val_buf + 3, "%d", 999 - i);
+		assert(strcmp(val_buf, ht_search(&table, base_buf)) == 0);
+		sprintf(val_buf + 3, "%d", i);
+		ht_insert(&table, base_buf, val_buf);
+	}
+	assert(strcmp("val0", ht_search(&table, "key0")) == 0);
+
+	// a table loaded up to where it would grow, with every key colliding,
+	// still terminates and finds every key, before and after removals
+	ht_hash_table crowded = { .hash = constant_hash };
+	ht_resize(&crowded, 64);
+	for (int i = 0; i < 48; i++) {
+		sprintf(base_buf + 3, "%d", 100 + i);
+		ht_insert(&crowded, base_buf, "v");
+	}
+	assert(crowded.capacity == 64 && crowded.size == 48);
+	for (int i = 0; i < 48; i += 2) {
+		sprintf(base_buf + 3, "%d", 100 + i);
+		ht_remove(&crowded, base_buf);
+	}
+	for (int i = 0; i < 48; i++) {
+		sprintf(base_buf + 3, "%d", 100 + i);
+		assert(ht_contains(&crowded, base_buf) == (i % 2 == 1));
+	}
+	assert(!ht_contains(&crowded, "nope"));
+	ht_clear(&crowded);
+
+	// shrinking keeps a slot empty, so lookups of missing keys stop
+	ht_hash_table shrunk = {0};
+	for (int i = 0; i < 100; i++) {
+		sprintf(base_buf + 3, "%d", 100 + i);
+		ht_insert(&shrunk, base_buf, "v");
+	}
+	for (int i = 0; i < 36; i++) {
+		sprintf(base_buf + 3, "%d", 100 + i);
+		ht_remove(&shrunk, base_buf);
+	}
+	ht_shrink_to_fit(&shrunk);
+	assert(shrunk.size == 64 && shrunk.capacity == 128);
+	assert(!ht_contains(&shrunk, "nope"));
+	for (int i = 36; i < 100; i++) {
+		sprintf(base_buf + 3, "%d", 100 + i);
+		assert(ht_contains(&shrunk, base_buf));
+	}
+	size_t shrunk_homed = 0;
+	for (size_t i = 0; i < shrunk.capacity; i++) {
+		shrunk_homed += ht_bucket_size(&shrunk, i);
+	}
+	assert(shrunk_homed == 64);
+	assert(ht_clusters(&shrunk).entries == 64);
+	ht_clear(&shrunk);
+
 	// iterators return all keys, without duplicates (order unknown)
 	bool seenHello = false;
 	bool seenTest = false;
@@ -79,6 +174,32 @@ int main(int argc, char *argv[]) {
 		assert(seenNums[i]);
 	}
 
+	// ranges of slots split iteration, and sparse tables iterate what's left
+	ht_hash_table sparse = {0};
+	ht_resize(&sparse, 1 << 16);
+	for (int i = 0; i < 1000; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		ht_insert(&sparse, base_buf, "v");
+	}
+	for (int i = 0; i < 1000; i += 3) {
+		sprintf(base_buf + 3, "%d", i);
+		ht_remove(&sparse, base_buf);
+	}
+	size_t ranged = 0;
+	for (size_t first = 0; first < sparse.capacity; first += 1000) {
+		ht_iter part = ht_iterator_range(&sparse, first, first + 1000);
+		while ((key = ht_iter_next(&part)) != NULL) {
+			assert(atoi(key + 3) % 3 != 0);
+			ranged++;
+		}
+	}
+	assert(ranged == sparse.size);
+	ht_iter none = ht_iterator_range(&sparse, 10, 5);
+	assert(ht_iter_next(&none) == NULL);
+	ht_clear(&sparse);
+	ht_iter empty = ht_iterator(&sparse);
+	assert(!ht_iter_next_pair(&empty, NULL, NULL));
+
 	// JSON stringifies correctly
 	// really, there should be a snapshot or similar to confirm this
 	char *buf_unescaped, *buf_escaped;
@@ -110,10 +231,288 @@ int main(int argc, char *argv[]) {
 	ht_removen(&table, "test", 4);
 	assert(!ht_contains(&table, "test"));
 
+	// keys are compared by length, not as prefixes
+	ht_insert(&table, "1", "one");
+	ht_insert(&table, "10", "ten");
+	assert(strcmp(ht_search(&table, "1"), "one") == 0);
+	assert(strcmp(ht_search(&table, "10"), "ten") == 0);
+	ht_remove(&table, "1");
+	assert(!ht_contains(&table, "1"));
+	assert(ht_contains(&table, "10"));
+
+	// keys and values can hold NUL bytes
+	size_t val_len = 0;
+	ht_insertn(&table, "nul\0a", 5, "x\0y", 3);
+	ht_insertn(&table, "nul\0b", 5, "z", 1);
+	assert(!ht_contains(&table, "nul"));
+	assert(memcmp(ht_searchn_len(&table, "nul\0a", 5, &val_len), "x\0y", 3) == 0);
+	assert(val_len == 3);
+	assert(strcmp(ht_searchn(&table, "nul\0b", 5), "z") == 0);
+
+	// batched lookups find the same values as single ones
+	const char *batch_keys[] = { "key0", "missing", "key999", "hello" };
+	size_t batch_lens[] = { 4, 7, 6, 5 };
+	char *batch_vals[4];
+	assert(ht_searchn_batch(&table, 4, batch_keys, batch_lens, batch_vals) == 3);
+	assert(strcmp(batch_vals[0], "val0") == 0);
+	assert(batch_vals[1] == NULL);
+	assert(strcmp(batch_vals[2], "val999") == 0);
+	assert(batch_vals[3] == ht_search(&table, "hello"));
+
 	// clearing a table removes all keys
 	ht_clear(&table);
 	assert(!ht_contains(&table, "hello"));
 	assert(table.capacity == 0);
 	assert(table.size == 0);
+
+	// arena tables behave the same, and compacting keeps every pair
+	ht_hash_table arena = { .flags = HT_ARENA };
+	for (int i = 0; i < 1000; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		sprintf(val_buf + 3, "%d", i);
+		ht_insert(&arena, base_buf, val_buf);
+	}
+	ht_insert(&arena, "key7", "replaced");
+	for (int i = 0; i < 1000; i += 2) {
+		sprintf(base_buf + 3, "%d", i);
+		ht_remove(&arena, base_buf);
+	}
+	char *taken = ht_remove_get(&arena, "key1");
+	assert(strcmp(taken, "val1") == 0);
+	free(taken);
+	assert(ht_compact(&arena));
+	assert(arena.size == 499);
+	assert(!ht_contains(&arena, "key0"));
+	assert(strcmp(ht_search(&arena, "key7"), "replaced") == 0);
+	assert(strcmp(ht_search(&arena, "key999"), "val999") == 0);
+	ht_clear(&arena);
+	assert(arena.flags == HT_ARENA);
+	assert(arena.size == 0);
+
+	// a custom hash hook replaces the built-in hash
+	ht_stats stats = {0};
+	ht_hash_table hooked = { .hash = constant_hash, .stats = &stats };
+	for (int i = 0; i < 100; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		ht_insert(&hooked, base_buf, "v");
+	}
+	ht_remove(&hooked, "key50");
+	for (int i = 0; i < 100; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		assert(ht_contains(&hooked, base_buf) == (i != 50));
+	}
+
+	// ...which piles every key into one cluster, as the analysis shows
+	size_t home = ht_bucket(&hooked, "anything");
+	assert(home == ht_bucketn(&hooked, "key1", 4));
+	assert(ht_bucket_size(&hooked, home) == 99);
+	assert(ht_bucket_size(&hooked, (home + 200) & (hooked.capacity - 1)) == 0);
+	ht_cluster_stats clusters = ht_clusters(&hooked);
+	assert(clusters.entries == 99);
+	assert(clusters.clusters == 1);
+	assert(clusters.longest_cluster == 99);
+	assert(clusters.max_displacement == 98);
+	assert(clusters.total_displacement == 98 * 99 / 2);
+#ifdef HT_STATS
+	// lookups for key0 stop at once, and those for key99 go furthest
+	assert(stats.hits[0] > 0);
+	assert(stats.misses[HT_STATS_BUCKETS - 1] == 0);
+	assert(stats.longest_probe >= 98 && stats.longest_probe < hooked.capacity);
+	assert(stats.resizes > 0 && stats.resize_ns > 0);
+
+	// every lookup counts, even identical ones whose results go unused
+	ht_stats repeated = {0};
+	ht_hash_table counted = { .stats = &repeated };
+	ht_insert(&counted, "key", "v");
+	memset(&repeated, 0, sizeof(repeated));
+	for (int i = 0; i < 10; i++) {
+		ht_contains(&counted, "key");
+		ht_search(&counted, "key");
+	}
+	uint64_t repeated_hits = 0;
+	for (int i = 0; i < HT_STATS_BUCKETS; i++) {
+		repeated_hits += repeated.hits[i];
+	}
+	assert(repeated_hits == 20);
+	ht_clear(&counted);
+#endif
+	ht_clear(&hooked);
+	assert(hooked.stats == &stats && hooked.hash == constant_hash);
+	// so does emptying it by shrinking
+	ht_insert(&hooked, "key1", "v");
+	ht_remove(&hooked, "key1");
+	ht_shrink_to_fit(&hooked);
+	assert(hooked.hash == constant_hash);
+
+	// whereas the built-in hash spreads them out
+	ht_hash_table spread = {0};
+	for (int i = 0; i < 1000; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		ht_insert(&spread, base_buf, "v");
+	}
+	clusters = ht_clusters(&spread);
+	assert(clusters.entries == 1000);
+	assert(clusters.clusters > 100);
+	assert(clusters.longest_cluster < 100);
+	size_t homed = 0;
+	for (size_t i = 0; i < spread.capacity; i++) {
+		homed += ht_bucket_size(&spread, i);
+	}
+	assert(homed == 1000);
+	ht_clear(&spread);
+	ht_cluster_stats no_entries = ht_clusters(&spread);
+	assert(no_entries.entries == 0 && no_entries.clusters == 0);
+
+	// premixed hashes are used as they are
+	ht_hash_table premixed = { .hash = first_byte_hash, .flags = HT_HASH_MIXED };
+	ht_insert(&premixed, "a", "1");
+	ht_insert(&premixed, "b", "2");
+	assert(ht_bucket(&premixed, "a") == 'a' * premixed.capacity >> 8);
+	assert(ht_bucket(&premixed, "b") == 'b' * premixed.capacity >> 8);
+	assert(strcmp(ht_search(&premixed, "b"), "2") == 0);
+	ht_clear(&premixed);
+
+	// borrowing tables keep the caller's pointers
+	const char borrowed[] = "keyvalue";
+	ht_hash_table borrowing = { .flags = HT_BORROW };
+	ht_insertn(&borrowing, borrowed, 3, borrowed + 3, 5);
+	assert(ht_searchn_len(&borrowing, "key", 3, &val_len) == borrowed + 3);
+	assert(val_len == 5);
+	taken = ht_removen_get(&borrowing, "key", 3);
+	assert(taken != borrowed + 3 && strcmp(taken, "value") == 0);
+	free(taken);
+	ht_insertn(&borrowing, borrowed, 3, borrowed, 8);
+	ht_clear(&borrowing);
+
+	// merging moves pairs over, with the source's values winning
+	ht_hash_table merged = {0}, merging = {0};
+	for (int i = 0; i < 300; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		sprintf(val_buf + 3, "%d", i);
+		ht_insert(&merged, base_buf, "old");
+		sprintf(base_buf + 3, "%d", i + 200);
+		ht_insert(&merging, base_buf, val_buf);
+	}
+	assert(ht_merge(&merged, &merging));
+	assert(merged.size == 500 && merging.size == 0 && merging.capacity == 0);
+	assert(strcmp(ht_search(&merged, "key199"), "old") == 0);
+	assert(strcmp(ht_search(&merged, "key250"), "val50") == 0);
+	assert(strcmp(ht_search(&merged, "key499"), "val299") == 0);
+	// arena pairs are copied into a table that owns its own, and arenas'
+	// slabs change hands
+	ht_hash_table arena_src = { .flags = HT_ARENA }, arena_dest = { .flags = HT_ARENA };
+	ht_insert(&arena_src, "key0", "new");
+	ht_insert(&arena_src, "extra", "1");
+	assert(ht_merge(&merged, &arena_src));
+	assert(merged.size == 501 && strcmp(ht_search(&merged, "key0"), "new") == 0);
+	ht_insert(&arena_src, "a", "1");
+	ht_insert(&arena_dest, "b", "2");
+	assert(ht_merge(&arena_dest, &arena_src));
+	assert(arena_src.slabs == NULL && strcmp(ht_search(&arena_dest, "a"), "1") == 0);
+	assert(ht_compact(&arena_dest) && strcmp(ht_search(&arena_dest, "b"), "2") == 0);
+	ht_clear(&arena_dest);
+	// tables whose hashes differ rehash, and borrowing tables take only
+	// borrowed pairs
+	ht_hash_table hooked_src = { .hash = first_byte_hash, .flags = HT_HASH_MIXED };
+	ht_insert(&hooked_src, "key0", "hooked");
+	ht_insert(&hooked_src, "zzz", "z");
+	assert(!ht_merge(&borrowing, &hooked_src) && hooked_src.size == 2);
+	assert(ht_merge(&merged, &hooked_src) && hooked_src.hash == first_byte_hash);
+	assert(merged.size == 502 && strcmp(ht_search(&merged, "key0"), "hooked") == 0);
+	assert(ht_search(&merged, "zzz") != NULL && ht_search(&merged, "key300") != NULL);
+	ht_clear(&merged);
+
+	ht_hash_table json = {0};
+	ht_insert(&json, "plain", "value");
+	struct json_buffer streamed = { .limit = SIZE_MAX };
+	char *buffered;
+	assert(ht_json_write(&json, false, json_buffer_sink, &streamed) == ht_json_stringify(&json, &buffered));
+	assert(strcmp(streamed.data, buffered) == 0);
+	free(buffered);
+	ht_insertn(&json, "esc", 3, "a\"b\\c\nd\x01" "e\tf, and some more plain text to go past a vector", 57);
+	streamed.len = 0;
+	assert(ht_json_write(&json, true, json_buffer_sink, &streamed) == streamed.len);
+	assert(strstr(streamed.data, "\"esc\":\"a\\\"b\\\\c\\nd\\u0001e\\tf, and some more plain text to go past a vector\"") != NULL);
+	assert(strstr(streamed.data, "\"plain\":\"value\"") != NULL);
+
+	// big tables go out in chunks, and a failing sink stops the writing
+	for (int i = 0; i < 5000; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		sprintf(val_buf + 3, "%d", i);
+		ht_insert(&json, base_buf, val_buf);
+	}
+	streamed.len = 0;
+	streamed.calls = 0;
+	size_t json_len = ht_json_write(&json, true, json_buffer_sink, &streamed);
+	assert(json_len == streamed.len && streamed.calls > 1);
+	streamed = (struct json_buffer) { .data = streamed.data, .limit = json_len / 2 };
+	assert(ht_json_write(&json, true, json_buffer_sink, &streamed) == 0);
+	assert(streamed.len <= json_len / 2);
+	free(streamed.data);
+#if defined(__unix__) || defined(__APPLE__)
+	FILE *json_file = tmpfile();
+	int json_fd = fileno(json_file);
+	assert(ht_json_write(&json, false, ht_json_fd_sink, &json_fd) == ht_json_stringify(&json, NULL));
+	assert((size_t) lseek(json_fd, 0, SEEK_CUR) == ht_json_stringify(&json, NULL));
+	fclose(json_file);
+#endif
+	ht_clear(&json);
+
+	// snapshots are searched in place, with the same results as the table
+	ht_hash_table saved = { .flags = HT_ARENA };
+	for (int i = 0; i < 1000; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		sprintf(val_buf + 3, "%d", i);
+		ht_insert(&saved, base_buf, val_buf);
+	}
+	ht_insertn(&saved, "nul\0a", 5, "x\0y", 3);
+	FILE *snap_file = fopen("ht-test.snapshot", "wb");
+	assert(snap_file != NULL && ht_snapshot_write(&saved, snap_file));
+	fclose(snap_file);
+	ht_snapshot snap;
+	assert(ht_snapshot_open(&snap, "ht-test.snapshot"));
+	assert(snap.size == saved.size);
+	for (int i = 0; i < 1000; i++) {
+		sprintf(base_buf + 3, "%d", i);
+		sprintf(val_buf + 3, "%d", i);
+		assert(strcmp(ht_snapshot_search(&snap, base_buf), val_buf) == 0);
+	}
+	assert(memcmp(ht_snapshot_searchn(&snap, "nul\0a", 5, &val_len), "x\0y", 3) == 0);
+	assert(val_len == 3);
+	assert(ht_snapshot_search(&snap, "missing") == NULL);
+
+	// a borrowing table can be rebuilt from a snapshot without copying it
+	ht_hash_table reloaded = { .flags = HT_BORROW };
+	assert(ht_snapshot_load(&snap, &reloaded));
+	assert(reloaded.size == saved.size);
+	assert(ht_search(&reloaded, "key42") == ht_snapshot_search(&snap, "key42"));
+	ht_clear(&reloaded);
+	ht_snapshot_close(&snap);
+	ht_clear(&saved);
+
+	// truncated or foreign bytes aren't taken for snapshots
+	snap_file = fopen("ht-test.snapshot", "rb");
+	assert(snap_file != NULL && fseek(snap_file, 0, SEEK_END) == 0);
+	size_t snap_len = (size_t) ftell(snap_file);
+	rewind(snap_file);
+	unsigned long long *snap_buf = malloc(snap_len);
+	assert(fread(snap_buf, 1, snap_len, snap_file) == snap_len);
+	fclose(snap_file);
+	remove("ht-test.snapshot");
+	assert(ht_snapshot_view(&snap, snap_buf, snap_len));
+	assert(!ht_snapshot_view(&snap, snap_buf, snap_len - 1));
+	// nor are pairs whose NULs are missing
+	assert(ht_snapshot_view(&snap, snap_buf, snap_len));
+	char *damaged = (char *) ht_snapshot_search(&snap, "key42");
+	damaged[5] = 'x';
+	assert(ht_snapshot_search(&snap, "key42") == NULL);
+	damaged[5] = '\0';
+	damaged[-1] = 'x';
+	assert(ht_snapshot_search(&snap, "key42") == NULL);
+	damaged[-1] = '\0';
+	assert(strcmp(ht_snapshot_search(&snap, "key42"), "val42") == 0);
+	memcpy(snap_buf, "NOTSNAP!", 8);
+	assert(!ht_snapshot_view(&snap, snap_buf, snap_len));
+	free(snap_buf);
 	return 0;
 }
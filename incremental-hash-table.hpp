@@ -0,0 +1,438 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "hash-table.hpp"
+
+// A `HashTable` that grows incrementally: rather than moving every entry
+// into a bigger array in the insert that crosses the maximum load factor,
+// it starts a new table and keeps the old one alongside it, and every later
+// lookup or modification moves a bounded number of the old table's slots
+// into the new one (like Redis's dict rehashing). New keys always go into
+// the new table; each key is in exactly one of the two at any time.
+//
+// The old table is drained fast enough that it's always empty before the
+// new one fills, so no single call ever moves more than `migrate_step()`
+// slots' worth of entries, apart from `reserve`, `rehash`, `shrink_to_fit`,
+// `max_load_factor` and `finish_resize`, which finish any resize in progress
+// first.
+//
+// Since non-const lookups move entries too, iterators are only valid until
+// the next non-const call other than `erase(iterator)`.
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class KeyEqual = std::equal_to<Key>,
+	class Probe = LinearProbing,
+	class Allocator = std::allocator<std::pair<const Key, T>>,
+	bool CacheHash = false
+>
+class IncrementalHashTable {
+public:
+	using Table = HashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>;
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = std::pair<const Key, T>;
+	using size_type = size_t;
+	using difference_type = ptrdiff_t;
+	using hasher = Hash;
+	using key_equal = KeyEqual;
+	using allocator_type = Allocator;
+	using reference = value_type&;
+	using const_reference = const value_type&;
+	using pointer = value_type*;
+	using const_pointer = const value_type*;
+	class iterator;
+	class const_iterator;
+
+	static constexpr size_t DEFAULT_MIGRATE_STEP = 64;
+
+private:
+	// `table` takes every insert; `old` is the table being drained, and is
+	// empty with no capacity when no resize is in progress. Slots of `old`
+	// before `cursor` have already been moved.
+	Table table;
+	Table old;
+	size_t cursor;
+	size_t min_step;
+	size_t step;
+
+	bool migrating() const noexcept {
+		return this->old.capacity != 0;
+	}
+	// Moves the next `step` slots of `old` into `table`.
+	void migrate() {
+		if (!this->migrating()) {
+			return;
+		}
+		this->cursor = this->old.migrate_to(this->table, this->cursor, this->step);
+		if (this->cursor == this->old.capacity) {
+			this->old.clear();
+			this->cursor = 0;
+		}
+	}
+	// Called instead of `table` growing in place: it becomes the old table,
+	// and a new one with the capacity it would have grown to replaces it.
+	void start_resize() {
+		this->finish_resize();
+		size_t new_cap = this->table.next_capacity();
+		Table next(new_cap, this->table.hashf, this->table.cmp, this->table.get_allocator());
+		next.max_load_factor(this->table.load_limit);
+		next.growth_factor(this->table.growth);
+		this->old = std::move(this->table);
+		this->table = std::move(next);
+		this->cursor = 0;
+		// Every insert of a new key migrates first, so this many slots per
+		// insert empties `old` before `table` reaches its own limit.
+		size_t room = this->table.grow_at > this->old.len ? this->table.grow_at - this->old.len : 0;
+		if (room == 0) {
+			this->finish_resize();
+			return;
+		}
+		this->step = std::max(this->min_step, (this->old.capacity + room - 1) / room);
+	}
+
+	// Inserts an entry constructed from `args` unless `key`, its key, is
+	// already in either table.
+	template<class... Args>
+	std::pair<iterator, bool> emplace_key(const Key& key, Args&&... args);
+
+public:
+	class iterator {
+		friend class IncrementalHashTable;
+	private:
+		// Walks `old` up to `old_end`, then `table` from `table_begin`.
+		typename Table::iterator it;
+		typename Table::iterator old_end;
+		typename Table::iterator table_begin;
+		bool in_old;
+		iterator(typename Table::iterator it, typename Table::iterator old_end, typename Table::iterator table_begin, bool in_old) noexcept :
+			it(it), old_end(old_end), table_begin(table_begin), in_old(in_old) {
+			this->skip_old_end();
+		}
+		void skip_old_end() noexcept {
+			if (this->in_old && this->it == this->old_end) {
+				this->it = this->table_begin;
+				this->in_old = false;
+			}
+		}
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = IncrementalHashTable::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = value_type*;
+		using reference = value_type&;
+		iterator& operator++() noexcept {
+			++this->it;
+			this->skip_old_end();
+			return *this;
+		}
+		iterator operator++(int) noexcept {
+			iterator out = *this;
+			++(*this);
+			return out;
+		}
+		bool operator==(const iterator& other) const noexcept {
+			return this->it == other.it;
+		}
+		bool operator!=(const iterator& other) const noexcept {
+			return !(*this == other);
+		}
+		reference operator*() {
+			return *this->it;
+		}
+		operator const_iterator() const {
+			return const_iterator(this->it, this->old_end, this->table_begin, this->in_old);
+		}
+	};
+	class const_iterator {
+		friend class IncrementalHashTable;
+	private:
+		typename Table::const_iterator it;
+		typename Table::const_iterator old_end;
+		typename Table::const_iterator table_begin;
+		bool in_old;
+		const_iterator(typename Table::const_iterator it, typename Table::const_iterator old_end, typename Table::const_iterator table_begin, bool in_old) noexcept :
+			it(it), old_end(old_end), table_begin(table_begin), in_old(in_old) {
+			this->skip_old_end();
+		}
+		void skip_old_end() noexcept {
+			if (this->in_old && this->it == this->old_end) {
+				this->it = this->table_begin;
+				this->in_old = false;
+			}
+		}
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = IncrementalHashTable::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type*;
+		using reference = const value_type&;
+		const_iterator& operator++() noexcept {
+			++this->it;
+			this->skip_old_end();
+			return *this;
+		}
+		const_iterator operator++(int) noexcept {
+			const_iterator out = *this;
+			++(*this);
+			return out;
+		}
+		bool operator==(const const_iterator& other) const noexcept {
+			return this->it == other.it;
+		}
+		bool operator!=(const const_iterator& other) const noexcept {
+			return !(*this == other);
+		}
+		const_reference operator*() const {
+			return *this->it;
+		}
+	};
+
+	IncrementalHashTable() : cursor(0), min_step(DEFAULT_MIGRATE_STEP), step(DEFAULT_MIGRATE_STEP) { }
+	explicit IncrementalHashTable(const allocator_type& alloc) :
+		table(alloc), old(alloc), cursor(0), min_step(DEFAULT_MIGRATE_STEP), step(DEFAULT_MIGRATE_STEP) { }
+	IncrementalHashTable(size_t bucket_count, const Hash& hash = Hash{}, const KeyEqual& cmp = KeyEqual{}, const allocator_type& alloc = allocator_type{}) :
+		table(bucket_count, hash, cmp, alloc), old(0, hash, cmp, alloc), cursor(0), min_step(DEFAULT_MIGRATE_STEP), step(DEFAULT_MIGRATE_STEP) { }
+
+	allocator_type get_allocator() const noexcept {
+		return this->table.get_allocator();
+	}
+
+	size_t size() const noexcept {
+		return this->table.size() + this->old.size();
+	}
+	bool empty() const noexcept {
+		return this->size() == 0;
+	}
+	// Whether an old table is still being drained.
+	bool resizing() const noexcept {
+		return this->migrating();
+	}
+	// How many of the old table's slots each call moves at least; it may
+	// move more if that's needed to finish before the new table fills.
+	size_t migrate_step() const noexcept {
+		return this->min_step;
+	}
+	void migrate_step(size_t slots) noexcept {
+		this->min_step = std::max(slots, (size_t) 1);
+		this->step = std::max(this->step, this->min_step);
+	}
+	// Moves everything left in the old table at once.
+	void finish_resize() {
+		if (this->migrating()) {
+			this->old.migrate_to(this->table, this->cursor, this->old.capacity - this->cursor);
+			this->old.clear();
+			this->cursor = 0;
+		}
+	}
+
+	bool contains(const Key& key) const {
+		return this->table.contains(key) || this->old.contains(key);
+	}
+	size_t count(const Key& key) const {
+		return this->contains(key) ? 1 : 0;
+	}
+
+	iterator find(const Key& key) {
+		this->migrate();
+		auto it = this->old.find(key);
+		if (it != this->old.end()) {
+			return iterator(it, this->old.end(), this->table.begin(), true);
+		}
+		it = this->table.find(key);
+		if (it != this->table.end()) {
+			return iterator(it, this->old.end(), this->table.begin(), false);
+		}
+		return this->end();
+	}
+	// Doesn't migrate anything.
+	const_iterator find(const Key& key) const {
+		auto it = this->old.find(key);
+		if (it != this->old.cend()) {
+			return const_iterator(it, this->old.cend(), this->table.cbegin(), true);
+		}
+		it = this->table.find(key);
+		if (it != this->table.cend()) {
+			return const_iterator(it, this->old.cend(), this->table.cbegin(), false);
+		}
+		return this->cend();
+	}
+
+	T& at(const Key& key) {
+		iterator it = this->find(key);
+		if (it == this->end()) {
+			throw std::out_of_range("key not in IncrementalHashTable");
+		}
+		return (*it).second;
+	}
+	const T& at(const Key& key) const {
+		const_iterator it = this->find(key);
+		if (it == this->cend()) {
+			throw std::out_of_range("key not in IncrementalHashTable");
+		}
+		return (*it).second;
+	}
+	T& operator[](const Key& key) {
+		return (*this->try_emplace(key).first).second;
+	}
+	T& operator[](Key&& key) {
+		return (*this->try_emplace(std::move(key)).first).second;
+	}
+
+	template<class... Args>
+	std::pair<iterator, bool> emplace(Args&&... args) {
+		typename Table::MutableValue pair(std::forward<Args>(args)...);
+		return this->emplace_key(pair.first, std::move(pair));
+	}
+	// Only constructs the entry if `key` isn't in the table yet.
+	template<class... Args>
+	std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+		return this->emplace_key(
+			key,
+			std::piecewise_construct,
+			std::forward_as_tuple(key),
+			std::forward_as_tuple(std::forward<Args>(args)...)
+		);
+	}
+	template<class... Args>
+	std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+		return this->emplace_key(
+			key,
+			std::piecewise_construct,
+			std::forward_as_tuple(std::move(key)),
+			std::forward_as_tuple(std::forward<Args>(args)...)
+		);
+	}
+	std::pair<iterator, bool> insert(const value_type& pair) {
+		return this->emplace(pair);
+	}
+	std::pair<iterator, bool> insert(value_type&& pair) {
+		return this->emplace(std::move(pair));
+	}
+	template<class M>
+	std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj) {
+		auto out = this->try_emplace(key, std::forward<M>(obj));
+		if (!out.second) {
+			(*out.first).second = std::forward<M>(obj);
+		}
+		return out;
+	}
+
+	size_t erase(const Key& key) {
+		this->migrate();
+		return this->old.erase(key) + this->table.erase(key);
+	}
+	// Like `HashTable::erase`, the returned iterator may point at the slot
+	// that was just erased.
+	iterator erase(iterator pos) {
+		if (pos.in_old) {
+			return iterator(this->old.erase(pos.it), this->old.end(), this->table.begin(), true);
+		} else {
+			return iterator(this->table.erase(pos.it), this->old.end(), this->table.begin(), false);
+		}
+	}
+
+	void clear() {
+		this->table.clear();
+		this->old.clear();
+		this->cursor = 0;
+	}
+
+	void reserve(size_t count) {
+		this->finish_resize();
+		this->table.reserve(count);
+	}
+	void rehash(size_t bucket_count) {
+		this->finish_resize();
+		this->table.rehash(bucket_count);
+	}
+	void shrink_to_fit() {
+		this->finish_resize();
+		this->table.shrink_to_fit();
+	}
+
+	iterator begin() noexcept {
+		return iterator(this->old.begin(), this->old.end(), this->table.begin(), true);
+	}
+	iterator end() noexcept {
+		return iterator(this->table.end(), this->old.end(), this->table.begin(), false);
+	}
+	const_iterator begin() const noexcept {
+		return this->cbegin();
+	}
+	const_iterator end() const noexcept {
+		return this->cend();
+	}
+	const_iterator cbegin() const noexcept {
+		return const_iterator(this->old.cbegin(), this->old.cend(), this->table.cbegin(), true);
+	}
+	const_iterator cend() const noexcept {
+		return const_iterator(this->table.cend(), this->old.cend(), this->table.cbegin(), false);
+	}
+
+	// The capacity of the newest table, which is what the table ends up
+	// with once any resize finishes.
+	size_t bucket_count() const noexcept {
+		return this->table.bucket_count();
+	}
+	float max_load_factor() const noexcept {
+		return this->table.max_load_factor();
+	}
+	void max_load_factor(float ml) {
+		this->finish_resize();
+		this->table.max_load_factor(ml);
+	}
+	float growth_factor() const noexcept {
+		return this->table.growth_factor();
+	}
+	void growth_factor(float factor) noexcept {
+		this->table.growth_factor(factor);
+	}
+
+	Hash hash_function() const {
+		return this->table.hash_function();
+	}
+	KeyEqual key_eq() const {
+		return this->table.key_eq();
+	}
+};
+
+template<class Key, class T, class Hash, class KeyEqual, class Probe, class Allocator, bool CacheHash>
+template<class... Args>
+auto IncrementalHashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>::emplace_key(const Key& key, Args&&... args) -> std::pair<iterator, bool> {
+	this->migrate();
+	if (this->migrating()) {
+		auto it = this->old.find(key);
+		if (it != this->old.end()) {
+			return std::make_pair(iterator(it, this->old.end(), this->table.begin(), true), false);
+		}
+	}
+	if (this->table.capacity == 0) {
+		this->table.reserve_exact(0, this->table.initial_capacity());
+	}
+	size_t mixed = Table::mix(key, this->table.hashf);
+	auto [contains, index] = this->table.find_slot(key, mixed);
+	if (contains) {
+		auto it = this->table.iterator_at(index);
+		return std::make_pair(iterator(it, this->old.end(), this->table.begin(), false), false);
+	}
+	typename Table::iterator it;
+	if (this->table.len >= this->table.grow_at) {
+		// built before `table` is moved, since `args` may refer into it
+		typename Table::MutableValue pair(std::forward<Args>(args)...);
+		this->start_resize();
+		this->table.len++;
+		it = this->table.inner_insert(this->table.view(), mixed, std::move(pair)).first;
+	} else {
+		it = this->table.emplace_unique_hint(index, mixed, std::forward<Args>(args)...).first;
+	}
+	return std::make_pair(iterator(it, this->old.end(), this->table.begin(), false), true);
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "hash-table.hpp"
+
+// A hash table for data that's read far more often than it changes. Lookups
+// never take a lock or write to memory other threads write: each reader
+// thread announces the epoch it's reading in through its own cache line, then
+// reads whichever `HashTable` is current. Writers copy the current table,
+// modify the copy, and publish it through an atomic pointer; the table it
+// replaced is freed once every reader has moved past the epoch it was
+// retired in.
+//
+// Every write therefore costs a copy of the whole table, so group changes
+// that come together into one `update`. Writers are serialized by a mutex.
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class KeyEqual = std::equal_to<Key>,
+	class Probe = LinearProbing,
+	class Allocator = std::allocator<std::pair<const Key, T>>,
+	bool CacheHash = false
+>
+class ReadMostlyHashTable {
+public:
+	using Table = HashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>;
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = std::pair<const Key, T>;
+	using size_type = size_t;
+	class Reader;
+
+private:
+	static constexpr uint64_t IDLE = UINT64_MAX;
+
+	// The epoch one reader is reading in, or `IDLE`. Only its reader writes
+	// it, and each gets its own cache line.
+	struct alignas(64) ReaderSlot {
+		std::atomic<uint64_t> epoch = IDLE;
+		// Guarded by `write_lock`.
+		bool in_use = false;
+	};
+
+	std::atomic<Table*> current;
+	std::atomic<uint64_t> epoch;
+	// Everything below is guarded by `write_lock`.
+	std::mutex write_lock;
+	std::vector<std::unique_ptr<ReaderSlot>> readers;
+	// Replaced tables, with the epoch each was retired in.
+	std::vector<std::pair<uint64_t, Table*>> retired;
+
+	// Frees retired tables that no reader can still be using: those
+	// retired before the oldest epoch any reader is in.
+	void reclaim() {
+		uint64_t oldest = IDLE;
+		for (const auto& slot : this->readers) {
+			oldest = std::min(oldest, slot->epoch.load(std::memory_order_seq_cst));
+		}
+		auto live = std::remove_if(this->retired.begin(), this->retired.end(), [&](const auto& entry) {
+			if (entry.first < oldest) {
+				delete entry.second;
+				return true;
+			}
+			return false;
+		});
+		this->retired.erase(live, this->retired.end());
+	}
+	// Makes `next` current. `write_lock` must be held.
+	void publish(std::unique_ptr<Table> next) {
+		this->retired.reserve(this->retired.size() + 1);
+		Table* old = this->current.exchange(next.release(), std::memory_order_seq_cst);
+		// readers that saw an epoch up to this one may have loaded `old`;
+		// later readers can only see the new table
+		this->retired.emplace_back(this->epoch.fetch_add(1, std::memory_order_seq_cst), old);
+		this->reclaim();
+	}
+
+public:
+	ReadMostlyHashTable() : current(new Table()), epoch(0) { }
+	explicit ReadMostlyHashTable(Table table) : current(new Table(std::move(table))), epoch(0) { }
+	ReadMostlyHashTable(const ReadMostlyHashTable&) = delete;
+	ReadMostlyHashTable& operator=(const ReadMostlyHashTable&) = delete;
+	// Every `Reader` must have been destroyed first.
+	~ReadMostlyHashTable() {
+		for (const auto& entry : this->retired) {
+			delete entry.second;
+		}
+		delete this->current.load(std::memory_order_relaxed);
+	}
+
+	// A handle one thread reads through; create one per reader thread and
+	// keep it for as long as the thread keeps reading, since creating one
+	// takes the writers' lock. A handle mustn't be shared between threads
+	// or outlive its table.
+	class Reader {
+		friend class ReadMostlyHashTable;
+		ReadMostlyHashTable* owner;
+		ReaderSlot* slot;
+		size_t depth;
+
+		explicit Reader(ReadMostlyHashTable& owner) : owner(&owner), slot(nullptr), depth(0) {
+			std::lock_guard guard(owner.write_lock);
+			for (const auto& slot : owner.readers) {
+				if (!slot->in_use) {
+					this->slot = slot.get();
+					break;
+				}
+			}
+			if (this->slot == nullptr) {
+				owner.readers.push_back(std::make_unique<ReaderSlot>());
+				this->slot = owner.readers.back().get();
+			}
+			this->slot->in_use = true;
+		}
+
+		const Table* enter() noexcept {
+			if (this->depth++ == 0) {
+				this->slot->epoch.store(this->owner->epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				// the announcement has to be visible before the table
+				// pointer is read, or a writer could free the table first
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+			}
+			return this->owner->current.load(std::memory_order_acquire);
+		}
+		void exit() noexcept {
+			if (--this->depth == 0) {
+				this->slot->epoch.store(IDLE, std::memory_order_release);
+			}
+		}
+
+	public:
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+		~Reader() {
+			std::lock_guard guard(this->owner->write_lock);
+			this->slot->in_use = false;
+		}
+
+		// Keeps one version of the table alive, so any number of lookups
+		// can go through it without announcing an epoch for each. A pinned
+		// version never sees later writes (though lookups through the
+		// `Reader` itself still do), and holds back freeing newer replaced
+		// ones, so pins should be short.
+		class Pin {
+			friend class Reader;
+			Reader* reader;
+			const Table* table;
+
+			explicit Pin(Reader& reader) noexcept : reader(&reader), table(reader.enter()) { }
+		public:
+			Pin(const Pin&) = delete;
+			Pin& operator=(const Pin&) = delete;
+			~Pin() {
+				this->reader->exit();
+			}
+			const Table& operator*() const noexcept {
+				return *this->table;
+			}
+			const Table* operator->() const noexcept {
+				return this->table;
+			}
+		};
+
+		Pin pin() noexcept {
+			return Pin(*this);
+		}
+		bool contains(const Key& key) {
+			return this->pin()->contains(key);
+		}
+		// A copy of the value for `key`, if there is one.
+		std::optional<T> find(const Key& key) {
+			Pin pinned = this->pin();
+			auto iter = pinned->find(key);
+			return iter == pinned->cend() ? std::nullopt : std::optional<T>((*iter).second);
+		}
+		// Calls `f(value)` while the table is pinned, if `key` exists;
+		// returns whether it did.
+		template<class F>
+		bool visit(const Key& key, F&& f) {
+			Pin pinned = this->pin();
+			auto iter = pinned->find(key);
+			if (iter == pinned->cend()) {
+				return false;
+			}
+			std::forward<F>(f)((*iter).second);
+			return true;
+		}
+	};
+
+	Reader reader() {
+		return Reader(*this);
+	}
+
+	// Calls `f(table)` on a copy of the current table, then publishes it.
+	template<class F>
+	void update(F&& f) {
+		std::lock_guard guard(this->write_lock);
+		auto next = std::make_unique<Table>(*this->current.load(std::memory_order_relaxed));
+		std::forward<F>(f)(*next);
+		this->publish(std::move(next));
+	}
+	// Returns `true` if `key` was inserted, or `false` if an existing value
+	// was replaced.
+	template<class M>
+	bool insert_or_assign(const Key& key, M&& obj) {
+		bool inserted = false;
+		this->update([&](Table& table) {
+			inserted = table.insert_or_assign(key, std::forward<M>(obj)).second;
+		});
+		return inserted;
+	}
+	// Doesn't copy the table if `key` doesn't exist.
+	size_t erase(const Key& key) {
+		{
+			std::lock_guard guard(this->write_lock);
+			if (!this->current.load(std::memory_order_relaxed)->contains(key)) {
+				return 0;
+			}
+		}
+		size_t erased = 0;
+		this->update([&](Table& table) {
+			erased = table.erase(key);
+		});
+		return erased;
+	}
+	void clear() {
+		std::lock_guard guard(this->write_lock);
+		this->publish(std::make_unique<Table>());
+	}
+	// The current table's size; writers can change it at any time.
+	size_t size() {
+		std::lock_guard guard(this->write_lock);
+		return this->current.load(std::memory_order_relaxed)->size();
+	}
+	// Replaced tables not yet freed because a reader may still use them.
+	size_t retired_count() {
+		std::lock_guard guard(this->write_lock);
+		return this->retired.size();
+	}
+};
@@ -0,0 +1,425 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "hash-table.hpp"
+
+namespace ht_detail {
+	// A bit for each of `keys[0..M)`, set if it equals `key`, comparing as
+	// many keys at a time as fit in a vector register. `M` is at most 64
+	// and known at compile time, so the loops unroll.
+	template<size_t M, class Key>
+	uint64_t match_packed(const Key* keys, Key key) noexcept {
+		static_assert(M <= 64, "match_packed matches at most 64 keys");
+		uint64_t mask = 0;
+#if defined(__AVX2__)
+		constexpr size_t LANES = sizeof(__m256i) / sizeof(Key);
+		__m256i needle;
+		if constexpr (sizeof(Key) == 8) {
+			needle = _mm256_set1_epi64x((long long) key);
+		} else {
+			needle = _mm256_set1_epi32((int) key);
+		}
+		constexpr size_t VECTORED = M - M % LANES;
+		for (size_t i = 0; i < VECTORED; i += LANES) {
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+			uint64_t bits;
+			if constexpr (sizeof(Key) == 8) {
+				bits = (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(block, needle)));
+			} else {
+				bits = (uint64_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block, needle)));
+			}
+			mask |= bits << i;
+		}
+#elif defined(__SSE2__)
+		constexpr size_t LANES = sizeof(__m128i) / sizeof(Key);
+		__m128i needle;
+		if constexpr (sizeof(Key) == 8) {
+			needle = _mm_set1_epi64x((long long) key);
+		} else {
+			needle = _mm_set1_epi32((int) key);
+		}
+		constexpr size_t VECTORED = M - M % LANES;
+		for (size_t i = 0; i < VECTORED; i += LANES) {
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+			__m128i eq = _mm_cmpeq_epi32(block, needle);
+			uint64_t bits;
+			if constexpr (sizeof(Key) == 8) {
+				// SSE2 has no 64-bit compare, so both halves have to match
+				eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+				bits = (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(eq));
+			} else {
+				bits = (uint64_t) _mm_movemask_ps(_mm_castsi128_ps(eq));
+			}
+			mask |= bits << i;
+		}
+#else
+		constexpr size_t VECTORED = 0;
+#endif
+		for (size_t i = VECTORED; i < M; i++) {
+			mask |= (uint64_t) (keys[i] == key) << i;
+		}
+		return mask;
+	}
+
+	// The index of the first of `keys[0..count)` equal to `key`, or `count`.
+	// All `N` keys are compared at once, without a branch per key, so they
+	// all have to hold some value; matches past `count` are ignored.
+	template<size_t N, class Key>
+	size_t find_packed(const Key* keys, size_t count, Key key) noexcept {
+		static_assert(std::is_integral_v<Key> && (sizeof(Key) == 4 || sizeof(Key) == 8), "find_packed compares 32- or 64-bit integers");
+		if constexpr (N > 64) {
+			// 64 at a time
+			if (count <= 64) {
+				return ht_detail::find_packed<64>(keys, count, key);
+			}
+			uint64_t mask = ht_detail::match_packed<64>(keys, key);
+			if (mask != 0) {
+				return (size_t) ht_detail::countr_zero(mask);
+			}
+			return 64 + ht_detail::find_packed<N - 64>(keys + 64, count - 64, key);
+		} else {
+			uint64_t mask = ht_detail::match_packed<N>(keys, key);
+			if (count < 64) {
+				mask &= ((uint64_t) 1 << count) - 1;
+			}
+			if (mask != 0) {
+				return (size_t) ht_detail::countr_zero(mask);
+			}
+		}
+		return count;
+	}
+}
+
+// A table for maps that usually hold only a handful of entries, like a
+// request's headers. Up to `N` entries live inline, in the object itself, and
+// are found by comparing keys one after another (a vector of them at a time
+// for 32- and 64-bit integer keys), so no slot array is allocated and keys
+// aren't even hashed. Inserting entry `N + 1` moves them
+// all into a `HashTable`, which the table then uses until `clear`, even if
+// it shrinks again. The parameters after `N` are the `HashTable`'s.
+//
+// Inline entries are kept packed at the front of the storage, and erasing
+// one moves the last into its place, so pointers to values stay valid only
+// until the next insert or erase.
+template<
+	class Key,
+	class T,
+	size_t N = 8,
+	class Hash = std::hash<Key>,
+	class KeyEqual = std::equal_to<Key>,
+	class Probe = LinearProbing,
+	class Allocator = std::allocator<std::pair<const Key, T>>,
+	bool CacheHash = false
+>
+class SmallHashTable {
+	static_assert(N > 0, "A small table must hold at least one entry inline");
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using size_type = size_t;
+	using hasher = Hash;
+	using key_equal = KeyEqual;
+	using allocator_type = Allocator;
+	using Table = HashTable<Key, T, Hash, KeyEqual, Probe, Allocator, CacheHash>;
+
+	static constexpr size_t INLINE_CAPACITY = N;
+
+private:
+	// Inline keys and values are kept in arrays of their own, so integer
+	// keys are packed together for `find_packed`, which reads all `N`; their
+	// storage is zeroed up front so that it never reads uninitialized keys.
+	// Keys aren't `const`, so erasing can move the last entry into the hole.
+	alignas(Key) unsigned char key_storage[N * sizeof(Key)];
+	alignas(T) unsigned char value_storage[N * sizeof(T)];
+	size_t count;
+	// Empty, and so without a slot array, until the inline entries overflow.
+	Table table;
+	KeyEqual cmp;
+
+	static constexpr bool PACKED_KEYS = std::is_integral_v<Key> && (sizeof(Key) == 4 || sizeof(Key) == 8)
+		&& (std::is_same_v<KeyEqual, std::equal_to<Key>> || std::is_same_v<KeyEqual, std::equal_to<>>);
+
+	using EntryNothrowMove = std::conjunction<std::is_nothrow_move_constructible<Key>, std::is_nothrow_move_constructible<T>>;
+	using TableNothrowMove = std::is_nothrow_move_constructible<Table>;
+
+	Key* keys() const noexcept {
+		return std::launder(reinterpret_cast<Key*>(const_cast<unsigned char*>(this->key_storage)));
+	}
+	T* values() const noexcept {
+		return std::launder(reinterpret_cast<T*>(const_cast<unsigned char*>(this->value_storage)));
+	}
+	void zero_keys() noexcept {
+		if constexpr (PACKED_KEYS) {
+			std::memset(this->key_storage, 0, sizeof(this->key_storage));
+		}
+	}
+	bool spilled() const noexcept {
+		return this->table.bucket_count() != 0;
+	}
+	// Which inline entry holds `key`, or `count`.
+	size_t inline_index(const Key& key) const {
+		if constexpr (PACKED_KEYS) {
+			return ht_detail::find_packed<N>(this->keys(), this->count, key);
+		} else {
+			Key* keys = this->keys();
+			size_t i = 0;
+			while (i < this->count && !this->cmp(keys[i], key)) {
+				i++;
+			}
+			return i;
+		}
+	}
+	// Constructs inline entry `count`, which must be free, from `key` and
+	// `args`, then counts it.
+	template<class K, class... Args>
+	T* construct_inline(K&& key, Args&&... args) {
+		size_t i = this->count;
+		Key* slot = new (&this->key_storage[i * sizeof(Key)]) Key(std::forward<K>(key));
+		T* value;
+		try {
+			value = new (&this->value_storage[i * sizeof(T)]) T(std::forward<Args>(args)...);
+		} catch (...) {
+			slot->~Key();
+			throw;
+		}
+		this->count++;
+		return value;
+	}
+	void destroy_inline() noexcept {
+		Key* keys = this->keys();
+		T* values = this->values();
+		for (size_t i = 0; i < this->count; i++) {
+			keys[i].~Key();
+			values[i].~T();
+		}
+		this->count = 0;
+	}
+	void copy_inline(const SmallHashTable& other) {
+		Key* keys = other.keys();
+		T* values = other.values();
+		while (this->count < other.count) {
+			this->construct_inline(keys[this->count], values[this->count]);
+		}
+	}
+	// Takes `other`'s inline entries, which must be all it has.
+	void move_inline(SmallHashTable& other) noexcept(EntryNothrowMove::value) {
+		Key* keys = other.keys();
+		T* values = other.values();
+		while (this->count < other.count) {
+			this->construct_inline(std::move(keys[this->count]), std::move(values[this->count]));
+		}
+		other.destroy_inline();
+	}
+	// Moves every inline entry into `table`, making room for `total` entries.
+	void spill(size_t total) {
+		this->table.reserve(std::max(total, 2 * N));
+		Key* keys = this->keys();
+		T* values = this->values();
+		for (size_t i = 0; i < this->count; i++) {
+			this->table.insert_unique(std::move(keys[i]), std::move(values[i]));
+		}
+		this->destroy_inline();
+	}
+	// Inserts a new entry for `key`, which must not be in the table.
+	template<class K, class... Args>
+	T* insert_new(K&& key, Args&&... args) {
+		if (this->count == N) {
+			this->spill(N + 1);
+		}
+		if (this->spilled()) {
+			return &(*this->table.try_emplace(std::forward<K>(key), std::forward<Args>(args)...).first).second;
+		}
+		return this->construct_inline(std::forward<K>(key), std::forward<Args>(args)...);
+	}
+	template<class K, class... Args>
+	std::pair<T*, bool> emplace_key(K&& key, Args&&... args) {
+		if (T* found = this->find(key)) {
+			return std::make_pair(found, false);
+		}
+		return std::make_pair(this->insert_new(std::forward<K>(key), std::forward<Args>(args)...), true);
+	}
+	template<class K, class M>
+	bool assign_key(K&& key, M&& obj) {
+		if (T* found = this->find(key)) {
+			*found = std::forward<M>(obj);
+			return false;
+		}
+		this->insert_new(std::forward<K>(key), std::forward<M>(obj));
+		return true;
+	}
+
+public:
+	SmallHashTable() : SmallHashTable(Hash{}) { }
+	explicit SmallHashTable(const Hash& hash, const KeyEqual& cmp = KeyEqual{}, const allocator_type& alloc = allocator_type{})
+		: count(0), table(0, hash, cmp, alloc), cmp(cmp)
+	{
+		this->zero_keys();
+	}
+	SmallHashTable(const SmallHashTable& other) : count(0), table(other.table), cmp(other.cmp) {
+		this->zero_keys();
+		this->copy_inline(other);
+	}
+	SmallHashTable(SmallHashTable&& other) noexcept(EntryNothrowMove::value && TableNothrowMove::value)
+		: count(0), table(std::move(other.table)), cmp(other.cmp)
+	{
+		this->zero_keys();
+		this->move_inline(other);
+	}
+	SmallHashTable& operator=(const SmallHashTable& other) {
+		if (this != &other) {
+			this->destroy_inline();
+			this->table = other.table;
+			this->cmp = other.cmp;
+			this->copy_inline(other);
+		}
+		return *this;
+	}
+	SmallHashTable& operator=(SmallHashTable&& other) noexcept(EntryNothrowMove::value && TableNothrowMove::value) {
+		if (this != &other) {
+			this->destroy_inline();
+			this->table = std::move(other.table);
+			this->cmp = other.cmp;
+			this->move_inline(other);
+		}
+		return *this;
+	}
+	~SmallHashTable() {
+		this->destroy_inline();
+	}
+
+	size_t size() const noexcept {
+		return this->spilled() ? this->table.size() : this->count;
+	}
+	bool empty() const noexcept {
+		return this->size() == 0;
+	}
+	// Whether the entries are still inline, rather than in a slot array.
+	bool is_inline() const noexcept {
+		return !this->spilled();
+	}
+	// Moves the entries into a slot array now if `count` won't fit inline.
+	void reserve(size_t count) {
+		if (this->spilled()) {
+			this->table.reserve(count);
+		} else if (count > N) {
+			this->spill(count);
+		}
+	}
+
+	T* find(const Key& key) {
+		if (this->spilled()) {
+			auto iter = this->table.find(key);
+			return iter == this->table.end() ? nullptr : &(*iter).second;
+		}
+		size_t i = this->inline_index(key);
+		return i == this->count ? nullptr : &this->values()[i];
+	}
+	const T* find(const Key& key) const {
+		return const_cast<SmallHashTable*>(this)->find(key);
+	}
+	bool contains(const Key& key) const {
+		return this->find(key) != nullptr;
+	}
+	T& at(const Key& key) {
+		T* found = this->find(key);
+		if (found == nullptr) {
+			throw std::out_of_range("Key doesn't exist");
+		}
+		return *found;
+	}
+	const T& at(const Key& key) const {
+		return const_cast<SmallHashTable*>(this)->at(key);
+	}
+	T& operator[](const Key& key) {
+		return *this->emplace_key(key).first;
+	}
+	T& operator[](Key&& key) {
+		return *this->emplace_key(std::move(key)).first;
+	}
+
+	// Inserts `T(args...)` for `key` if it isn't there; returns the value for
+	// `key` and whether it was inserted.
+	template<class... Args>
+	std::pair<T*, bool> try_emplace(const Key& key, Args&&... args) {
+		return this->emplace_key(key, std::forward<Args>(args)...);
+	}
+	template<class... Args>
+	std::pair<T*, bool> try_emplace(Key&& key, Args&&... args) {
+		return this->emplace_key(std::move(key), std::forward<Args>(args)...);
+	}
+	// Returns `true` if `key` was inserted, or `false` if an existing value
+	// was replaced.
+	template<class M>
+	bool insert_or_assign(const Key& key, M&& obj) {
+		return this->assign_key(key, std::forward<M>(obj));
+	}
+	template<class M>
+	bool insert_or_assign(Key&& key, M&& obj) {
+		return this->assign_key(std::move(key), std::forward<M>(obj));
+	}
+
+	size_t erase(const Key& key) {
+		if (this->spilled()) {
+			return this->table.erase(key);
+		}
+		size_t i = this->inline_index(key);
+		if (i == this->count) {
+			return 0;
+		}
+		size_t last = --this->count;
+		Key* keys = this->keys();
+		T* values = this->values();
+		if (i != last) {
+			keys[i] = std::move(keys[last]);
+			values[i] = std::move(values[last]);
+		}
+		keys[last].~Key();
+		values[last].~T();
+		return 1;
+	}
+	// Frees any slot array, so the table starts over inline.
+	void clear() noexcept {
+		this->destroy_inline();
+		this->table.clear();
+	}
+
+	// Calls `f(key, value)` for every entry.
+	template<class F>
+	void for_each(F&& f) {
+		if (this->spilled()) {
+			this->table.for_each([&](auto& entry) {
+				f(std::as_const(entry.first), entry.second);
+			});
+			return;
+		}
+		Key* keys = this->keys();
+		T* values = this->values();
+		for (size_t i = 0; i < this->count; i++) {
+			f(std::as_const(keys[i]), values[i]);
+		}
+	}
+	template<class F>
+	void for_each(F&& f) const {
+		const_cast<SmallHashTable*>(this)->for_each([&](const Key& key, T& value) {
+			f(key, std::as_const(value));
+		});
+	}
+
+	hasher hash_function() const {
+		return this->table.hash_function();
+	}
+	key_equal key_eq() const {
+		return this->cmp;
+	}
+};